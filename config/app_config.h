@@ -127,4 +127,175 @@
 
 // </e>
 
+// <q> LED_STORAGE_JOURNAL_ENABLED  - Keep the LED state in an append-only journal
+// <i> Changes are appended as one-word deltas into two flash pages right below
+// <i> the FDS pages instead of updating an FDS record. Saves wear flash about
+// <i> 7x less than with FDS, see tools/fds_sim/journal_bench.sh.
+#ifndef LED_STORAGE_JOURNAL_ENABLED
+#define LED_STORAGE_JOURNAL_ENABLED 0
+#endif
+
+// <h> Buttons
+
+// <o> BUTTON_MAX_COUNT - Number of buttons that can be registered
+#ifndef BUTTON_MAX_COUNT
+#define BUTTON_MAX_COUNT 8
+#endif
+
+// <o> BUTTON_TICK_MS - Period of the timer shared by all buttons
+// <i> Runs only while a button is being debounced or a click or hold is pending.
+#ifndef BUTTON_TICK_MS
+#define BUTTON_TICK_MS 10
+#endif
+
+// <q> BUTTON_GPIOTE_HI_ACCURACY - Use a GPIOTE IN channel per button
+// <i> Off, the buttons share the PORT event: only the SENSE of their pins is
+// <i> set, and flipped after every edge, which costs no idle current and can
+// <i> wake the chip from System OFF. There are only 8 IN channels, and an
+// <i> enabled one keeps drawing current while the CPU sleeps.
+#ifndef BUTTON_GPIOTE_HI_ACCURACY
+#define BUTTON_GPIOTE_HI_ACCURACY 0
+#endif
+
+// <o> GPIOTE_CONFIG_NUM_OF_LOW_POWER_EVENTS - Number of lower power input pins
+// <i> Every button with a pin takes one, unless BUTTON_GPIOTE_HI_ACCURACY is set.
+#ifndef GPIOTE_CONFIG_NUM_OF_LOW_POWER_EVENTS
+#define GPIOTE_CONFIG_NUM_OF_LOW_POWER_EVENTS BUTTON_MAX_COUNT
+#endif
+
+#ifndef NRFX_GPIOTE_CONFIG_NUM_OF_LOW_POWER_EVENTS
+#define NRFX_GPIOTE_CONFIG_NUM_OF_LOW_POWER_EVENTS BUTTON_MAX_COUNT
+#endif
+
+// <o> BUTTON_CALLBACK_QUEUE_SIZE - Button callbacks waiting for the main loop
+// <i> A hold repeats every 50 ms, so 16 cover a main loop busy for most of a
+// <i> second. Newer callbacks are dropped when it is full.
+#ifndef BUTTON_CALLBACK_QUEUE_SIZE
+#define BUTTON_CALLBACK_QUEUE_SIZE 16
+#endif
+
+// <o> BUTTON_EVENTS_QUEUE_SIZE - Board button events waiting to be notified
+// <i> Events that come while a notification is in flight are sent together
+// <i> after it, up to 5 in one. Newer events are dropped when it is full.
+#ifndef BUTTON_EVENTS_QUEUE_SIZE
+#define BUTTON_EVENTS_QUEUE_SIZE 16
+#endif
+
+// <s> ESTC_PRESET_BUTTON_PINS - Pins of wall panel preset buttons, active low
+// <i> The button at index N recalls preset slot N on a click and stores
+// <i> the current LED state into it on a double click.
+// #define ESTC_PRESET_BUTTON_PINS NRF_GPIO_PIN_MAP(0, 2), NRF_GPIO_PIN_MAP(0, 29)
+
+// </h>
+
+// <e> ENCODER_ENABLED - Rotary encoder on the QDEC
+// <i> Turning the knob changes the brightness, or the hue after a double
+// <i> click of the board button. The QDEC debounces and counts the steps on
+// <i> its own, the CPU is only interrupted once per report period while the
+// <i> knob turns.
+#ifndef ENCODER_ENABLED
+#define ENCODER_ENABLED 0
+#endif
+
+// <o> ENCODER_PIN_A - Pin of the A contact
+#ifndef ENCODER_PIN_A
+#define ENCODER_PIN_A NRF_GPIO_PIN_MAP(1, 10)
+#endif
+
+// <o> ENCODER_PIN_B - Pin of the B contact
+#ifndef ENCODER_PIN_B
+#define ENCODER_PIN_B NRF_GPIO_PIN_MAP(1, 13)
+#endif
+
+// <o> ENCODER_SAMPLEPER - Sample period
+// <i> A step has to outlast two samples plus the contact bounce, or it is
+// <i> counted as a double transition and lost.
+// <0=> 128 us
+// <1=> 256 us
+// <2=> 512 us
+// <3=> 1024 us
+// <4=> 2048 us
+// <5=> 4096 us
+// <6=> 8192 us
+// <7=> 16384 us
+#ifndef ENCODER_SAMPLEPER
+#define ENCODER_SAMPLEPER 3
+#endif
+
+// <o> ENCODER_REPORTPER - Samples per report
+// <i> Sets the rate of the LED updates, 40 samples of 1024 us is one every 41 ms.
+// <0=> 10 samples
+// <1=> 40 samples
+// <2=> 80 samples
+// <3=> 120 samples
+// <4=> 160 samples
+// <5=> 200 samples
+// <6=> 240 samples
+// <7=> 280 samples
+#ifndef ENCODER_REPORTPER
+#define ENCODER_REPORTPER 1
+#endif
+
+// <o> ENCODER_STEPS_PER_DETENT - Quadrature steps between two detents
+#ifndef ENCODER_STEPS_PER_DETENT
+#define ENCODER_STEPS_PER_DETENT 4
+#endif
+
+#ifndef QDEC_ENABLED
+#define QDEC_ENABLED ENCODER_ENABLED
+#endif
+
+#ifndef NRFX_QDEC_ENABLED
+#define NRFX_QDEC_ENABLED ENCODER_ENABLED
+#endif
+
+// </e>
+
+// <e> LATENCY_TRACE_ENABLED - Trace the input to light latency
+// <i> Timestamps button edges and BLE writes until the PWM loads the new
+// <i> duty cycles. A traced LED update busy-waits up to one PWM period (100 us).
+#ifndef LATENCY_TRACE_ENABLED
+#define LATENCY_TRACE_ENABLED 0
+#endif
+
+// <o> LATENCY_TRACE_TIMEOUT_MS - Age at which an open trace is dropped
+// <i> Inputs that do not change the LED leave their trace open.
+#ifndef LATENCY_TRACE_TIMEOUT_MS
+#define LATENCY_TRACE_TIMEOUT_MS 1000
+#endif
+
+// </e>
+
+// <e> CPU_USAGE_ENABLED - Measure the CPU time asleep and per subsystem
+// <i> Published in the CPU usage characteristic at the end of every window.
+// <i> The SDK monitor (NRF_PWR_MGMT_CONFIG_CPU_USAGE_MONITOR_ENABLED) only
+// <i> logs the total and is left off.
+#ifndef CPU_USAGE_ENABLED
+#define CPU_USAGE_ENABLED 0
+#endif
+
+// <o> CPU_USAGE_WINDOW_MS - Length of a measurement window <100-60000>
+#ifndef CPU_USAGE_WINDOW_MS
+#define CPU_USAGE_WINDOW_MS 5000
+#endif
+
+// <q> CPU_USAGE_LOG_ENABLED - Log a line at the end of every window
+#ifndef CPU_USAGE_LOG_ENABLED
+#define CPU_USAGE_LOG_ENABLED 0
+#endif
+
+// </e>
+
+// <q> SYSOFF_ON_ADV_IDLE - Enter System OFF when advertising times out
+// <i> For battery builds: nobody connected within APP_ADV_DURATION, which also
+// <i> follows every disconnection. The chip powers down once the LED is off
+// <i> and its state is in flash, a press of any registered button wakes it
+// <i> through a reset. A mains powered controller keeps this off.
+#ifndef SYSOFF_ON_ADV_IDLE
+#define SYSOFF_ON_ADV_IDLE 0
+#endif
+
+// FDS geometry and garbage collection thresholds, see tools/fds_sim/fds_size.sh
+#include "led_storage_sizing.h"
+
 #endif
@@ -0,0 +1,26 @@
+/* Generated by tools/fds_sim/fds_size.sh, do not edit.
+ *
+ * Workload: 200 changes in 10 sessions a day, 2 bonded peers
+ * Lifetime target 10.0 years, estimated 176.1 years.
+ * LED state as an FDS record of 5 words per save (1.0 with the journal
+ * layout, estimated to last 999.0 years). */
+#ifndef LED_STORAGE_SIZING_H
+#define LED_STORAGE_SIZING_H
+
+// <o> FDS_VIRTUAL_PAGES - Number of virtual flash pages to use.
+// <i> Shared by the LED saves, the presets and the Peer Manager.
+#ifndef FDS_VIRTUAL_PAGES
+#define FDS_VIRTUAL_PAGES 3
+#endif
+
+// <o> LED_STORAGE_GC_FREEABLE_LIMIT_WORDS - Garbage collection starts once more words are freeable
+#ifndef LED_STORAGE_GC_FREEABLE_LIMIT_WORDS
+#define LED_STORAGE_GC_FREEABLE_LIMIT_WORDS 512
+#endif
+
+// <o> LED_STORAGE_GC_FREE_WORDS_FLOOR - Garbage collection can not wait below this many free words
+#ifndef LED_STORAGE_GC_FREE_WORDS_FLOOR
+#define LED_STORAGE_GC_FREE_WORDS_FLOOR 256
+#endif
+
+#endif /* LED_STORAGE_SIZING_H */
@@ -1,74 +1,507 @@
 #include "button.h"
 
+#include "nrf.h"
+#include "sdk_config.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+#include "app_scheduler.h"
+
+#include "nrfx_gpiote.h"
+
+#include "latency_trace.h"
+#include "cpu_usage.h"
+#include "cycle_counter.h"
+
+/*
+ * All buttons share one repeated app_timer that ticks every BUTTON_TICK_MS.
+ * A button only keeps countdowns in ticks, the timer runs while any of them
+ * is armed and is stopped once every button is idle, so the number of timer
+ * operations does not grow with the number of buttons.
+ * The GPIOTE and app_timer handlers run at the same IRQ priority, so the
+ * countdowns are never modified concurrently.
+ *
+ * An edge on a GPIO finds its button through m_pin_to_button, indexed by
+ * the pin number and holding the index into m_buttons plus one.
+ *
+ * Unless BUTTON_GPIOTE_HI_ACCURACY is set, the pins only have their SENSE
+ * set and all share the GPIOTE PORT event. The driver flips the sense
+ * level after every edge, so a press and a release are both seen, and
+ * button_wakeup_prepare() leaves the pins sensing a press for System OFF.
+ *
+ * A button with debounce_samples set integrates its pin on the same tick
+ * instead of restarting a countdown on every edge. Its GPIOTE input is off
+ * while it samples, so a burst of bounces costs a few samples rather than
+ * an interrupt per edge, and a clean press is taken after debounce_samples
+ * ticks.
+ *
+ * Clicks and holds are detected in the timer interrupt, but their callbacks
+ * wait in m_pending and run from the main loop, each with the app_timer
+ * counter of the interrupt that detected it. However many are pending, the
+ * module has at most one app_scheduler event queued to drain them, plus one
+ * to retry the tick, see BUTTON_SCHED_EVENTS_MAX. When m_pending is full
+ * the event is dropped, never run in the interrupt. The time they take
+ * there is measured with the DWT cycle counter.
+ */
+
+typedef enum {
+    button_evt_click,
+    button_evt_hold,
+    button_evt_hold_end
+} button_evt_type_t;
+
+typedef struct {
+    uint32_t time; /* app_timer counter in the interrupt that posted it */
+    uint8_t index;
+    uint8_t type;
+    uint8_t count; /* clicks or hold repeats */
+    uint8_t clicks; /* before a hold */
+} button_pending_evt_t;
+
+APP_TIMER_DEF(button_tick_timer);
+
+static button_t * m_buttons[BUTTON_MAX_COUNT];
+static uint8_t m_buttons_count;
+static bool m_tick_active;
+static bool m_tick_retry_queued;
+static bool m_tick_timer_created;
+
+static uint8_t m_pin_to_button[NUMBER_OF_PINS];
+
+/* Callbacks waiting for the main loop, put by the GPIOTE and timer
+ * interrupts, taken in a critical region by the main loop */
+static button_pending_evt_t m_pending[BUTTON_CALLBACK_QUEUE_SIZE];
+static uint8_t m_pending_head;
+static volatile uint8_t m_pending_count;
+static volatile bool m_pending_queued; /* the main loop has an event to drain them */
+
+static button_stats_t m_stats;
+static uint32_t m_event_time;      /* of the callback that is running */
+
+static uint16_t button_ms_to_ticks(uint16_t ms)
+{
+    return MAX(1, (ms + BUTTON_TICK_MS - 1) / BUTTON_TICK_MS);
+}
+
+static void button_tick_retry_run(void *p_event_data, uint16_t event_size);
+
+static void button_tick_start(void)
+{
+    if (m_tick_active)
+        return;
+
+    m_tick_active = (NRF_SUCCESS == app_timer_start(button_tick_timer,
+                                                    APP_TIMER_TICKS(BUTTON_TICK_MS),
+                                                    NULL));
+    if (m_tick_active)
+        return;
+
+    /* The app_timer operation queue is full. Nothing else would start the
+     * tick of a sampling button, its input is off: try again from the main
+     * loop, once the RTC interrupt has processed the queue */
+    m_stats.tick_start_failures++;
+
+    if (!m_tick_retry_queued)
+        m_tick_retry_queued = (NRF_SUCCESS == app_sched_event_put(NULL, 0, button_tick_retry_run));
+}
+
+static void button_tick_retry_run(void *p_event_data, uint16_t event_size)
+{
+    /* The tick state is shared with the GPIOTE and timer interrupts */
+    CRITICAL_REGION_ENTER();
+
+    m_tick_retry_queued = false;
+    button_tick_start();
+
+    CRITICAL_REGION_EXIT();
+}
+
+static bool button_is_pressed(button_t *b)
+{
+    if (b->callbacks->is_pressed != NULL)
+        return b->callbacks->is_pressed(b->p_context);
+
+    return nrf_gpio_pin_read(b->pin) == b->active_level;
+}
+
+static void button_event_run(button_t *b, button_evt_type_t type, uint8_t count, uint8_t clicks,
+                             uint32_t time)
+{
+    m_event_time = time;
+
+    switch (type)
+    {
+        case button_evt_click:
+            if (b->callbacks->onclick != NULL)
+                b->callbacks->onclick(b->p_context, count);
+            break;
+
+        case button_evt_hold:
+            if (b->callbacks->onhold != NULL)
+                b->callbacks->onhold(b->p_context, clicks, count);
+            break;
+
+        case button_evt_hold_end:
+            if (b->callbacks->onhold_end != NULL)
+                b->callbacks->onhold_end(b->p_context);
+            break;
+    }
+}
+
+static void button_sched_handler(void *p_event_data, uint16_t event_size)
+{
+    cpu_usage_subsystem_t cpu = cpu_usage_enter(CPU_USAGE_BUTTON);
+    uint32_t start = cycle_counter_get();
+    button_pending_evt_t evt;
+    bool pending;
+
+    /* An event put from now on queues the drain again */
+    m_pending_queued = false;
+
+    for (;;)
+    {
+        CRITICAL_REGION_ENTER();
+
+        pending = (m_pending_count != 0);
+
+        if (pending)
+        {
+            evt = m_pending[m_pending_head];
+            m_pending_head = (m_pending_head + 1) % BUTTON_CALLBACK_QUEUE_SIZE;
+            m_pending_count--;
+        }
+
+        CRITICAL_REGION_EXIT();
+
+        if (!pending)
+            break;
+
+        button_event_run(m_buttons[evt.index], evt.type, evt.count, evt.clicks, evt.time);
+    }
+
+    m_stats.deferred_us += cycle_counter_to_us(cycle_counter_get() - start);
+
+    cpu_usage_exit(cpu);
+}
+
+static void button_event_post(button_t *b, button_evt_type_t type, uint8_t count)
+{
+    button_pending_evt_t *evt;
+
+    if (m_pending_count == BUTTON_CALLBACK_QUEUE_SIZE)
+    {
+        /* Never run in the interrupt, it would race with the main loop */
+        m_stats.events_dropped++;
+        return;
+    }
+
+    evt = &m_pending[(m_pending_head + m_pending_count) % BUTTON_CALLBACK_QUEUE_SIZE];
+
+    evt->time = app_timer_cnt_get();
+    evt->index = b->index;
+    evt->type = type;
+    evt->count = count;
+    evt->clicks = b->hold_clicks;
+
+    m_pending_count++;
+
+    m_stats.events_deferred++;
+    m_stats.queue_depth_max = MAX(m_stats.queue_depth_max, m_pending_count);
+
+    /* One scheduler event drains all of them, a failed put is tried
+     * again with the next event */
+    if (!m_pending_queued)
+        m_pending_queued = (NRF_SUCCESS == app_sched_event_put(NULL, 0, button_sched_handler));
+}
+
+static bool button_countdown_expired(uint16_t *ticks)
+{
+    if (*ticks == 0)
+        return false;
+
+    return --(*ticks) == 0;
+}
+
 static void button_click_check(button_t *b)
 {
     if (!b->pressed_flag &&
         b->clicks_cnt != 0)
     {
-        b->callbacks.onclick(b->clicks_cnt);
+        button_event_post(b, button_evt_click, b->clicks_cnt);
         b->clicks_cnt = 0;
     }
 }   
 
 static void button_hold_check(button_t *b)
 {
-    if (!(b->callbacks.is_pressed() && b->pressed_flag))
+    if (!(button_is_pressed(b) && b->pressed_flag))
         return;
 
+    /* The held press is counted as a click too */
+    if (b->hold_repeats == 0)
+        b->hold_clicks = b->clicks_cnt - 1;
+
     b->clicks_cnt = 0;
-    b->callbacks.onhold();
-    app_timer_start(*(b->hold_timer_ptr), APP_TIMER_TICKS(b->timings.hold_pause_short_ms), (void *) b);
+    button_event_post(b, button_evt_hold, b->hold_repeats);
+    b->hold_repeats = MIN(b->hold_repeats + 1, UINT8_MAX);
+    b->hold_ticks = button_ms_to_ticks(b->timings->hold_pause_short_ms);
 }
 
-static void button_debounce_check(button_t *b)
+static void button_state_set(button_t *b, bool pressed)
 {
     /* rising */
-    if (b->callbacks.is_pressed() && !b->pressed_flag)
+    if (pressed && !b->pressed_flag)
     {
+        latency_trace_mark(LATENCY_POINT_DEBOUNCE);
+
         b->pressed_flag = true;
         b->clicks_cnt++;
-        app_timer_start(*(b->hold_timer_ptr), APP_TIMER_TICKS(b->timings.hold_pause_long_ms), (void *) b);
+        b->hold_repeats = 0;
+        b->hold_ticks = button_ms_to_ticks(b->timings->hold_pause_long_ms);
     }
 
     /* falling */
-    if (!b->callbacks.is_pressed() && b->pressed_flag)
+    if (!pressed && b->pressed_flag)
     {
+        latency_trace_mark(LATENCY_POINT_DEBOUNCE);
+
         b->pressed_flag = false;
-        app_timer_start(*(b->click_timer_ptr), APP_TIMER_TICKS(b->timings.dblclk_pause_ms), (void *) b);
+
+        if (b->hold_repeats != 0)
+            button_event_post(b, button_evt_hold_end, 0);
+
+        b->click_ticks = button_ms_to_ticks(b->timings->dblclk_pause_ms);
     }
 }
 
-static void button_debounce_timer_handler(void *ctx)
+static void button_debounce_check(button_t *b)
+{
+    button_state_set(b, button_is_pressed(b));
+}
+
+static void button_sample(button_t *b)
+{
+    uint8_t samples = b->timings->debounce_samples;
+
+    m_stats.samples++;
+
+    if (button_is_pressed(b))
+        b->integrator = MIN(b->integrator + 1, samples);
+    else if (b->integrator != 0)
+        b->integrator--;
+
+    if (b->integrator == samples)
+        button_state_set(b, true);
+    else if (b->integrator == 0)
+        button_state_set(b, false);
+    else
+        return;
+
+    /* Settled, edges take over again */
+    b->sampling = false;
+
+    if (b->pin == BUTTON_NO_PIN)
+        return;
+
+    nrfx_gpiote_in_event_enable(b->pin, true);
+
+    /* The sense level is set from the pin as it is now, an edge since the
+     * last sample would go unnoticed */
+    if (button_is_pressed(b) != b->pressed_flag)
+        button_first_run(b);
+}
+
+/* Returns true while the button still has a check armed */
+static bool button_tick(button_t *b)
 {
-    button_debounce_check((button_t *) ctx);
+    /* Debounce goes last, the checks it arms start counting on the next tick */
+    if (button_countdown_expired(&b->click_ticks))
+        button_click_check(b);
+
+    if (button_countdown_expired(&b->hold_ticks))
+        button_hold_check(b);
+
+    if (button_countdown_expired(&b->debounce_ticks))
+        button_debounce_check(b);
+
+    if (b->sampling)
+        button_sample(b);
+
+    return b->debounce_ticks != 0 || b->click_ticks != 0 || b->hold_ticks != 0 ||
+           b->sampling;
 }
 
-static void button_click_timer_handler(void *ctx)
+static void button_tick_timer_handler(void *ctx)
 {
-    button_click_check((button_t *) ctx);
+    cpu_usage_subsystem_t cpu = cpu_usage_enter(CPU_USAGE_BUTTON);
+    bool armed = false;
+    uint8_t i;
+
+    for (i = 0; i < m_buttons_count; i++)
+    {
+        armed |= button_tick(m_buttons[i]);
+    }
+
+    if (!armed)
+    {
+        m_tick_active = false;
+        app_timer_stop(button_tick_timer);
+    }
+
+    cpu_usage_exit(cpu);
 }
 
-static void button_hold_timer_handler(void *ctx)
+static void button_gpiote_handler(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
 {
-    button_hold_check((button_t *) ctx);
+    uint8_t index = m_pin_to_button[pin];
+    cpu_usage_subsystem_t cpu;
+
+    if (index == 0)
+        return;
+
+    cpu = cpu_usage_enter(CPU_USAGE_BUTTON);
+
+    m_stats.edge_irqs++;
+
+    /* Bounces restart the debounce, the trace starts at the first edge */
+    if (m_buttons[index - 1]->debounce_ticks == 0 && !m_buttons[index - 1]->sampling)
+        latency_trace_start(LATENCY_SOURCE_BUTTON);
+
+    button_first_run(m_buttons[index - 1]);
+
+    cpu_usage_exit(cpu);
 }
 
-void button_init(button_t *b,
-                 button_timings_t const * timings,
-                 button_callbacks_t const * callbacks)
+static ret_code_t button_gpio_init(uint32_t pin, nrf_gpio_pin_pull_t pull)
 {
+    nrfx_gpiote_in_config_t gpiote_config = NRFX_GPIOTE_CONFIG_IN_SENSE_TOGGLE(BUTTON_GPIOTE_HI_ACCURACY);
+    ret_code_t ret_code;
+
+    if (!nrfx_gpiote_is_init())
+    {
+        ret_code = nrfx_gpiote_init();
+
+        if (ret_code != NRF_SUCCESS)
+            return ret_code;
+    }
+
+    gpiote_config.pull = pull;
+
+    ret_code = nrfx_gpiote_in_init(pin, &gpiote_config, button_gpiote_handler);
+
+    if (ret_code != NRF_SUCCESS)
+        return ret_code;
+
+    nrfx_gpiote_in_event_enable(pin, true);
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t button_init(button_t *b, button_config_t const * config)
+{
+    ret_code_t ret_code;
+
+    if (m_buttons_count == BUTTON_MAX_COUNT)
+        return NRF_ERROR_NO_MEM;
+
+    if (config->pin != BUTTON_NO_PIN &&
+        (config->pin >= NUMBER_OF_PINS || m_pin_to_button[config->pin] != 0))
+        return NRF_ERROR_INVALID_PARAM;
+
+    if (!m_tick_timer_created)
+    {
+        ret_code = app_timer_create(&button_tick_timer,
+                                    APP_TIMER_MODE_REPEATED,
+                                    button_tick_timer_handler);
+
+        if (ret_code != NRF_SUCCESS)
+            return ret_code;
+
+        m_tick_timer_created = true;
+
+        cycle_counter_init();
+    }
+
+    b->timings = config->timings;
+    b->callbacks = config->callbacks;
+    b->p_context = config->p_context;
+    b->debounce_ticks = 0;
+    b->click_ticks = 0;
+    b->hold_ticks = 0;
+    b->index = m_buttons_count;
+    b->pin = config->pin;
+    b->active_level = config->active_level;
     b->pressed_flag = false;
     b->clicks_cnt = 0;
-    b->timings = *timings;
-    b->callbacks = *callbacks;
+    b->hold_repeats = 0;
+    b->hold_clicks = 0;
+    b->integrator = 0;
+    b->sampling = false;
+
+    m_buttons[m_buttons_count] = b;
+
+    /* The pin is mapped before its events are enabled, so no edge is missed */
+    if (config->pin != BUTTON_NO_PIN)
+    {
+        m_pin_to_button[config->pin] = m_buttons_count + 1;
 
-    app_timer_create(b->debounce_timer_ptr, APP_TIMER_MODE_SINGLE_SHOT, button_debounce_timer_handler);
-    app_timer_create(b->click_timer_ptr, APP_TIMER_MODE_SINGLE_SHOT, button_click_timer_handler);
-    app_timer_create(b->hold_timer_ptr, APP_TIMER_MODE_SINGLE_SHOT, button_hold_timer_handler);
+        ret_code = button_gpio_init(config->pin, config->pull);
+
+        if (ret_code != NRF_SUCCESS)
+        {
+            m_pin_to_button[config->pin] = 0;
+            return ret_code;
+        }
+    }
+
+    m_buttons_count++;
+
+    return NRF_SUCCESS;
 }
 
 void button_first_run(button_t *b)
 {
-    app_timer_start(*(b->debounce_timer_ptr), APP_TIMER_TICKS(b->timings.debounce_period_ms), (void *) b);
+    if (b->timings->debounce_samples == 0)
+    {
+        b->debounce_ticks = button_ms_to_ticks(b->timings->debounce_period_ms);
+    }
+    else if (!b->sampling)
+    {
+        /* The bounces are not interrupts any more, only samples */
+        if (b->pin != BUTTON_NO_PIN)
+            nrfx_gpiote_in_event_disable(b->pin);
+
+        b->integrator = b->pressed_flag ? b->timings->debounce_samples : 0;
+        b->sampling = true;
+    }
+
+    button_tick_start();
 }
 
+void button_wakeup_prepare(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < m_buttons_count; i++)
+    {
+        button_t *b = m_buttons[i];
+
+        if (b->pin == BUTTON_NO_PIN)
+            continue;
+
+        /* Also clears the sense the driver left for the next edge */
+        nrfx_gpiote_in_event_disable(b->pin);
+
+        nrf_gpio_cfg_sense_set(b->pin, b->active_level ? NRF_GPIO_PIN_SENSE_HIGH
+                                                       : NRF_GPIO_PIN_SENSE_LOW);
+    }
+}
+
+uint32_t button_event_time_get(void)
+{
+    return m_event_time;
+}
+
+void button_stats_get(button_stats_t *stats)
+{
+    *stats = m_stats;
+}
@@ -8,55 +8,106 @@ extern "C" {
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "sdk_errors.h"
 #include "app_timer.h"
+#include "nrf_gpio.h"
 
+/* The button is not wired to a GPIO, edges are reported with button_first_run */
+#define BUTTON_NO_PIN 0xFF
+
+/* All periods are rounded up to BUTTON_TICK_MS and may fire up to one tick early.
+ * With debounce_samples set, an edge disables the GPIOTE input and the pin
+ * is sampled once per tick into an integrator instead: the state changes
+ * when debounce_samples more samples agree with it than disagree, and the
+ * input is enabled again once the integrator is back at a rail.
+ * debounce_period_ms is not used then */
 typedef struct {
     uint16_t dblclk_pause_ms; 
     uint16_t hold_pause_short_ms; 
     uint16_t hold_pause_long_ms; 
     uint16_t debounce_period_ms;
+    uint8_t debounce_samples;
 } button_timings_t;
 
+/* onclick and onhold are called from the main loop through app_scheduler,
+ * is_pressed from the timer interrupt. p_context is the one given in
+ * button_config_t, any callback may be NULL */
 typedef struct {
-    void (*onclick)(uint8_t);
-    void (*onhold)(void);
-    bool (*is_pressed)(void);
+    void (*onclick)(void *p_context, uint8_t clicks);
+    /* clicks: presses before the held one within the same gesture, 0 for a
+     * plain hold. repeat is 0 when the hold starts */
+    void (*onhold)(void *p_context, uint8_t clicks, uint8_t repeat);
+    void (*onhold_end)(void *p_context);             /* released after a hold */
+    bool (*is_pressed)(void *p_context); /* NULL reads the pin */
 } button_callbacks_t;
 
 typedef struct {
+    uint32_t pin;          /* BUTTON_NO_PIN for inputs that are not a GPIO */
+    uint8_t active_level;
+    nrf_gpio_pin_pull_t pull;
+
+    button_timings_t const * timings;
+    button_callbacks_t const * callbacks;
+    void * p_context;
+} button_config_t;
+
+typedef struct {
+    button_timings_t const * timings;
+    button_callbacks_t const * callbacks;
+    void * p_context;
+
+    /* Ticks left until the check runs, 0 if it is not armed */
+    uint16_t debounce_ticks;
+    uint16_t click_ticks;
+    uint16_t hold_ticks;
+
+    uint8_t index;
+    uint8_t pin;
+    uint8_t active_level;
     bool pressed_flag;
     uint8_t clicks_cnt;
+    uint8_t hold_repeats;
+    uint8_t hold_clicks;
+    uint8_t integrator;
+    bool sampling;
+} button_t;
 
-    button_timings_t timings;
-    button_callbacks_t callbacks;
+typedef struct {
+    uint32_t events_deferred; /* callbacks left to the main loop */
+    uint32_t events_dropped;  /* callbacks lost, BUTTON_CALLBACK_QUEUE_SIZE were pending */
+    uint32_t queue_depth_max; /* most callbacks pending at once */
+    uint32_t deferred_us;     /* callback time moved out of the interrupt */
+    uint32_t edge_irqs;       /* GPIOTE events of all buttons */
+    uint32_t samples;         /* pin samples taken by integrating debouncers */
+    uint32_t tick_start_failures; /* app_timer_start of the tick rejected, retried */
+} button_stats_t;
 
-    app_timer_id_t * debounce_timer_ptr;
-    app_timer_id_t * click_timer_ptr;
-    app_timer_id_t * hold_timer_ptr;
-} button_t;
+/* Entries the buttons take in the app_scheduler queue at most, with no
+ * event data: draining the callbacks and retrying the tick */
+#define BUTTON_SCHED_EVENTS_MAX 2
 
-#define BUTTON_DEF(BUTTON_NAME)\
-APP_TIMER_DEF(CONCAT_2(BUTTON_NAME, _debounce_timer));\
-APP_TIMER_DEF(CONCAT_2(BUTTON_NAME, _click_timer));\
-APP_TIMER_DEF(CONCAT_2(BUTTON_NAME, _hold_timer));\
-\
-static volatile button_t BUTTON_NAME = \
-{\
-    false,\
-    0,\
-    (button_timings_t) {0, 0, 0, 0},\
-    (button_callbacks_t) {NULL, NULL, NULL},\
-    (app_timer_id_t * const) &CONCAT_2(BUTTON_NAME, _debounce_timer),\
-    (app_timer_id_t * const) &CONCAT_2(BUTTON_NAME, _click_timer),\
-    (app_timer_id_t * const) &CONCAT_2(BUTTON_NAME, _hold_timer)\
-}
+#define BUTTON_DEF(BUTTON_NAME) static button_t BUTTON_NAME
 
-void button_init(button_t *b,
-                 button_timings_t const * timings,
-                 button_callbacks_t const * callbacks);
+/* Registers the button and, if it has a pin, enables its GPIOTE input.
+ * Timings and callbacks are referenced, not copied, they must stay valid.
+ * Returns NRF_ERROR_NO_MEM if BUTTON_MAX_COUNT buttons are registered */
+ret_code_t button_init(button_t *b, button_config_t const * config);
 
+/* Call on every edge of an input without a pin, (re)starts the debounce period
+ * or the sampling */
 void button_first_run(button_t *b);
 
+/* Disables the GPIOTE inputs and sets every button pin to sense its pressed
+ * level, so that a press wakes the chip from System OFF. Call last before
+ * entering it, the buttons do not work afterwards */
+void button_wakeup_prepare(void);
+
+/* app_timer counter when the event of the running callback was detected,
+ * in the interrupt, however long it waited for the main loop */
+uint32_t button_event_time_get(void);
+
+void button_stats_get(button_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,125 @@
+#include "button_events.h"
+
+#include "app_util.h"
+
+#include "nrf_log.h"
+
+/*
+ * The SoftDevice sends the queued notifications at the next connection
+ * event and reports them with HVN_TX_COMPLETE after it. Only one batch is
+ * handed over at a time, so the events that come in the meantime go out
+ * together in a single notification one connection interval later, while
+ * a lone event is sent at once.
+ *
+ * The timestamps come from the RTC that drives app_timer and are taken in
+ * the button interrupt, the order and spacing of the events survive however
+ * long they waited for the main loop and however they are batched.
+ *
+ * HVN_TX_COMPLETE counts the notifications of every characteristic on the
+ * link. The SoftDevice sends them in order, so ours are taken as done with
+ * the first ones counted, at worst a batch is handed over while another one
+ * of ours is still queued behind the others. NRF_ERROR_RESOURCES waits for
+ * any of them.
+ *
+ * Events are put from the main loop, where HVN_TX_COMPLETE is handled too.
+ */
+
+static uint32_t m_queue[BUTTON_EVENTS_QUEUE_SIZE];
+static uint8_t m_head;
+static uint8_t m_count;
+static uint8_t m_in_flight; /* our notifications not reported complete yet */
+static bool m_sd_queue_full;
+
+static button_events_send_t m_send;
+
+static void button_events_flush(void)
+{
+    uint32_t batch[BUTTON_EVENTS_BATCH_MAX];
+    uint8_t batch_count;
+    ret_code_t ret_code;
+    uint8_t i;
+
+    if (m_in_flight > 0 || m_sd_queue_full || m_count == 0)
+    {
+        return;
+    }
+
+    batch_count = MIN(m_count, BUTTON_EVENTS_BATCH_MAX);
+
+    for (i = 0; i < batch_count; i++)
+    {
+        batch[i] = m_queue[(m_head + i) % BUTTON_EVENTS_QUEUE_SIZE];
+    }
+
+    ret_code = m_send(batch, batch_count * sizeof(uint32_t));
+
+    if (ret_code == NRF_ERROR_RESOURCES)
+    {
+        /* The SoftDevice queue is full of other notifications */
+        m_sd_queue_full = true;
+        return;
+    }
+
+    if (ret_code == NRF_SUCCESS)
+    {
+        m_in_flight++;
+
+        m_head = (m_head + batch_count) % BUTTON_EVENTS_QUEUE_SIZE;
+        m_count -= batch_count;
+    }
+    else
+    {
+        /* Nobody listens */
+        m_head = 0;
+        m_count = 0;
+    }
+}
+
+void button_events_put(button_event_type_t type, uint8_t clicks, uint32_t time)
+{
+    uint32_t event;
+
+    if (m_send == NULL)
+    {
+        return;
+    }
+
+    event = (time & BUTTON_EVENT_TIME_MASK) |
+            ((uint32_t) type << BUTTON_EVENT_TYPE_POS) |
+            ((uint32_t) MIN(clicks, BUTTON_EVENT_CLICKS_MAX) << BUTTON_EVENT_CLICKS_POS);
+
+    if (m_count == BUTTON_EVENTS_QUEUE_SIZE)
+    {
+        NRF_LOG_DEBUG("Button event queue is full");
+        return;
+    }
+
+    m_queue[(m_head + m_count) % BUTTON_EVENTS_QUEUE_SIZE] = event;
+    m_count++;
+
+    button_events_flush();
+}
+
+void button_events_on_tx_complete(uint8_t count)
+{
+    /* Any notification may have freed the SoftDevice queue */
+    m_sd_queue_full = false;
+    m_in_flight -= MIN(count, m_in_flight);
+
+    button_events_flush();
+}
+
+void button_events_reset(void)
+{
+    m_head = 0;
+    m_count = 0;
+    m_in_flight = 0;
+    m_sd_queue_full = false;
+}
+
+void button_events_init(button_events_send_t send)
+{
+    m_send = send;
+
+    button_events_reset();
+}
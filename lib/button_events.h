@@ -0,0 +1,58 @@
+#ifndef BUTTON_EVENTS_H
+#define BUTTON_EVENTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_config.h"
+#include "sdk_errors.h"
+
+#include "ble_gatt.h"
+
+/*
+ * Every event is one little-endian uint32_t:
+ *   bits  0..23 the RTC1 counter when it happened, 32768 Hz, wraps every 512 s
+ *   bits 24..25 button_event_type_t
+ *   bits 26..31 the clicks, capped at 63
+ */
+#define BUTTON_EVENT_TIME_MASK 0x00FFFFFFUL
+#define BUTTON_EVENT_TYPE_POS 24
+#define BUTTON_EVENT_CLICKS_POS 26
+#define BUTTON_EVENT_CLICKS_MAX 63
+
+/* As many as fit a notification at the default MTU */
+#define BUTTON_EVENTS_BATCH_MAX ((BLE_GATT_ATT_MTU_DEFAULT - 3) / sizeof(uint32_t))
+
+typedef enum {
+    BUTTON_EVENT_CLICK = 0,  /* clicks: the number of clicks */
+    BUTTON_EVENT_HOLD_START, /* clicks: the clicks before the held press */
+    BUTTON_EVENT_HOLD_END
+} button_event_type_t;
+
+/* Queues the events for a notification. Returns NRF_ERROR_RESOURCES to have
+ * them sent again after the next notification went out, anything else but
+ * NRF_SUCCESS drops them */
+typedef ret_code_t (*button_events_send_t)(uint32_t const *events, uint16_t len);
+
+void button_events_init(button_events_send_t send);
+
+/* time: the app_timer counter when the button saw the event, see
+ * button_event_time_get(). It is sent at once unless a notification is
+ * still in flight, then with the ones after it once that one went out */
+void button_events_put(button_event_type_t type, uint8_t clicks, uint32_t time);
+
+/* On BLE_GATTS_EVT_HVN_TX_COMPLETE, count: the notifications it reports */
+void button_events_on_tx_complete(uint8_t count);
+
+/* On connection and disconnection, the events of an old link are dropped */
+void button_events_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BUTTON_EVENTS_H */
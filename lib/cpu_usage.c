@@ -0,0 +1,184 @@
+#include "cpu_usage.h"
+
+#if CPU_USAGE_ENABLED
+
+#include <string.h>
+
+#include "app_timer.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+
+#include "nrf_log.h"
+
+#include "event_loop.h"
+#include "cycle_counter.h"
+
+/*
+ * The DWT cycle counter runs on the CPU clock, which stops while
+ * nrf_pwr_mgmt_run() waits for an event. So the cycles counted over a
+ * window of the RTC are the active time, and the rest of the window is
+ * the time asleep. With a debugger attached the clock may keep running
+ * and the idle time reads low.
+ *
+ * The instrumented code marks which subsystem runs. Every switch charges
+ * the cycles since the previous one to the subsystem that was running, so a
+ * nested subsystem (a PWM update from a BLE write) is not counted twice.
+ * Subsystems are entered from interrupts as well, so a switch is done in a
+ * critical region.
+ *
+ * Code that is not marked never switches, its cycles go to whatever was
+ * marked when it started. CPU_USAGE_OTHER is only the time while nothing is
+ * marked. An unmarked interrupt (app_timer, USB, PWM) or the SoftDevice
+ * preempting a marked subsystem is charged to that subsystem, so a busy
+ * link inflates the subsystem it happens to interrupt.
+ *
+ * The window is closed in the RTC interrupt, the report and the log line
+ * come from the main loop.
+ */
+
+STATIC_ASSERT(CPU_USAGE_WINDOW_MS <= 60000); /* the cycle counter wraps after 67 s at 64 MHz */
+
+APP_TIMER_DEF(cpu_usage_timer);
+
+static cpu_usage_handler_t m_handler;
+
+static cpu_usage_subsystem_t m_current;
+static uint32_t m_mark;
+static uint32_t m_cycles[CPU_USAGE_COUNT];
+
+static uint32_t m_window_start_ticks;
+
+static cpu_usage_stats_t m_stats;
+
+static void cpu_usage_charge(void)
+{
+    uint32_t now = cycle_counter_get();
+
+    m_cycles[m_current] += now - m_mark;
+    m_mark = now;
+}
+
+cpu_usage_subsystem_t cpu_usage_enter(cpu_usage_subsystem_t subsystem)
+{
+    cpu_usage_subsystem_t previous;
+
+    CRITICAL_REGION_ENTER();
+
+    cpu_usage_charge();
+
+    previous = m_current;
+    m_current = subsystem;
+
+    CRITICAL_REGION_EXIT();
+
+    return previous;
+}
+
+void cpu_usage_exit(cpu_usage_subsystem_t previous)
+{
+    CRITICAL_REGION_ENTER();
+
+    cpu_usage_charge();
+
+    m_current = previous;
+
+    CRITICAL_REGION_EXIT();
+}
+
+static uint16_t permille(uint64_t us, uint64_t window_us)
+{
+    return (uint16_t) ((us * 1000 + window_us / 2) / window_us);
+}
+
+static void cpu_usage_report_run(void *p_event_data, uint16_t event_size)
+{
+    cpu_usage_stats_t stats;
+
+    CRITICAL_REGION_ENTER();
+    stats = m_stats;
+    CRITICAL_REGION_EXIT();
+
+    if (m_handler != NULL)
+    {
+        m_handler(&stats);
+    }
+
+#if CPU_USAGE_LOG_ENABLED
+    NRF_LOG_INFO("CPU %d.%d%% idle: unmarked %d, BLE %d, PWM %d, FDS %d, log %d, button %d permille "
+                 "(interrupts included)",
+                 stats.idle_permille / 10,
+                 stats.idle_permille % 10,
+                 stats.active_permille[CPU_USAGE_OTHER],
+                 stats.active_permille[CPU_USAGE_BLE],
+                 stats.active_permille[CPU_USAGE_PWM],
+                 stats.active_permille[CPU_USAGE_FDS],
+                 stats.active_permille[CPU_USAGE_LOG],
+                 stats.active_permille[CPU_USAGE_BUTTON]);
+#endif
+}
+
+EVENT_LOOP_WORK_DEF(cpu_usage_report_work, cpu_usage_report_run);
+
+static void cpu_usage_timer_handler(void *ctx)
+{
+    uint32_t cycles[CPU_USAGE_COUNT];
+    uint32_t now_ticks = app_timer_cnt_get();
+    uint64_t window_us;
+    uint64_t active_us = 0;
+    uint64_t us;
+    uint8_t i;
+
+    CRITICAL_REGION_ENTER();
+
+    cpu_usage_charge();
+
+    memcpy(cycles, m_cycles, sizeof(cycles));
+    memset(m_cycles, 0, sizeof(m_cycles));
+
+    CRITICAL_REGION_EXIT();
+
+    window_us = (uint64_t) app_timer_cnt_diff_compute(now_ticks, m_window_start_ticks) *
+                1000000 / APP_TIMER_CLOCK_FREQ;
+
+    m_window_start_ticks = now_ticks;
+
+    if (window_us == 0)
+    {
+        return;
+    }
+
+    /* Every cycle is charged to some subsystem, together they are the
+     * active time of the window */
+    m_stats.window_ms = window_us / 1000;
+
+    for (i = 0; i < CPU_USAGE_COUNT; i++)
+    {
+        us = cycle_counter_to_us(cycles[i]);
+        active_us += us;
+
+        m_stats.active_permille[i] = permille(us, window_us);
+    }
+
+    m_stats.idle_permille = permille(window_us - MIN(active_us, window_us), window_us);
+
+    event_loop_defer(&cpu_usage_report_work);
+}
+
+void cpu_usage_init(cpu_usage_handler_t handler)
+{
+    m_handler = handler;
+
+    cycle_counter_init();
+
+    m_current = CPU_USAGE_OTHER;
+    m_mark = cycle_counter_get();
+    m_window_start_ticks = app_timer_cnt_get();
+
+    app_timer_create(&cpu_usage_timer,
+                     APP_TIMER_MODE_REPEATED,
+                     cpu_usage_timer_handler);
+
+    app_timer_start(cpu_usage_timer, APP_TIMER_TICKS(CPU_USAGE_WINDOW_MS), NULL);
+}
+
+#endif /* CPU_USAGE_ENABLED */
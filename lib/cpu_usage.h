@@ -0,0 +1,59 @@
+#ifndef CPU_USAGE_H
+#define CPU_USAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_config.h"
+
+typedef enum {
+    CPU_USAGE_OTHER = 0, /* nothing marked: the main loop, unmarked interrupts and
+                          * the SoftDevice when they do not preempt a subsystem */
+    CPU_USAGE_BLE,       /* BLE event handlers */
+    CPU_USAGE_PWM,       /* LED updates */
+    CPU_USAGE_FDS,       /* storage flushes, garbage collection, FDS events */
+    CPU_USAGE_LOG,       /* log processing and the USB backend */
+    CPU_USAGE_BUTTON,    /* button interrupts and callbacks */
+    CPU_USAGE_COUNT
+} cpu_usage_subsystem_t;
+
+/* One measurement window, in thousandths of it. Idle and the active
+ * subsystems add up to the whole window. A subsystem includes the unmarked
+ * interrupts and SoftDevice events that preempted it */
+typedef struct {
+    uint16_t window_ms;
+    uint16_t idle_permille;
+    uint16_t active_permille[CPU_USAGE_COUNT];
+} cpu_usage_stats_t;
+
+/* Called from the main loop at the end of every window */
+typedef void (*cpu_usage_handler_t)(cpu_usage_stats_t const *stats);
+
+#if CPU_USAGE_ENABLED
+
+void cpu_usage_init(cpu_usage_handler_t handler);
+
+/* Charges the time from here to cpu_usage_exit() to the subsystem, minus
+ * the subsystems entered in the meantime. Returns what to pass to
+ * cpu_usage_exit() */
+cpu_usage_subsystem_t cpu_usage_enter(cpu_usage_subsystem_t subsystem);
+
+void cpu_usage_exit(cpu_usage_subsystem_t previous);
+
+#else
+
+static inline void cpu_usage_init(cpu_usage_handler_t handler) {}
+static inline cpu_usage_subsystem_t cpu_usage_enter(cpu_usage_subsystem_t subsystem) { return CPU_USAGE_OTHER; }
+static inline void cpu_usage_exit(cpu_usage_subsystem_t previous) {}
+
+#endif /* CPU_USAGE_ENABLED */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CPU_USAGE_H */
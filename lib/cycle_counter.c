@@ -0,0 +1,19 @@
+#include "cycle_counter.h"
+
+#include "nrf.h"
+
+void cycle_counter_init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+
+uint32_t cycle_counter_get(void)
+{
+    return DWT->CYCCNT;
+}
+
+uint32_t cycle_counter_to_us(uint32_t cycles)
+{
+    return cycles / (SystemCoreClock / 1000000);
+}
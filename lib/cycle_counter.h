@@ -0,0 +1,23 @@
+#ifndef CYCLE_COUNTER_H
+#define CYCLE_COUNTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/* Starts the DWT cycle counter, every module that reads it calls this */
+void cycle_counter_init(void);
+
+/* CPU cycles, wraps after 67 s at 64 MHz: only the difference of two
+ * readings is meaningful */
+uint32_t cycle_counter_get(void);
+
+uint32_t cycle_counter_to_us(uint32_t cycles);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CYCLE_COUNTER_H */
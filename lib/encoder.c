@@ -0,0 +1,110 @@
+#include "encoder.h"
+
+#if ENCODER_ENABLED
+
+#include <stdlib.h>
+
+#include "app_util_platform.h"
+#include "app_scheduler.h"
+
+#include "nrfx_qdec.h"
+#include "nrf_gpio.h"
+
+#include "nrf_log.h"
+
+/*
+ * The QDEC samples both inputs every ENCODER_SAMPLEPER through its debounce
+ * filter and counts the steps in ACC without the CPU. It raises REPORTRDY
+ * only after ENCODER_REPORTPER samples with a non-zero ACC, so the knob
+ * costs one interrupt per report period while it turns and none while it
+ * rests, however fast its contacts bounce.
+ *
+ * The interrupt adds the report to m_steps and queues one app_scheduler
+ * event if none is pending yet, reports that come before the main loop
+ * gets to it are merged into the same call. Steps short of a detent are
+ * kept for the next report.
+ */
+
+static encoder_handler_t m_handler;
+static encoder_stats_t m_stats;
+
+static int32_t m_steps; /* not yet passed to the handler */
+static bool m_queued;
+
+static void encoder_sched_handler(void *p_event_data, uint16_t event_size)
+{
+    int16_t detents;
+
+    CRITICAL_REGION_ENTER();
+
+    detents = m_steps / ENCODER_STEPS_PER_DETENT;
+    m_steps -= detents * ENCODER_STEPS_PER_DETENT;
+    m_queued = false;
+
+    CRITICAL_REGION_EXIT();
+
+    if (detents != 0)
+    {
+        m_stats.batches++;
+        m_handler(detents);
+    }
+}
+
+static void encoder_qdec_handler(nrfx_qdec_event_t event)
+{
+    if (event.type != NRF_QDEC_EVENT_REPORTRDY)
+        return;
+
+    m_stats.reports++;
+    m_stats.steps += event.data.report.acc;
+    m_stats.double_steps += event.data.report.accdbl;
+
+    m_steps += event.data.report.acc;
+
+    if (m_queued || abs(m_steps) < ENCODER_STEPS_PER_DETENT)
+        return;
+
+    if (app_sched_event_put(NULL, 0, encoder_sched_handler) == NRF_SUCCESS)
+        m_queued = true;
+    else
+        m_stats.queue_full++;
+}
+
+ret_code_t encoder_init(encoder_handler_t handler)
+{
+    nrfx_qdec_config_t config = NRFX_QDEC_DEFAULT_CONFIG;
+    ret_code_t ret_code;
+
+    m_handler = handler;
+
+    config.reportper = (nrf_qdec_reportper_t) ENCODER_REPORTPER;
+    config.sampleper = (nrf_qdec_sampleper_t) ENCODER_SAMPLEPER;
+    config.psela = ENCODER_PIN_A;
+    config.pselb = ENCODER_PIN_B;
+    config.pselled = NRF_QDEC_LED_NOT_CONNECTED;
+    config.dbfen = true;
+    config.sample_inten = false;
+
+    /* The contacts of a mechanical encoder switch to ground */
+    nrf_gpio_cfg_input(ENCODER_PIN_A, NRF_GPIO_PIN_PULLUP);
+    nrf_gpio_cfg_input(ENCODER_PIN_B, NRF_GPIO_PIN_PULLUP);
+
+    ret_code = nrfx_qdec_init(&config, encoder_qdec_handler);
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        NRF_LOG_ERROR("QDEC init failed: %d", ret_code);
+        return ret_code;
+    }
+
+    nrfx_qdec_enable();
+
+    return NRF_SUCCESS;
+}
+
+void encoder_stats_get(encoder_stats_t *stats)
+{
+    *stats = m_stats;
+}
+
+#endif /* ENCODER_ENABLED */
@@ -0,0 +1,40 @@
+#ifndef ENCODER_H
+#define ENCODER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_config.h"
+#include "sdk_errors.h"
+
+/* Entries the encoder takes in the app_scheduler queue at most, a report
+ * waits until the previous one was handled */
+#define ENCODER_SCHED_EVENTS_MAX (ENCODER_ENABLED ? 1 : 0)
+
+/* Called from the main loop through app_scheduler with the detents turned
+ * since the last call, positive when A leads B */
+typedef void (*encoder_handler_t)(int16_t detents);
+
+typedef struct {
+    uint32_t reports;      /* REPORTRDY interrupts */
+    uint32_t batches;      /* handler calls */
+    int32_t steps;         /* net quadrature steps counted by the QDEC */
+    uint32_t double_steps; /* both inputs changed within a sample, the step is lost */
+    uint32_t queue_full;   /* reports kept for the next one, the scheduler queue was full */
+} encoder_stats_t;
+
+/* Starts the QDEC on ENCODER_PIN_A and ENCODER_PIN_B with its debounce
+ * filter on. The handler is referenced until the end */
+ret_code_t encoder_init(encoder_handler_t handler);
+
+void encoder_stats_get(encoder_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ENCODER_H */
@@ -2,6 +2,7 @@
 
 #include "app_error.h"
 #include "app_timer.h"
+#include "app_util_platform.h"
 
 #include "nrf_log.h"
 #include "nrf_log_ctrl.h"
@@ -12,23 +13,25 @@
 #include "ble_gatts.h"
 #include "ble_srv_common.h"
 
-#include "fds.h"
-#include "fds_internal_defs.h"
-
 #include "nrf_gpio.h"
 
-#include "nrfx_gpiote.h"
-
 #include "button.h"
 #include "pwm_wrap.h"
 #include "led_common.h"
+#include "led_storage.h"
+#include "led_presets.h"
+#include "led_retained.h"
+#include "latency_trace.h"
+#include "encoder.h"
+#include "led_color.h"
+#include "gesture.h"
+#include "button_events.h"
+#include "event_loop.h"
+#include "cpu_usage.h"
 
 #define ESTC_BLE_SERVICE_NOTIFYING_DELAY_MS 100
 APP_TIMER_DEF(notify_led_timer);
 
-#define LED_STORAGE_INDICATION_DELAY_MS 500
-APP_TIMER_DEF(led_storage_clean_timer);
-
 #define BUTTON_GPIO NRF_GPIO_PIN_MAP(1,  6)
 #define BUTTON_ACTIVE_LEVEL 0
 
@@ -40,16 +43,17 @@ static ret_code_t estc_ble_add_characteristics(ble_estc_service_t *service, void
 
 extern ble_estc_service_t m_estc_service; 
 
-#define ESTC_BLE_SERVICE_LED_SAVES_FILE_ID 0xBEEF
-#define ESTC_BLE_SERVICE_LED_SAVES_RECORD_KEY 0xBABE
-
 static const led_params_t led_params_default = {
     .color = (rgb_t) {0xff, 0x00, 0xff},
-    .state = 0x01
+    .state = 0x01,
+    .brightness = LED_BRIGHTNESS_MAX
 };
 
 static volatile led_params_t led_params = led_params_default;
 
+/* The state survived the reset in RAM, the flash copy is not needed */
+static bool led_params_retained;
+
 enum {
     pwm_channel_indicator = 0,
     pwm_channel_red,
@@ -74,29 +78,79 @@ static pwm_wrapper_t estc_ble_service_pwm =
     .seq = &estc_ble_service_pwm_seq
 };
 
-static void led_set_color(rgb_t color)
+static uint16_t led_channel_duty(uint8_t value, uint8_t brightness)
+{
+    return ((uint32_t) value * brightness * pwm_max_pct) / (255 * 255);
+}
+
+static void led_set_color(rgb_t color, uint8_t brightness)
 {
     pwm_set_duty_cycle(&estc_ble_service_pwm,
                        pwm_channel_red,
-                       ((uint16_t) color.r * pwm_max_pct) / 255);
+                       led_channel_duty(color.r, brightness));
 
     pwm_set_duty_cycle(&estc_ble_service_pwm,
                        pwm_channel_green,
-                       ((uint16_t) color.g * pwm_max_pct) / 255);
+                       led_channel_duty(color.g, brightness));
 
     pwm_set_duty_cycle(&estc_ble_service_pwm,
                        pwm_channel_blue,
-                       ((uint16_t) color.b * pwm_max_pct) / 255);
+                       led_channel_duty(color.b, brightness));
+}
+
+/* Set while the input that opened the latency trace is handled. Only the
+ * first LED update it causes ends the trace, the dim ramp, the encoder and
+ * the restores at boot leave it alone */
+static bool led_update_traced;
+
+static void led_trace_begin(void)
+{
+    led_update_traced = true;
+}
+
+static void led_trace_end(void)
+{
+    led_update_traced = false;
+
+    /* The input did not change the LED, do not let a later update close the trace */
+    latency_trace_abort();
 }
 
 static void led_update(led_params_t *params)
 {
     static const rgb_t black = (rgb_t) {0, 0, 0};
+    cpu_usage_subsystem_t cpu = cpu_usage_enter(CPU_USAGE_PWM);
+    bool traced = led_update_traced;
+
+    led_update_traced = false;
+
+    led_set_color(params->state ? params->color : black, params->brightness);
+
+    /* Only a traced update waits for the PWM to load the new duty cycles */
+    if (traced && latency_trace_mark(LATENCY_POINT_LED_UPDATE))
+    {
+        if (pwm_wait_reload(&estc_ble_service_pwm))
+            latency_trace_mark(LATENCY_POINT_PWM_RELOAD);
+        else
+            latency_trace_abort();
+    }
 
-    led_set_color(params->state ? params->color : black);
+    led_retained_store(params);
+
+    cpu_usage_exit(cpu);
 }
 
-static void notify_led_timer_handler(void *ctx)
+static void led_boot_latency_log(char const *source)
+{
+    /* The RTC is started by timers_init(), the very first thing main() does */
+    uint32_t ticks = app_timer_cnt_get();
+
+    NRF_LOG_INFO("LED state restored from %s in %d us after boot",
+                 source,
+                 (uint32_t) (((uint64_t) ticks * 1000000) / APP_TIMER_CLOCK_FREQ));
+}
+
+static void notify_led_run(void *p_event_data, uint16_t event_size)
 {
     ble_gatts_hvx_params_t hvx_params;
 
@@ -124,139 +178,144 @@ static void notify_led_timer_handler(void *ctx)
     NRF_LOG_INFO("LED Notify");
 }
 
-static void display_storage_state(void)
+EVENT_LOOP_WORK_DEF(notify_led_work, notify_led_run);
+
+static void notify_led_timer_handler(void *ctx)
 {
-    fds_stat_t stat;
+    event_loop_defer(&notify_led_work);
+}
 
-    if (NRF_SUCCESS == fds_stat(&stat))
+static void led_on_storage_load(led_params_t const *params)
+{
+    if (led_params_retained)
     {
-        NRF_LOG_INFO("\e[32mFDS stat\e[0m: %d valid record, %d dirty records, %d words used, %d words freeable",
-                     stat.valid_records,
-                     stat.dirty_records,
-                     stat.words_used,
-                     stat.freeable_words);
+        /* RAM may hold changes that did not reach the flash before the reset */
+        led_storage_mark_dirty((led_params_t *) &led_params);
+        return;
     }
-    else
+
+    if (params != NULL)
     {
-        NRF_LOG_INFO("Unable to retrieve file system statistics");
+        led_params = *params;
     }
-}
 
-#define ESTC_BLE_SERVICE_LED_SAVES_FDS_USAGE_LIMIT ((uint32_t) FDS_PHY_PAGE_SIZE * 75 / 100)
+    led_update((led_params_t *) &led_params);
+    led_boot_latency_log("flash");
+}
 
-static void check_and_trigger_gc(void)
+static bool estc_ble_char_value_set(ble_gatts_char_handles_t const *handles,
+                                    void const *data,
+                                    uint16_t len)
 {
-    fds_stat_t stat;
+    ble_gatts_value_t value;
 
-    if (NRF_SUCCESS != fds_stat(&stat))
+    if (handles->value_handle == BLE_GATT_HANDLE_INVALID)
     {
-        NRF_LOG_INFO("Unable to retrieve file system statistics");
-        return;
+        /* The service is not registered yet */
+        return false;
     }
 
-    if (stat.freeable_words > ESTC_BLE_SERVICE_LED_SAVES_FDS_USAGE_LIMIT)
-    {
-        ret_code_t ret_code = fds_gc();
+    /* Keep the value up to date, so reads cost nothing */
+    value.len = len;
+    value.offset = 0;
+    value.p_value = (uint8_t *) data;
 
-        switch (ret_code)
-        {
-            case NRF_SUCCESS:
-                NRF_LOG_INFO("Trigger garbage collection");
-                break;
+    sd_ble_gatts_value_set(BLE_CONN_HANDLE_INVALID,
+                           handles->value_handle,
+                           &value);
 
-            default:
-                NRF_LOG_WARNING("Unable to trigger garbage collection!");
-                break;
-        }
-    }
+    return true;
 }
 
-static void led_save_state(void)
+static void estc_ble_char_notify(ble_gatts_char_handles_t const *handles,
+                                 void const *data,
+                                 uint16_t len)
 {
-    fds_record_desc_t record_desc;
-    fds_find_token_t record_token;
-    fds_record_t record;
+    ble_gatts_hvx_params_t hvx_params;
 
-    ret_code_t ret_code;
+    if (m_estc_service.connection_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return;
+    }
 
-    memset(&record_token, 0, sizeof(fds_find_token_t));
+    hvx_params.handle = handles->value_handle;
+    hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
+    hvx_params.offset = 0;
+    hvx_params.p_len = &len;
+    hvx_params.p_data = (uint8_t *) data;
 
-    record.file_id = ESTC_BLE_SERVICE_LED_SAVES_FILE_ID;
-    record.key = ESTC_BLE_SERVICE_LED_SAVES_RECORD_KEY;
-    record.data.p_data = (void *) &led_params;
-    record.data.length_words = sizeof(led_params_t) / 4;
+    sd_ble_gatts_hvx(m_estc_service.connection_handle, &hvx_params);
+}
 
-    if (NRF_SUCCESS == fds_record_find(ESTC_BLE_SERVICE_LED_SAVES_FILE_ID,
-                                       ESTC_BLE_SERVICE_LED_SAVES_RECORD_KEY,
-                                       &record_desc,
-                                       &record_token))
-    {
-        ret_code = fds_record_update(&record_desc, &record);
-    }
-    else
+static void estc_ble_char_publish(ble_gatts_char_handles_t const *handles,
+                                  void const *data,
+                                  uint16_t len)
+{
+    if (estc_ble_char_value_set(handles, data, len))
     {
-        ret_code = fds_record_write(&record_desc, &record);
+        estc_ble_char_notify(handles, data, len);
     }
+}
 
-    if (ret_code == NRF_SUCCESS)
-    {
-        NRF_LOG_INFO("LED parameters saved to flash memory");
-    }
-    else
+STATIC_ASSERT(ESTC_GATT_STORAGE_HEALTH_NOTIFY_LEN <= BLE_GATT_ATT_MTU_DEFAULT - 3); /* one notification at any MTU */
+
+static void storage_health_publish(led_storage_health_t const *health)
+{
+    /* The summary goes out, the page erase counts wait for a read */
+    if (estc_ble_char_value_set(&m_estc_service.storage_health_char_handles,
+                                health,
+                                ESTC_GATT_STORAGE_HEALTH_CHAR_LEN))
     {
-        fds_gc();
-        NRF_LOG_INFO("Unable to save LED parameters!");
+        estc_ble_char_notify(&m_estc_service.storage_health_char_handles,
+                             health,
+                             ESTC_GATT_STORAGE_HEALTH_NOTIFY_LEN);
     }
-
-    display_storage_state();
-    check_and_trigger_gc();
 }
 
-static void fds_on_init(void)
+static void latency_publish(latency_trace_stats_t const *stats)
 {
-    fds_record_desc_t record_desc;
-    fds_find_token_t record_token;
-    fds_flash_record_t flash_record;
-
-    memset(&record_token, 0, sizeof(fds_find_token_t));
+    estc_ble_char_value_set(&m_estc_service.latency_char_handles,
+                            stats,
+                            ESTC_GATT_LATENCY_CHAR_LEN);
+}
 
-    if (NRF_SUCCESS == fds_record_find(ESTC_BLE_SERVICE_LED_SAVES_FILE_ID,
-                                       ESTC_BLE_SERVICE_LED_SAVES_RECORD_KEY,
-                                       &record_desc,
-                                       &record_token))
-    {
-        if (NRF_SUCCESS == fds_record_open(&record_desc, &flash_record))
-        {
-            led_params = *(led_params_t *) flash_record.p_data;
-            fds_record_close(&record_desc);
+static void preset_list_publish(uint32_t occupied_mask)
+{
+    estc_ble_char_publish(&m_estc_service.preset_list_char_handles,
+                          &occupied_mask,
+                          ESTC_GATT_PRESET_LIST_CHAR_LEN);
+}
 
-            NRF_LOG_INFO("Read LED parameters from flash memory");
-        }
-    }
+static void cpu_usage_publish(cpu_usage_stats_t const *stats)
+{
+    estc_ble_char_publish(&m_estc_service.cpu_usage_char_handles,
+                          stats,
+                          ESTC_GATT_CPU_USAGE_CHAR_LEN);
+}
 
-    led_update((led_params_t *) &led_params);
+static void gesture_table_publish(gesture_table_t const *table)
+{
+    estc_ble_char_value_set(&m_estc_service.gesture_char_handles,
+                            table,
+                            ESTC_GATT_GESTURE_CHAR_LEN);
 }
 
-static void fds_events_handler(fds_evt_t const * p_evt)
+static ret_code_t button_events_send(uint32_t const *events, uint16_t len)
 {
-    switch (p_evt->id)
-    {
-        case FDS_EVT_INIT:
-            fds_on_init();
-            break;
+    ble_gatts_hvx_params_t hvx_params;
 
-        case FDS_EVT_GC:
-            NRF_LOG_INFO("Garbage collection is done");
-            display_storage_state();
-            break;
+    if (m_estc_service.connection_handle == BLE_CONN_HANDLE_INVALID)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
 
-        case FDS_EVT_DEL_FILE:
-            NRF_LOG_INFO("Saves clean is done!");
-            break;
+    hvx_params.handle = m_estc_service.button_event_char_handles.value_handle;
+    hvx_params.type = BLE_GATT_HVX_NOTIFICATION;
+    hvx_params.offset = 0;
+    hvx_params.p_len = &len;
+    hvx_params.p_data = (uint8_t const *) events;
 
-        default:
-            break;
-    }
+    return sd_ble_gatts_hvx(m_estc_service.connection_handle, &hvx_params);
 }
 
 static void on_led_color_char_write(const uint8_t *data, uint16_t len, bool on_connected)
@@ -283,7 +342,7 @@ static void on_led_color_char_write(const uint8_t *data, uint16_t len, bool on_c
     }
     else
     {
-        led_save_state();
+        led_storage_mark_dirty((led_params_t *) &led_params);
 
         app_timer_start(notify_led_timer,
                         APP_TIMER_TICKS(ESTC_BLE_SERVICE_NOTIFYING_DELAY_MS),
@@ -320,7 +379,7 @@ static void on_led_state_char_write(const uint8_t *data, uint16_t len, bool on_c
     }
     else
     {
-        led_save_state();
+        led_storage_mark_dirty((led_params_t *) &led_params);
 
         app_timer_start(notify_led_timer,
                         APP_TIMER_TICKS(ESTC_BLE_SERVICE_NOTIFYING_DELAY_MS),
@@ -331,10 +390,164 @@ static void on_led_state_char_write(const uint8_t *data, uint16_t len, bool on_c
                  led_params.state ? "on" : "off");
 }
 
+static void led_preset_store(uint8_t slot)
+{
+    ret_code_t ret_code;
+
+    ret_code = led_presets_store(slot, (led_params_t *) &led_params);
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Unable to store preset %d (0x%04X)", slot, ret_code);
+        return;
+    }
+
+    NRF_LOG_INFO("LED preset %d has been stored", slot);
+}
+
+/* Applies a change of led_params that did not come from the characteristics */
+static void led_params_apply(void)
+{
+    ble_gatts_value_t value;
+
+    led_update((led_params_t *) &led_params);
+
+    value.offset = 0;
+
+    value.len = ESTC_GATT_LED_COLOR_CHAR_LEN;
+    value.p_value = (uint8_t *) &(led_params.color);
+    sd_ble_gatts_value_set(m_estc_service.connection_handle,
+                           m_estc_service.led_color_char_handles.value_handle,
+                           &value);
+
+    value.len = ESTC_GATT_LED_STATE_CHAR_LEN;
+    value.p_value = (uint8_t *) &(led_params.state);
+    sd_ble_gatts_value_set(m_estc_service.connection_handle,
+                           m_estc_service.led_state_char_handles.value_handle,
+                           &value);
+
+    led_storage_mark_dirty((led_params_t *) &led_params);
+
+    app_timer_start(notify_led_timer,
+                    APP_TIMER_TICKS(ESTC_BLE_SERVICE_NOTIFYING_DELAY_MS),
+                    NULL);
+}
+
+/* The slot the next preset gesture starts from */
+static uint8_t led_preset_last = LED_PRESETS_COUNT - 1;
+
+static void led_preset_apply(uint8_t slot)
+{
+    led_params_t preset;
+
+    if (led_presets_recall(slot, &preset) != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("LED preset %d is empty", slot);
+        return;
+    }
+
+    led_params = preset;
+    led_params_apply();
+
+    led_preset_last = slot;
+
+    NRF_LOG_INFO("LED preset %d has been applied", slot);
+}
+
+static void led_preset_next(void)
+{
+    uint32_t occupied_mask = led_presets_occupied_mask();
+    uint8_t slot = led_preset_last;
+    uint8_t i;
+
+    for (i = 0; i < LED_PRESETS_COUNT; i++)
+    {
+        slot = (slot + 1) % LED_PRESETS_COUNT;
+
+        if (occupied_mask & (1UL << slot))
+        {
+            led_preset_apply(slot);
+            return;
+        }
+    }
+
+    NRF_LOG_WARNING("No LED presets stored");
+}
+
+static void on_preset_store_char_write(const uint8_t *data, uint16_t len)
+{
+    if (len != ESTC_GATT_PRESET_SLOT_CHAR_LEN)
+    {
+        return;
+    }
+
+    led_preset_store(data[0]);
+}
+
+static void on_preset_recall_char_write(const uint8_t *data, uint16_t len)
+{
+    if (len != ESTC_GATT_PRESET_SLOT_CHAR_LEN)
+    {
+        return;
+    }
+
+    led_preset_apply(data[0]);
+}
+
+static void on_preset_delete_char_write(const uint8_t *data, uint16_t len)
+{
+    ret_code_t ret_code;
+
+    if (len != ESTC_GATT_PRESET_SLOT_CHAR_LEN)
+    {
+        return;
+    }
+
+    ret_code = led_presets_delete(data[0]);
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Unable to delete preset %d (0x%04X)", data[0], ret_code);
+        return;
+    }
+
+    NRF_LOG_INFO("LED preset %d has been deleted", data[0]);
+}
+
+static void on_gesture_char_write(const uint8_t *data, uint16_t len)
+{
+    gesture_table_t table;
+    ret_code_t ret_code;
+
+    if (len != ESTC_GATT_GESTURE_CHAR_LEN)
+    {
+        return;
+    }
+
+    memcpy(&table, data, sizeof(gesture_table_t));
+
+    ret_code = gesture_table_set(&table);
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Unable to set the gestures (0x%04X)", ret_code);
+
+        /* Do not let the rejected table be read back */
+        gesture_table_get(&table);
+        gesture_table_publish(&table);
+        return;
+    }
+
+    NRF_LOG_INFO("Gestures have been updated");
+}
+
 static void on_write(const ble_evt_t *ble_evt)
 {
     const ble_gatts_evt_write_t * p_evt_write = &ble_evt->evt.gatts_evt.params.write;
 
+    latency_trace_start(LATENCY_SOURCE_BLE);
+    led_trace_begin();
+
     if (p_evt_write->handle == m_estc_service.led_color_char_handles.value_handle)
     {
         on_led_color_char_write(p_evt_write->data, p_evt_write->len, false);
@@ -344,6 +557,28 @@ static void on_write(const ble_evt_t *ble_evt)
     {
         on_led_state_char_write(p_evt_write->data, p_evt_write->len, false);
     }
+
+    if (p_evt_write->handle == m_estc_service.preset_store_char_handles.value_handle)
+    {
+        on_preset_store_char_write(p_evt_write->data, p_evt_write->len);
+    }
+
+    if (p_evt_write->handle == m_estc_service.preset_recall_char_handles.value_handle)
+    {
+        on_preset_recall_char_write(p_evt_write->data, p_evt_write->len);
+    }
+
+    if (p_evt_write->handle == m_estc_service.preset_delete_char_handles.value_handle)
+    {
+        on_preset_delete_char_write(p_evt_write->data, p_evt_write->len);
+    }
+
+    if (p_evt_write->handle == m_estc_service.gesture_char_handles.value_handle)
+    {
+        on_gesture_char_write(p_evt_write->data, p_evt_write->len);
+    }
+
+    led_trace_end();
 }
 
 void estc_ble_service_on_ble_event(const ble_evt_t *ble_evt, void *ctx)
@@ -354,7 +589,15 @@ void estc_ble_service_on_ble_event(const ble_evt_t *ble_evt, void *ctx)
             on_write(ble_evt);
             break;
         
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+            button_events_on_tx_complete(ble_evt->evt.gatts_evt.params.hvn_tx_complete.count);
+            break;
+
         case BLE_GAP_EVT_CONNECTED:
+            m_estc_service.connection_handle = ble_evt->evt.gap_evt.conn_handle;
+            led_storage_link_state_set(true);
+            button_events_reset();
+
             on_led_color_char_write((uint8_t *) &(led_params.color),
                                     ESTC_GATT_LED_COLOR_CHAR_LEN,
                                     true);
@@ -364,30 +607,32 @@ void estc_ble_service_on_ble_event(const ble_evt_t *ble_evt, void *ctx)
 
             break;
 
+        case BLE_GAP_EVT_DISCONNECTED:
+            m_estc_service.connection_handle = BLE_CONN_HANDLE_INVALID;
+            button_events_reset();
+
+            /* Do not keep the last changes of the session in RAM only */
+            led_storage_commit();
+            led_storage_link_state_set(false);
+            break;
+
         default:
             break;
     }
 }
 
-static void led_storage_clean_timer_handler(void *ctx)
-{
-    pwm_set_duty_cycle(&estc_ble_service_pwm, pwm_channel_indicator, 0);
-}
-
 ret_code_t estc_ble_service_init(ble_estc_service_t *service, void *ctx)
 {
     ret_code_t error_code;
     ble_uuid_t service_uuid = { .uuid = ESTC_SERVICE_UUID,
                                 .type = ESTC_UUID_TYPE };
 
+    service->connection_handle = BLE_CONN_HANDLE_INVALID;
+
     app_timer_create(&notify_led_timer,
                      APP_TIMER_MODE_SINGLE_SHOT,
                      notify_led_timer_handler);
 
-    app_timer_create(&led_storage_clean_timer,
-                     APP_TIMER_MODE_SINGLE_SHOT,
-                     led_storage_clean_timer_handler);
-
     error_code = sd_ble_uuid_vs_add(&m_base_uuid128, &service_uuid.type);
     APP_ERROR_CHECK(error_code);
 
@@ -400,116 +645,309 @@ ret_code_t estc_ble_service_init(ble_estc_service_t *service, void *ctx)
     NRF_LOG_DEBUG("%s:%d | Service UUID type: 0x%02x", __FUNCTION__, __LINE__, service_uuid.type);
     NRF_LOG_DEBUG("%s:%d | Service handle: 0x%04x", __FUNCTION__, __LINE__, service->service_handle);
 
-    return estc_ble_add_characteristics(service, ctx);
+    error_code = estc_ble_add_characteristics(service, ctx);
+
+    if (error_code == NRF_SUCCESS)
+    {
+        led_storage_health_t health;
+        gesture_table_t gestures;
+
+        led_storage_health_get(&health);
+        storage_health_publish(&health);
+
+        preset_list_publish(led_presets_occupied_mask());
+
+        gesture_table_get(&gestures);
+        gesture_table_publish(&gestures);
+    }
+
+    return error_code;
 }
 
-static ret_code_t estc_ble_add_characteristics(ble_estc_service_t *service, void *ctx)
+static ret_code_t estc_ble_add_char(ble_estc_service_t *service,
+                                    ble_add_char_params_t *add_char_params,
+                                    char const *description,
+                                    ble_gatts_char_handles_t *handles)
 {
-    ble_add_char_params_t add_char_params;
     ble_add_char_user_desc_t add_char_user_desc;
-    ble_gatts_char_pf_t char_pf;
-
-    ret_code_t error_code;
-    
-    const char led_color_char_user_description[] = LED_COLOR_CHAR_DESCRIPTION;
-    const char led_state_char_user_description[] = LED_STATE_CHAR_DESCRIPTION;
-    const char led_notify_char_user_description[] = LED_NOTIFY_CHAR_DESCRIPTION;
 
     memset(&add_char_user_desc, 0, sizeof(ble_add_char_user_desc_t));
 
-    add_char_user_desc.max_size = strlen(led_color_char_user_description);
-    add_char_user_desc.size = strlen(led_color_char_user_description);
-    add_char_user_desc.p_char_user_desc = (uint8_t *) led_color_char_user_description;
+    add_char_user_desc.max_size = strlen(description);
+    add_char_user_desc.size = strlen(description);
+    add_char_user_desc.p_char_user_desc = (uint8_t *) description;
     add_char_user_desc.is_value_user = false;
     add_char_user_desc.is_var_len = false;
     add_char_user_desc.char_props.read = 1;
     add_char_user_desc.read_access = SEC_OPEN;
 
+    add_char_params->uuid_type = ESTC_UUID_TYPE;
+    add_char_params->is_value_user = false;
+    add_char_params->p_user_descr = &add_char_user_desc;
+
+    return characteristic_add(service->service_handle,
+                              add_char_params,
+                              handles);
+}
+
+static ret_code_t estc_ble_add_preset_slot_char(ble_estc_service_t *service,
+                                                uint16_t uuid,
+                                                char const *description,
+                                                ble_gatts_char_handles_t *handles)
+{
+    ble_add_char_params_t add_char_params;
+
+    memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
+
+    add_char_params.uuid = uuid;
+    add_char_params.init_len = ESTC_GATT_PRESET_SLOT_CHAR_LEN;
+    add_char_params.max_len = ESTC_GATT_PRESET_SLOT_CHAR_LEN;
+    add_char_params.char_props.write = 1;
+    add_char_params.is_var_len = false;
+    add_char_params.write_access = SEC_JUST_WORKS;
+
+    return estc_ble_add_char(service, &add_char_params, description, handles);
+}
+
+static ret_code_t estc_ble_add_characteristics(ble_estc_service_t *service, void *ctx)
+{
+    ble_add_char_params_t add_char_params;
+    ble_gatts_char_pf_t char_pf;
+
+    ret_code_t error_code;
+
     memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
 
     add_char_params.uuid = ESTC_GATT_LED_COLOR_CHAR_UUID;
-    add_char_params.uuid_type = ESTC_UUID_TYPE;
     add_char_params.init_len = ESTC_GATT_LED_COLOR_CHAR_LEN;
     add_char_params.max_len = ESTC_GATT_LED_COLOR_CHAR_LEN;
     add_char_params.char_props.write = 1;
     add_char_params.char_props.read = 1;
     add_char_params.is_var_len = false;
-    add_char_params.is_value_user = false;
     add_char_params.write_access = SEC_JUST_WORKS;
     add_char_params.read_access = SEC_OPEN;
-    add_char_params.p_user_descr = &add_char_user_desc;
 
-    error_code = characteristic_add(service->service_handle,
-                                    &add_char_params,
-                                    &service->led_color_char_handles);
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   LED_COLOR_CHAR_DESCRIPTION,
+                                   &service->led_color_char_handles);
 
     if (error_code != NRF_SUCCESS)
     {
         return error_code;
     }
 
-    memset(&add_char_user_desc, 0, sizeof(ble_add_char_user_desc_t));
-
-    add_char_user_desc.max_size = strlen(led_state_char_user_description);
-    add_char_user_desc.size = strlen(led_state_char_user_description);
-    add_char_user_desc.p_char_user_desc = (uint8_t *) led_state_char_user_description;
-    add_char_user_desc.is_value_user = false;
-    add_char_user_desc.is_var_len = false;
-    add_char_user_desc.char_props.read = 1;
-    add_char_user_desc.read_access = SEC_OPEN;
-
     memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
 
     add_char_params.uuid = ESTC_GATT_LED_STATE_CHAR_UUID;
-    add_char_params.uuid_type = ESTC_UUID_TYPE;
     add_char_params.init_len = ESTC_GATT_LED_STATE_CHAR_LEN;
     add_char_params.max_len = ESTC_GATT_LED_STATE_CHAR_LEN;
     add_char_params.char_props.write = 1;
     add_char_params.char_props.read = 1;
     add_char_params.is_var_len = false;
-    add_char_params.is_value_user = false;
     add_char_params.write_access = SEC_JUST_WORKS;
     add_char_params.read_access = SEC_OPEN;
-    add_char_params.p_user_descr = &add_char_user_desc;
 
-    error_code = characteristic_add(service->service_handle,
-                                    &add_char_params,
-                                    &service->led_state_char_handles);
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   LED_STATE_CHAR_DESCRIPTION,
+                                   &service->led_state_char_handles);
 
     if (error_code != NRF_SUCCESS)
     {
         return error_code;
     }
 
-    memset(&add_char_user_desc, 0, sizeof(ble_add_char_user_desc_t));
-
-    add_char_user_desc.max_size = strlen(led_notify_char_user_description);
-    add_char_user_desc.size = strlen(led_notify_char_user_description);
-    add_char_user_desc.p_char_user_desc = (uint8_t *) led_notify_char_user_description;
-    add_char_user_desc.is_value_user = false;
-    add_char_user_desc.is_var_len = false;
-    add_char_user_desc.char_props.read = 1;
-    add_char_user_desc.read_access = SEC_OPEN;
-
     memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
 
     memset(&char_pf, 0, sizeof(ble_gatts_char_pf_t));
     char_pf.format = BLE_GATT_CPF_FORMAT_UTF8S;
 
     add_char_params.uuid = ESTC_GATT_LED_NOTIFY_CHAR_UUID;
-    add_char_params.uuid_type = ESTC_UUID_TYPE;
     add_char_params.init_len = LED_READ_LEN - 1;
     add_char_params.max_len = LED_READ_LEN - 1;
     add_char_params.char_props.notify = 1;
     add_char_params.is_var_len = false;
-    add_char_params.is_value_user = false;
     add_char_params.cccd_write_access = SEC_JUST_WORKS;
-    add_char_params.p_user_descr = &add_char_user_desc;
     add_char_params.p_presentation_format = &char_pf;
 
-    error_code = characteristic_add(service->service_handle,
-                                    &add_char_params,
-                                    &service->led_notify_char_handles);
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   LED_NOTIFY_CHAR_DESCRIPTION,
+                                   &service->led_notify_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
+
+    add_char_params.uuid = ESTC_GATT_STORAGE_HEALTH_CHAR_UUID;
+    add_char_params.init_len = ESTC_GATT_STORAGE_HEALTH_CHAR_LEN;
+    add_char_params.max_len = ESTC_GATT_STORAGE_HEALTH_CHAR_LEN;
+    add_char_params.char_props.read = 1;
+    add_char_params.char_props.notify = 1;
+    add_char_params.is_var_len = false;
+    add_char_params.read_access = SEC_OPEN;
+    add_char_params.cccd_write_access = SEC_JUST_WORKS;
+
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   STORAGE_HEALTH_CHAR_DESCRIPTION,
+                                   &service->storage_health_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    error_code = estc_ble_add_preset_slot_char(service,
+                                               ESTC_GATT_PRESET_STORE_CHAR_UUID,
+                                               PRESET_STORE_CHAR_DESCRIPTION,
+                                               &service->preset_store_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    error_code = estc_ble_add_preset_slot_char(service,
+                                               ESTC_GATT_PRESET_RECALL_CHAR_UUID,
+                                               PRESET_RECALL_CHAR_DESCRIPTION,
+                                               &service->preset_recall_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    error_code = estc_ble_add_preset_slot_char(service,
+                                               ESTC_GATT_PRESET_DELETE_CHAR_UUID,
+                                               PRESET_DELETE_CHAR_DESCRIPTION,
+                                               &service->preset_delete_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
+
+    add_char_params.uuid = ESTC_GATT_PRESET_LIST_CHAR_UUID;
+    add_char_params.init_len = ESTC_GATT_PRESET_LIST_CHAR_LEN;
+    add_char_params.max_len = ESTC_GATT_PRESET_LIST_CHAR_LEN;
+    add_char_params.char_props.read = 1;
+    add_char_params.char_props.notify = 1;
+    add_char_params.is_var_len = false;
+    add_char_params.read_access = SEC_OPEN;
+    add_char_params.cccd_write_access = SEC_JUST_WORKS;
+
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   PRESET_LIST_CHAR_DESCRIPTION,
+                                   &service->preset_list_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
+
+    add_char_params.uuid = ESTC_GATT_STORAGE_WIPE_CHAR_UUID;
+    add_char_params.init_len = ESTC_GATT_STORAGE_WIPE_CHAR_LEN;
+    add_char_params.max_len = ESTC_GATT_STORAGE_WIPE_CHAR_LEN;
+    add_char_params.char_props.read = 1;
+    add_char_params.char_props.notify = 1;
+    add_char_params.is_var_len = false;
+    add_char_params.read_access = SEC_OPEN;
+    add_char_params.cccd_write_access = SEC_JUST_WORKS;
+
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   STORAGE_WIPE_CHAR_DESCRIPTION,
+                                   &service->storage_wipe_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
+
+    add_char_params.uuid = ESTC_GATT_LATENCY_CHAR_UUID;
+    add_char_params.init_len = ESTC_GATT_LATENCY_CHAR_LEN;
+    add_char_params.max_len = ESTC_GATT_LATENCY_CHAR_LEN;
+    add_char_params.char_props.read = 1;
+    add_char_params.is_var_len = false;
+    add_char_params.read_access = SEC_OPEN;
+
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   LATENCY_CHAR_DESCRIPTION,
+                                   &service->latency_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
+
+    add_char_params.uuid = ESTC_GATT_GESTURE_CHAR_UUID;
+    add_char_params.init_len = ESTC_GATT_GESTURE_CHAR_LEN;
+    add_char_params.max_len = ESTC_GATT_GESTURE_CHAR_LEN;
+    add_char_params.char_props.write = 1;
+    add_char_params.char_props.read = 1;
+    add_char_params.is_var_len = false;
+    add_char_params.write_access = SEC_JUST_WORKS;
+    add_char_params.read_access = SEC_OPEN;
+
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   GESTURE_CHAR_DESCRIPTION,
+                                   &service->gesture_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
+
+    add_char_params.uuid = ESTC_GATT_BUTTON_EVENT_CHAR_UUID;
+    add_char_params.init_len = 0;
+    add_char_params.max_len = ESTC_GATT_BUTTON_EVENT_CHAR_LEN;
+    add_char_params.char_props.notify = 1;
+    add_char_params.is_var_len = true;
+    add_char_params.cccd_write_access = SEC_JUST_WORKS;
+
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   BUTTON_EVENT_CHAR_DESCRIPTION,
+                                   &service->button_event_char_handles);
+
+    if (error_code != NRF_SUCCESS)
+    {
+        return error_code;
+    }
+
+    memset(&add_char_params, 0, sizeof(ble_add_char_params_t));
+
+    add_char_params.uuid = ESTC_GATT_CPU_USAGE_CHAR_UUID;
+    add_char_params.init_len = ESTC_GATT_CPU_USAGE_CHAR_LEN;
+    add_char_params.max_len = ESTC_GATT_CPU_USAGE_CHAR_LEN;
+    add_char_params.char_props.read = 1;
+    add_char_params.char_props.notify = 1;
+    add_char_params.is_var_len = false;
+    add_char_params.read_access = SEC_OPEN;
+    add_char_params.cccd_write_access = SEC_JUST_WORKS;
+
+    error_code = estc_ble_add_char(service,
+                                   &add_char_params,
+                                   CPU_USAGE_CHAR_DESCRIPTION,
+                                   &service->cpu_usage_char_handles);
 
     if (error_code != NRF_SUCCESS)
     {
@@ -519,11 +957,27 @@ static ret_code_t estc_ble_add_characteristics(ble_estc_service_t *service, void
     return NRF_SUCCESS;
 }
 
+static void estc_ble_service_led_retained_init(void)
+{
+    led_params_t params;
+
+    if (led_retained_load(&params))
+    {
+        led_params = params;
+        led_params_retained = true;
+
+        led_update((led_params_t *) &led_params);
+        led_boot_latency_log("retained RAM");
+    }
+}
+
 static void estc_ble_service_led_save_init(void)
 {
-    fds_register(fds_events_handler);
+    /* Presets and gestures hook into FDS, so they go first */
+    APP_ERROR_CHECK(led_presets_init(preset_list_publish));
+    APP_ERROR_CHECK(gesture_init(gesture_table_publish));
 
-    if (NRF_SUCCESS != fds_init())
+    if (NRF_SUCCESS != led_storage_init(led_on_storage_load, storage_health_publish))
     {
         pwm_set_duty_cycle(&estc_ble_service_pwm, pwm_channel_indicator, pwm_max_pct);
     }
@@ -543,90 +997,329 @@ static void estc_ble_service_pwm_hw_init(void)
     pwm_set_duty_cycle(&estc_ble_service_pwm, pwm_channel_indicator, 0);
 }
 
+static void led_on_storage_wipe(led_storage_wipe_stage_t stage)
+{
+    uint8_t value = stage;
+
+    estc_ble_char_publish(&m_estc_service.storage_wipe_char_handles,
+                          &value,
+                          ESTC_GATT_STORAGE_WIPE_CHAR_LEN);
+
+    /* The indicator stays on until the flash is actually clean */
+    switch (stage)
+    {
+        case LED_STORAGE_WIPE_DELETING:
+            pwm_set_duty_cycle(&estc_ble_service_pwm, pwm_channel_indicator, pwm_max_pct);
+            break;
+
+        case LED_STORAGE_WIPE_DONE:
+            pwm_set_duty_cycle(&estc_ble_service_pwm, pwm_channel_indicator, 0);
+            NRF_LOG_INFO("Saves are clean");
+            break;
+
+        case LED_STORAGE_WIPE_FAILED:
+            pwm_set_duty_cycle(&estc_ble_service_pwm, pwm_channel_indicator, pwm_max_pct);
+            NRF_LOG_ERROR("Cleaning saves failed");
+            break;
+
+        default:
+            break;
+    }
+}
+
+bool estc_ble_service_led_is_on(void)
+{
+    return led_params.state != 0;
+}
+
 void estc_ble_service_led_storage_clean(void)
 {
-    ret_code_t ret_code = fds_file_delete(ESTC_BLE_SERVICE_LED_SAVES_FILE_ID);
+    ret_code_t ret_code = led_storage_clean(led_on_storage_wipe);
 
     if (ret_code == NRF_SUCCESS)
     {
-        pwm_set_duty_cycle(&estc_ble_service_pwm, pwm_channel_indicator, 100);
-        app_timer_start(led_storage_clean_timer, APP_TIMER_TICKS(LED_STORAGE_INDICATION_DELAY_MS), NULL);
-
         NRF_LOG_INFO("Clean saves");
     }
     else
     {
-        NRF_LOG_ERROR("Unable to clean saves");
+        NRF_LOG_ERROR("Unable to clean saves (0x%04X)", ret_code);
     }
 }
 
-static void gpiote_handler(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+#if ENCODER_ENABLED
+/* The knob turns the brightness, or the hue once the knob mode gesture
+ * switched it over. The QDEC reports come at a fixed rate, every batch goes
+ * to the PWM at once and to flash once the knob rests. */
+enum { led_knob_brightness_step = 8 };
+enum { led_knob_hue_step = 8 }; /* degrees */
+
+static bool led_knob_hue;
+
+static void encoder_onrotate(int16_t detents)
 {
-    button_first_run((button_t *) &button);
+    int16_t brightness;
+
+    if (led_knob_hue)
+    {
+        led_params.color = led_color_hue_rotate(led_params.color, detents * led_knob_hue_step);
+    }
+    else
+    {
+        brightness = led_params.brightness + detents * led_knob_brightness_step;
+        led_params.brightness = MAX(LED_BRIGHTNESS_MIN, MIN(brightness, LED_BRIGHTNESS_MAX));
+    }
+
+    led_update((led_params_t *) &led_params);
+    led_storage_mark_dirty((led_params_t *) &led_params);
+}
+#endif
+
+/* Button callbacks run from the main loop, like the BLE, FDS and timer
+ * handlers that also change the LED and storage state, so they need no
+ * locking. What a gesture does comes from the gesture table. */
+
+/* Hold-to-dim: every hold reverses the direction and the step grows the
+ * longer the button is held. Only the PWM and the retained copy follow the
+ * ramp, the final brightness goes to flash once the button is released. */
+enum { led_dim_step_min = 1 };
+enum { led_dim_step_max = 12 };
+enum { led_dim_accel_repeats = 4 }; /* the step grows by one every 4 repeats */
+
+static bool led_dim_up;
+
+static void led_dim_ramp(uint8_t repeat)
+{
+    int16_t brightness;
+    int16_t step;
+
+    if (repeat == 0)
+    {
+        led_dim_up = !led_dim_up;
+
+        if (led_params.brightness >= LED_BRIGHTNESS_MAX)
+            led_dim_up = false;
+        else if (led_params.brightness <= LED_BRIGHTNESS_MIN)
+            led_dim_up = true;
+    }
+
+    step = MIN(led_dim_step_min + repeat / led_dim_accel_repeats, led_dim_step_max);
+    brightness = led_params.brightness + (led_dim_up ? step : -step);
+
+    led_params.brightness = MAX(LED_BRIGHTNESS_MIN, MIN(brightness, LED_BRIGHTNESS_MAX));
+    led_update((led_params_t *) &led_params);
 }
 
-static void button_onclick(uint8_t clicks)
+/* A one-shot action, the dim ramp is run by the hold callbacks */
+static void gesture_run(gesture_entry_t gesture)
 {
-    if (clicks == 3)
+    switch (gesture.action)
     {
-        estc_ble_service_led_storage_clean();
+        case GESTURE_ACTION_TOGGLE:
+            led_params.state = !led_params.state;
+            led_params_apply();
+            NRF_LOG_INFO("LED state has been updated (%s)",
+                         led_params.state ? "on" : "off");
+            break;
+
+        case GESTURE_ACTION_PRESET_RECALL:
+            led_preset_apply(gesture.param);
+            break;
+
+        case GESTURE_ACTION_PRESET_NEXT:
+            led_preset_next();
+            break;
+
+        case GESTURE_ACTION_WIPE:
+            estc_ble_service_led_storage_clean();
+            break;
+
+#if ENCODER_ENABLED
+        case GESTURE_ACTION_KNOB_MODE:
+            led_knob_hue = !led_knob_hue;
+            NRF_LOG_INFO("Knob turns the %s", led_knob_hue ? "hue" : "brightness");
+            break;
+#endif
+
+        default:
+            break;
     }
+}
+
+static void button_onclick(void *p_context, uint8_t clicks)
+{
+    gesture_entry_t gesture = gesture_lookup(GESTURE_CLICK, clicks);
+    button_stats_t stats;
+    event_loop_stats_t loop_stats;
+
+    button_events_put(BUTTON_EVENT_CLICK, clicks, button_event_time_get());
+
+    /* The release edge opened the trace */
+    led_trace_begin();
+    gesture_run(gesture);
+    led_trace_end();
 
     NRF_LOG_INFO("%s: %d", __func__, clicks);
+
+    button_stats_get(&stats);
+    NRF_LOG_DEBUG("Button events: %d deferred, %d dropped, queue depth %d, %d us out of interrupts",
+                  stats.events_deferred,
+                  stats.events_dropped,
+                  stats.queue_depth_max,
+                  stats.deferred_us);
+
+    event_loop_stats_get(&loop_stats);
+    NRF_LOG_DEBUG("Main loop: %d us in %d passes, %d us at most, %d coalesced, %d queue full, queue depth %d",
+                  loop_stats.run_us,
+                  loop_stats.runs,
+                  loop_stats.run_max_us,
+                  loop_stats.coalesced,
+                  loop_stats.queue_full,
+                  loop_stats.queue_depth_max);
 }
 
-static void button_onhold(void)
+/* Looked up once per hold, a table written meanwhile applies to the next one */
+static gesture_entry_t button_hold_gesture;
+
+static void button_onhold(void *p_context, uint8_t clicks, uint8_t repeat)
 {
-    NRF_LOG_INFO("%s", __func__);
+    if (repeat == 0)
+    {
+        button_hold_gesture = gesture_lookup(GESTURE_HOLD, clicks);
+        button_events_put(BUTTON_EVENT_HOLD_START, clicks, button_event_time_get());
+    }
+
+    if (button_hold_gesture.action == GESTURE_ACTION_DIM)
+    {
+        led_dim_ramp(repeat);
+    }
+    else if (repeat == 0)
+    {
+        /* Late on purpose, a hold does not close the trace of the press */
+        gesture_run(button_hold_gesture);
+    }
 }
 
-static bool button_is_pressed(void)
+static void button_onhold_end(void *p_context)
 {
-    return nrf_gpio_pin_read(BUTTON_GPIO) == BUTTON_ACTIVE_LEVEL;
+    button_events_put(BUTTON_EVENT_HOLD_END, 0, button_event_time_get());
+
+    if (button_hold_gesture.action != GESTURE_ACTION_DIM)
+    {
+        return;
+    }
+
+    led_storage_mark_dirty((led_params_t *) &led_params);
+
+    NRF_LOG_INFO("LED brightness %d", led_params.brightness);
 }
 
 enum { btn_dblclk_pause = 200 };
 enum { btnhold_period_first_ms = 500 };
 enum { btnhold_period_next_ms = 50 };
 enum { debounce_period_ms = 50 };
+enum { debounce_samples = 3 };
 
 static button_timings_t const button_timings = {
     .dblclk_pause_ms = btn_dblclk_pause, 
     .hold_pause_short_ms = btnhold_period_next_ms,
     .hold_pause_long_ms = btnhold_period_first_ms,
-    .debounce_period_ms = debounce_period_ms
+    .debounce_period_ms = debounce_period_ms,
+    .debounce_samples = debounce_samples
 };
 
 static button_callbacks_t const button_callbacks = {
     .onclick = button_onclick,
     .onhold = button_onhold,
-    .is_pressed = button_is_pressed
+    .onhold_end = button_onhold_end,
+    .is_pressed = NULL
+};
+
+static button_config_t const button_config = {
+    .pin = BUTTON_GPIO,
+    .active_level = BUTTON_ACTIVE_LEVEL,
+    .pull = NRF_GPIO_PIN_PULLUP,
+    .timings = &button_timings,
+    .callbacks = &button_callbacks,
+    .p_context = NULL
 };
 
-static void gpiote_init_on_toggle(nrfx_gpiote_pin_t pin,
-                                  nrf_gpio_pin_pull_t pull,
-                                  nrfx_gpiote_evt_handler_t handler)
+#ifdef ESTC_PRESET_BUTTON_PINS
+/* Wall panel buttons, the context of each one is its preset slot */
+static uint32_t const preset_button_pins[] = { ESTC_PRESET_BUTTON_PINS };
+static button_t preset_buttons[ARRAY_SIZE(preset_button_pins)];
+
+static void preset_button_onclick(void *p_context, uint8_t clicks)
 {
-    nrfx_gpiote_in_config_t
-    gpiote_config = NRFX_GPIOTE_CONFIG_IN_SENSE_TOGGLE(false);
-    gpiote_config.pull = pull;
+    uint8_t slot = (uint8_t) (uintptr_t) p_context;
 
-    nrfx_gpiote_in_init(pin, &gpiote_config, handler);
-    nrfx_gpiote_in_event_enable(pin, true);
+    switch (clicks)
+    {
+        case 1:
+            led_trace_begin();
+            led_preset_apply(slot);
+            led_trace_end();
+            break;
+
+        case 2:
+            led_preset_store(slot);
+            break;
+
+        default:
+            break;
+    }
 }
 
+static button_callbacks_t const preset_button_callbacks = {
+    .onclick = preset_button_onclick,
+    .onhold = NULL,
+    .onhold_end = NULL,
+    .is_pressed = NULL
+};
+
+static void preset_buttons_init(void)
+{
+    button_config_t config = {
+        .active_level = 0,
+        .pull = NRF_GPIO_PIN_PULLUP,
+        .timings = &button_timings,
+        .callbacks = &preset_button_callbacks,
+    };
+    ret_code_t ret_code;
+    uint8_t i;
+
+    for (i = 0; i < ARRAY_SIZE(preset_buttons); i++)
+    {
+        config.pin = preset_button_pins[i];
+        config.p_context = (void *) (uintptr_t) i;
+
+        ret_code = button_init(&preset_buttons[i], &config);
+        APP_ERROR_CHECK(ret_code);
+    }
+}
+#endif
+
 void estc_ble_service_deps_init(void)
 {
+    ret_code_t ret_code;
+
+    latency_trace_init(latency_publish);
+    cpu_usage_init(cpu_usage_publish);
+    button_events_init(button_events_send);
+
     estc_ble_service_pwm_hw_init();
+    estc_ble_service_led_retained_init();
     estc_ble_service_led_save_init();
 
-    button_init((button_t *) &button,
-                &button_timings,
-                &button_callbacks);
+    ret_code = button_init(&button, &button_config);
+    APP_ERROR_CHECK(ret_code);
+
+#ifdef ESTC_PRESET_BUTTON_PINS
+    preset_buttons_init();
+#endif
 
-    nrfx_gpiote_init();
-    gpiote_init_on_toggle(BUTTON_GPIO,
-                          NRF_GPIO_PIN_PULLUP,
-                          gpiote_handler);
+#if ENCODER_ENABLED
+    ret_code = encoder_init(encoder_onrotate);
+    APP_ERROR_CHECK(ret_code);
+#endif
 }
 
@@ -2,11 +2,17 @@
 #define ESTC_SERVICE_H__
 
 #include <stdint.h>
+#include <stddef.h>
 
 #include "ble.h"
 #include "sdk_errors.h"
 
 #include "led_common.h"
+#include "led_storage.h"
+#include "latency_trace.h"
+#include "gesture.h"
+#include "button_events.h"
+#include "cpu_usage.h"
 
 /* UUID: 0f9cxxxx-c952-426b-950e-2f1cb01a1885 */
 #define ESTC_BASE_UUID { 0x85, 0x18, 0x1A, 0xB0, \
@@ -21,9 +27,28 @@
 #define ESTC_GATT_LED_COLOR_CHAR_UUID 0xDBF3
 #define ESTC_GATT_LED_STATE_CHAR_UUID 0xDBF4
 #define ESTC_GATT_LED_NOTIFY_CHAR_UUID 0xDBF5
+#define ESTC_GATT_STORAGE_HEALTH_CHAR_UUID 0xDBF6
+#define ESTC_GATT_PRESET_STORE_CHAR_UUID 0xDBF7
+#define ESTC_GATT_PRESET_RECALL_CHAR_UUID 0xDBF8
+#define ESTC_GATT_PRESET_DELETE_CHAR_UUID 0xDBF9
+#define ESTC_GATT_PRESET_LIST_CHAR_UUID 0xDBFA
+#define ESTC_GATT_STORAGE_WIPE_CHAR_UUID 0xDBFB
+#define ESTC_GATT_LATENCY_CHAR_UUID 0xDBFC
+#define ESTC_GATT_GESTURE_CHAR_UUID 0xDBFD
+#define ESTC_GATT_BUTTON_EVENT_CHAR_UUID 0xDBFE
+#define ESTC_GATT_CPU_USAGE_CHAR_UUID 0xDBFF
 
 #define ESTC_GATT_LED_COLOR_CHAR_LEN (3 * sizeof(uint8_t))
 #define ESTC_GATT_LED_STATE_CHAR_LEN (1 * sizeof(uint8_t))
+#define ESTC_GATT_STORAGE_HEALTH_CHAR_LEN (sizeof(led_storage_health_t))
+#define ESTC_GATT_STORAGE_HEALTH_NOTIFY_LEN (offsetof(led_storage_health_t, page_erases))
+#define ESTC_GATT_PRESET_SLOT_CHAR_LEN (1 * sizeof(uint8_t))
+#define ESTC_GATT_PRESET_LIST_CHAR_LEN (sizeof(uint32_t))
+#define ESTC_GATT_STORAGE_WIPE_CHAR_LEN (1 * sizeof(uint8_t))
+#define ESTC_GATT_LATENCY_CHAR_LEN (sizeof(latency_trace_stats_t))
+#define ESTC_GATT_GESTURE_CHAR_LEN (sizeof(gesture_table_t))
+#define ESTC_GATT_BUTTON_EVENT_CHAR_LEN (BUTTON_EVENTS_BATCH_MAX * sizeof(uint32_t))
+#define ESTC_GATT_CPU_USAGE_CHAR_LEN (sizeof(cpu_usage_stats_t))
 
 #define LED_COLOR_CHAR_DESCRIPTION "Three-byte characteristic for setting the LED color. "\
                                    "Send three bytes corresponding "\
@@ -36,6 +61,38 @@
 
 #define LED_NOTIFY_CHAR_DESCRIPTION "Characteristic for notifying the LED color and state"
 
+/* Value layout: led_storage_health_t, little-endian. Longer than the MTU,
+ * so notifications carry the counters before page_erases and the erase
+ * counts per page are read with long reads */
+#define STORAGE_HEALTH_CHAR_DESCRIPTION "Flash storage health counters"
+
+/* Writes carry a single byte, the preset slot number */
+#define PRESET_STORE_CHAR_DESCRIPTION "Save the LED to a preset slot"
+#define PRESET_RECALL_CHAR_DESCRIPTION "Apply a preset slot"
+#define PRESET_DELETE_CHAR_DESCRIPTION "Delete a preset slot"
+
+/* Value: uint32_t bitmap, bit N is set when slot N holds a preset */
+#define PRESET_LIST_CHAR_DESCRIPTION "Occupied preset slots"
+
+/* Value: led_storage_wipe_stage_t of the last wipe */
+#define STORAGE_WIPE_CHAR_DESCRIPTION "Storage wipe progress"
+
+/* Value layout: latency_trace_stats_t, little-endian. Longer than the MTU,
+ * so it is read only, with long reads */
+#define LATENCY_CHAR_DESCRIPTION "Input to light latency"
+
+/* Value layout: gesture_table_t, an action and a parameter byte for
+ * 1 to 4 clicks, then for a hold after 0 to 3 clicks */
+#define GESTURE_CHAR_DESCRIPTION "Button gestures"
+
+/* Value: 1 to BUTTON_EVENTS_BATCH_MAX board button events, oldest first,
+ * see button_events.h for the layout. Notify only */
+#define BUTTON_EVENT_CHAR_DESCRIPTION "Button events"
+
+/* Value layout: cpu_usage_stats_t, little-endian, notified at the end of
+ * every CPU_USAGE_WINDOW_MS */
+#define CPU_USAGE_CHAR_DESCRIPTION "CPU usage"
+
 #define LED_READ_TEMPLATE "RGB(%02X%02X%02X), LED %3s"
 #define LED_READ_LEN (sizeof(LED_READ_TEMPLATE) - 6)
 
@@ -47,6 +104,16 @@ typedef struct
     ble_gatts_char_handles_t led_color_char_handles;
     ble_gatts_char_handles_t led_state_char_handles;
     ble_gatts_char_handles_t led_notify_char_handles;
+    ble_gatts_char_handles_t storage_health_char_handles;
+    ble_gatts_char_handles_t preset_store_char_handles;
+    ble_gatts_char_handles_t preset_recall_char_handles;
+    ble_gatts_char_handles_t preset_delete_char_handles;
+    ble_gatts_char_handles_t preset_list_char_handles;
+    ble_gatts_char_handles_t storage_wipe_char_handles;
+    ble_gatts_char_handles_t latency_char_handles;
+    ble_gatts_char_handles_t gesture_char_handles;
+    ble_gatts_char_handles_t button_event_char_handles;
+    ble_gatts_char_handles_t cpu_usage_char_handles;
 } ble_estc_service_t;
 
 void estc_ble_service_deps_init(void);
@@ -54,4 +121,7 @@ ret_code_t estc_ble_service_init(ble_estc_service_t *service, void *ctx);
 void estc_ble_service_on_ble_event(const ble_evt_t *ble_evt, void *ctx);
 void estc_ble_service_led_storage_clean(void);
 
+/* Whether the LED is switched on, whatever its color */
+bool estc_ble_service_led_is_on(void);
+
 #endif /* ESTC_SERVICE_H__ */
@@ -0,0 +1,122 @@
+#include "event_loop.h"
+
+#include "sdk_config.h"
+#include "app_util.h"
+#include "app_util_platform.h"
+
+#include "nrf_log.h"
+#include "nrf_sdh.h"
+#include "nrf_sdm.h"
+
+#include "cycle_counter.h"
+
+/*
+ * The interrupt handlers of the application only queue an event, the work
+ * runs from the main loop:
+ * - SoftDevice events, and with them FDS and fstorage completions, through
+ *   the SoftDevice event interrupt below (NRF_SDH_DISPATCH_MODEL_POLLING)
+ * - button callbacks and encoder reports, queued by their modules
+ * - app_timer handlers that touch flash or BLE, through event_loop_defer()
+ *
+ * Nothing is ever run in an interrupt because the queue is full. Every
+ * producer keeps a flag and has at most one event queued, however often
+ * its interrupt fires before the main loop gets to it, so the queue is
+ * sized for the worst case (SCHED_QUEUE_SIZE in main.c). The deferred
+ * work items are:
+ *   led_storage flush, led_storage GC, LED notify, CPU usage report and
+ *   the SoftDevice events
+ * and EVENT_LOOP_WORK_MAX has to follow this list.
+ *
+ * The button tick stays in the RTC interrupt, it samples the pins and
+ * shares its state with the GPIOTE handler at the same priority.
+ *
+ * The time spent in the queued handlers used to be interrupt time, it is
+ * measured with the DWT cycle counter. The deepest the queue got comes from
+ * the app_scheduler profiler.
+ */
+
+static event_loop_stats_t m_stats;
+static uint16_t m_queue_size;
+
+void event_loop_run(void)
+{
+    uint32_t start = cycle_counter_get();
+    uint32_t us;
+
+    /* Only the passes with work count */
+    if (app_sched_queue_space_get() == m_queue_size)
+    {
+        return;
+    }
+
+    app_sched_execute();
+
+    us = cycle_counter_to_us(cycle_counter_get() - start);
+
+    m_stats.runs++;
+    m_stats.run_us += us;
+    m_stats.run_max_us = MAX(m_stats.run_max_us, us);
+}
+
+static void event_loop_work_run(void *p_event_data, uint16_t event_size)
+{
+    event_loop_work_t *work = *(event_loop_work_t **) p_event_data;
+
+    /* Cleared first, an interrupt during the handler queues it again */
+    work->queued = false;
+    work->handler(NULL, 0);
+}
+
+void event_loop_defer(event_loop_work_t *work)
+{
+    bool queued;
+
+    CRITICAL_REGION_ENTER();
+    queued = work->queued;
+    work->queued = true;
+    CRITICAL_REGION_EXIT();
+
+    if (queued)
+    {
+        m_stats.coalesced++;
+        return;
+    }
+
+    if (NRF_SUCCESS != app_sched_event_put(&work, sizeof(work), event_loop_work_run))
+    {
+        /* Try again with the next deferral */
+        work->queued = false;
+        m_stats.queue_full++;
+        NRF_LOG_ERROR("Scheduler queue is full, SCHED_QUEUE_SIZE is too small");
+    }
+}
+
+#if NRF_SDH_DISPATCH_MODEL == NRF_SDH_DISPATCH_MODEL_POLLING
+static void sdh_poll_run(void *p_event_data, uint16_t event_size)
+{
+    nrf_sdh_evts_poll();
+}
+
+EVENT_LOOP_WORK_DEF(m_sdh_poll_work, sdh_poll_run);
+
+/* nrf_sdh leaves this interrupt to the application in the polling model.
+ * With NRF_SDH_DISPATCH_MODEL_APPSH it queues an event per interrupt
+ * instead, and resets the chip once the queue is full */
+void SD_EVT_IRQHandler(void)
+{
+    event_loop_defer(&m_sdh_poll_work);
+}
+#endif
+
+void event_loop_stats_get(event_loop_stats_t *stats)
+{
+    *stats = m_stats;
+    stats->queue_depth_max = app_sched_queue_utilization_get();
+}
+
+void event_loop_init(uint16_t queue_size)
+{
+    m_queue_size = queue_size;
+
+    cycle_counter_init();
+}
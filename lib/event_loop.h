@@ -0,0 +1,53 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_scheduler.h"
+
+/* Work items defined with EVENT_LOOP_WORK_DEF, each takes at most one
+ * entry of the app_scheduler queue */
+#define EVENT_LOOP_WORK_MAX 5
+
+/* Room a deferred work item needs in the app_scheduler queue */
+#define EVENT_LOOP_EVENT_DATA_SIZE sizeof(void *)
+
+typedef struct {
+    app_sched_event_handler_t handler;
+    volatile bool queued;
+} event_loop_work_t;
+
+#define EVENT_LOOP_WORK_DEF(WORK_NAME, WORK_HANDLER) \
+    static event_loop_work_t WORK_NAME = { .handler = WORK_HANDLER }
+
+typedef struct {
+    uint32_t runs;           /* passes of the main loop that ran events */
+    uint32_t run_us;         /* time in the event handlers, out of interrupts */
+    uint32_t run_max_us;     /* the longest pass */
+    uint32_t coalesced;      /* deferrals of work that was still queued */
+    uint32_t queue_full;     /* deferrals the queue had no room for, a sizing bug */
+    uint16_t queue_depth_max;
+} event_loop_stats_t;
+
+/* After APP_SCHED_INIT(), with the same queue size */
+void event_loop_init(uint16_t queue_size);
+
+/* Runs the queued events, from the main loop only */
+void event_loop_run(void);
+
+/* For interrupt handlers: runs the work from the main loop, with no event
+ * data. Work deferred again before it ran is only run once */
+void event_loop_defer(event_loop_work_t *work);
+
+void event_loop_stats_get(event_loop_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EVENT_LOOP_H */
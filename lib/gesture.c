@@ -0,0 +1,236 @@
+#include "gesture.h"
+
+#include <string.h>
+
+#include "sdk_config.h"
+#include "app_util.h"
+
+#include "nrf_log.h"
+
+#include "fds.h"
+
+#include "led_presets.h"
+
+/*
+ * The table is indexed by the gesture itself, so matching one is a single
+ * array access. It is stored as one FDS record in its own file, read into
+ * m_table once FDS is initialized. The record data doubles as the source
+ * buffer of the FDS write, so a new table is refused until the previous
+ * one has been written.
+ */
+
+#define GESTURE_FILE_ID 0xBEF2
+#define GESTURE_RECORD_KEY 0x0001
+
+#define GESTURE_RECORD_WORDS BYTES_TO_WORDS(sizeof(gesture_table_t))
+
+STATIC_ASSERT(sizeof(gesture_table_t) % sizeof(uint32_t) == 0);
+
+/* What the board button did before the table existed. Without the knob a
+ * double click steps through the presets instead */
+static gesture_table_t const m_table_default = {
+    .entries = {
+#if ENCODER_ENABLED
+        [2 - 1] = { GESTURE_ACTION_KNOB_MODE, 0 },
+#else
+        [2 - 1] = { GESTURE_ACTION_PRESET_NEXT, 0 },
+#endif
+        [3 - 1] = { GESTURE_ACTION_WIPE, 0 },
+        [GESTURE_CLICKS_MAX + 0] = { GESTURE_ACTION_DIM, 0 },
+    }
+};
+
+static gesture_table_t m_table = m_table_default;
+
+static uint32_t m_record_data[GESTURE_RECORD_WORDS];
+static uint32_t m_record_id;
+static bool m_record_found;
+static bool m_busy;
+
+static gesture_change_handler_t m_change_handler;
+
+static void gesture_notify_change(void)
+{
+    if (m_change_handler != NULL)
+    {
+        m_change_handler(&m_table);
+    }
+}
+
+static uint8_t gesture_index(gesture_kind_t kind, uint8_t clicks)
+{
+    if (kind == GESTURE_CLICK)
+    {
+        return MIN(MAX(clicks, 1), GESTURE_CLICKS_MAX) - 1;
+    }
+
+    return GESTURE_CLICKS_MAX + MIN(clicks, GESTURE_CLICKS_MAX - 1);
+}
+
+static bool gesture_table_valid(gesture_table_t const *table)
+{
+    uint8_t i;
+
+    for (i = 0; i < GESTURE_COUNT; i++)
+    {
+        gesture_entry_t const *entry = &table->entries[i];
+
+        if (entry->action >= GESTURE_ACTION_COUNT)
+        {
+            return false;
+        }
+
+        if (entry->action == GESTURE_ACTION_PRESET_RECALL &&
+            entry->param >= LED_PRESETS_COUNT)
+        {
+            return false;
+        }
+
+        /* A ramp needs the hold repeats */
+        if (entry->action == GESTURE_ACTION_DIM && i < GESTURE_CLICKS_MAX)
+        {
+            return false;
+        }
+
+#if !ENCODER_ENABLED
+        /* There is no knob to switch */
+        if (entry->action == GESTURE_ACTION_KNOB_MODE)
+        {
+            return false;
+        }
+#endif
+    }
+
+    return true;
+}
+
+gesture_entry_t gesture_lookup(gesture_kind_t kind, uint8_t clicks)
+{
+    return m_table.entries[gesture_index(kind, clicks)];
+}
+
+ret_code_t gesture_table_set(gesture_table_t const *table)
+{
+    fds_record_desc_t record_desc;
+    fds_record_t record;
+    ret_code_t ret_code;
+
+    if (!gesture_table_valid(table))
+    {
+        return NRF_ERROR_INVALID_DATA;
+    }
+
+    if (m_busy)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    memcpy(m_record_data, table, sizeof(gesture_table_t));
+
+    record.file_id = GESTURE_FILE_ID;
+    record.key = GESTURE_RECORD_KEY;
+    record.data.p_data = m_record_data;
+    record.data.length_words = GESTURE_RECORD_WORDS;
+
+    if (m_record_found)
+    {
+        fds_descriptor_from_rec_id(&record_desc, m_record_id);
+        ret_code = fds_record_update(&record_desc, &record);
+    }
+    else
+    {
+        ret_code = fds_record_write(&record_desc, &record);
+    }
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        return ret_code;
+    }
+
+    m_table = *table;
+    m_record_id = record_desc.record_id;
+    m_record_found = true;
+    m_busy = true;
+
+    gesture_notify_change();
+
+    return NRF_SUCCESS;
+}
+
+void gesture_table_get(gesture_table_t *table)
+{
+    *table = m_table;
+}
+
+static void gesture_table_load(void)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_flash_record_t flash_record;
+    gesture_table_t table;
+
+    memset(&record_token, 0, sizeof(fds_find_token_t));
+
+    if (NRF_SUCCESS == fds_record_find(GESTURE_FILE_ID,
+                                       GESTURE_RECORD_KEY,
+                                       &record_desc,
+                                       &record_token) &&
+        NRF_SUCCESS == fds_record_open(&record_desc, &flash_record))
+    {
+        m_record_id = record_desc.record_id;
+        m_record_found = true;
+
+        /* A table of another size or with unknown actions is overwritten
+         * by the next one set, the defaults stay until then */
+        if (flash_record.p_header->length_words == GESTURE_RECORD_WORDS)
+        {
+            memcpy(&table, flash_record.p_data, sizeof(gesture_table_t));
+
+            if (gesture_table_valid(&table))
+            {
+                m_table = table;
+                NRF_LOG_INFO("Gesture table loaded");
+            }
+        }
+
+        fds_record_close(&record_desc);
+    }
+
+    gesture_notify_change();
+}
+
+static void gesture_fds_events_handler(fds_evt_t const * p_evt)
+{
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            if (p_evt->result == NRF_SUCCESS)
+            {
+                gesture_table_load();
+            }
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            if (p_evt->write.file_id == GESTURE_FILE_ID)
+            {
+                m_busy = false;
+
+                if (p_evt->result != NRF_SUCCESS)
+                {
+                    NRF_LOG_WARNING("Unable to store the gesture table (0x%04X)", p_evt->result);
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+ret_code_t gesture_init(gesture_change_handler_t change_handler)
+{
+    m_change_handler = change_handler;
+
+    return fds_register(gesture_fds_events_handler);
+}
@@ -0,0 +1,67 @@
+#ifndef GESTURE_H
+#define GESTURE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+
+/* Click counts with their own entry, more clicks use the last one */
+#define GESTURE_CLICKS_MAX 4
+
+typedef enum {
+    GESTURE_CLICK = 0, /* clicks: 1 to GESTURE_CLICKS_MAX */
+    GESTURE_HOLD       /* clicks before the held press: 0 for a long hold,
+                          1 and up for click-then-hold */
+} gesture_kind_t;
+
+/* The clicks first, then the holds after 0 to GESTURE_CLICKS_MAX - 1 clicks */
+#define GESTURE_COUNT (2 * GESTURE_CLICKS_MAX)
+
+typedef enum {
+    GESTURE_ACTION_NONE = 0,
+    GESTURE_ACTION_TOGGLE,        /* turns the LED on or off */
+    GESTURE_ACTION_PRESET_RECALL, /* param is the preset slot */
+    GESTURE_ACTION_PRESET_NEXT,   /* the next occupied preset slot */
+    GESTURE_ACTION_WIPE,          /* wipes the LED state saves */
+    GESTURE_ACTION_DIM,           /* brightness ramp while held, holds only */
+    GESTURE_ACTION_KNOB_MODE,     /* the knob turns the hue or the brightness, ENCODER_ENABLED only */
+    GESTURE_ACTION_COUNT
+} gesture_action_t;
+
+typedef struct {
+    uint8_t action; /* gesture_action_t */
+    uint8_t param;
+} gesture_entry_t;
+
+/* Also the value of the BLE characteristic and of the FDS record */
+typedef struct {
+    gesture_entry_t entries[GESTURE_COUNT];
+} gesture_table_t;
+
+/* Called once the stored table is loaded and whenever it is changed */
+typedef void (*gesture_change_handler_t)(gesture_table_t const *table);
+
+/* Must be called before FDS is initialized, the default table is used
+ * until the stored one is loaded */
+ret_code_t gesture_init(gesture_change_handler_t change_handler);
+
+/* A constant time lookup, never touches flash */
+gesture_entry_t gesture_lookup(gesture_kind_t kind, uint8_t clicks);
+
+/* Takes effect at once and is written to flash. Returns
+ * NRF_ERROR_INVALID_DATA if an entry is not valid and NRF_ERROR_BUSY
+ * while the previous table is still being written */
+ret_code_t gesture_table_set(gesture_table_t const *table);
+
+void gesture_table_get(gesture_table_t *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GESTURE_H */
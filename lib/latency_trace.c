@@ -0,0 +1,165 @@
+#include "latency_trace.h"
+
+#if LATENCY_TRACE_ENABLED
+
+#include <string.h>
+
+#include "app_util.h"
+#include "app_util_platform.h"
+
+#include "nrf_log.h"
+
+#include "cycle_counter.h"
+
+/*
+ * A trace is opened by an input (a GPIOTE edge or a GATTS write) and closed
+ * once the PWM has loaded the duty cycles it caused. The points on the way
+ * are timestamped with the DWT cycle counter, which wraps after a minute at
+ * 64 MHz, so a trace older than LATENCY_TRACE_TIMEOUT_MS is dropped instead
+ * of being closed by some unrelated LED update.
+ *
+ * Only one trace is open at a time: every input restarts it. A trace is
+ * started from the GPIOTE interrupt, which can preempt a mark in the main
+ * loop, so the trace state is only touched in a critical region. The trace
+ * is reported after it, from a copy.
+ */
+
+static latency_trace_stats_t m_stats;
+static uint64_t m_sum_us[LATENCY_SOURCE_COUNT][LATENCY_POINT_COUNT];
+
+static latency_trace_handler_t m_handler;
+
+static bool m_open;
+static latency_source_t m_source;
+static uint32_t m_start;
+static uint8_t m_points_hit;
+static uint32_t m_point_us[LATENCY_POINT_COUNT];
+
+static uint8_t latency_bucket(uint32_t us)
+{
+    uint8_t bucket = 0;
+    uint32_t limit = 64;
+
+    while (us >= limit && bucket < LATENCY_TRACE_BUCKETS - 1)
+    {
+        limit *= 4;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static void latency_record(latency_stats_t *stats, uint64_t *sum_us, uint32_t us)
+{
+    stats->min_us = stats->count == 0 ? us : MIN(stats->min_us, us);
+    stats->max_us = MAX(stats->max_us, us);
+
+    stats->count++;
+    *sum_us += us;
+    stats->avg_us = *sum_us / stats->count;
+
+    if (stats->histogram[latency_bucket(us)] != UINT16_MAX)
+    {
+        stats->histogram[latency_bucket(us)]++;
+    }
+}
+
+static void latency_trace_report(latency_source_t source,
+                                 uint32_t const *point_us,
+                                 latency_trace_stats_t const *stats)
+{
+    NRF_LOG_INFO("Latency of %s: %d us to LED update, %d us to light",
+                 source == LATENCY_SOURCE_BUTTON ? "button" : "BLE write",
+                 point_us[LATENCY_POINT_LED_UPDATE],
+                 point_us[LATENCY_POINT_PWM_RELOAD]);
+
+    if (m_handler != NULL)
+    {
+        m_handler(stats);
+    }
+}
+
+void latency_trace_init(latency_trace_handler_t handler)
+{
+    m_handler = handler;
+
+    cycle_counter_init();
+}
+
+void latency_trace_start(latency_source_t source)
+{
+    CRITICAL_REGION_ENTER();
+
+    m_start = cycle_counter_get();
+    m_source = source;
+    m_points_hit = 0;
+    m_open = true;
+
+    CRITICAL_REGION_EXIT();
+}
+
+bool latency_trace_mark(latency_point_t point)
+{
+    latency_trace_stats_t stats;
+    uint32_t point_us[LATENCY_POINT_COUNT];
+    latency_source_t source;
+    bool closed = false;
+    bool open;
+    uint32_t us;
+
+    CRITICAL_REGION_ENTER();
+
+    open = m_open;
+
+    if (open)
+    {
+        us = cycle_counter_to_us(cycle_counter_get() - m_start);
+
+        if (us > LATENCY_TRACE_TIMEOUT_MS * 1000)
+        {
+            m_open = false;
+            open = false;
+        }
+    }
+
+    if (open)
+    {
+        /* A point hit again within the trace (e.g. the debounce of a release
+         * that did not restart it) keeps its first time */
+        if (!(m_points_hit & (1 << point)))
+        {
+            m_points_hit |= 1 << point;
+            m_point_us[point] = us;
+
+            latency_record(&m_stats.points[m_source][point],
+                           &m_sum_us[m_source][point],
+                           us);
+        }
+
+        if (point == LATENCY_POINT_PWM_RELOAD)
+        {
+            m_open = false;
+            closed = true;
+
+            source = m_source;
+            memcpy(point_us, m_point_us, sizeof(point_us));
+            stats = m_stats;
+        }
+    }
+
+    CRITICAL_REGION_EXIT();
+
+    if (closed)
+    {
+        latency_trace_report(source, point_us, &stats);
+    }
+
+    return open;
+}
+
+void latency_trace_abort(void)
+{
+    m_open = false;
+}
+
+#endif /* LATENCY_TRACE_ENABLED */
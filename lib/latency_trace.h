@@ -0,0 +1,71 @@
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_config.h"
+
+/* Histogram buckets are powers of four, from below 64 us up to 256 ms and above */
+#define LATENCY_TRACE_BUCKETS 8
+
+typedef enum {
+    LATENCY_SOURCE_BUTTON = 0, /* GPIOTE edge of a button */
+    LATENCY_SOURCE_BLE,        /* GATTS write event */
+    LATENCY_SOURCE_COUNT
+} latency_source_t;
+
+typedef enum {
+    LATENCY_POINT_DEBOUNCE = 0, /* the button state change was accepted */
+    LATENCY_POINT_LED_UPDATE,   /* the new duty cycles are in the PWM sequence */
+    LATENCY_POINT_PWM_RELOAD,   /* the PWM picked them up, ends the trace */
+    LATENCY_POINT_COUNT
+} latency_point_t;
+
+/* Time from the start of a trace to one of its points */
+typedef struct {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t avg_us;
+    uint16_t histogram[LATENCY_TRACE_BUCKETS];
+} latency_stats_t;
+
+typedef struct {
+    latency_stats_t points[LATENCY_SOURCE_COUNT][LATENCY_POINT_COUNT];
+} latency_trace_stats_t;
+
+/* Called from the context of the trace's last point */
+typedef void (*latency_trace_handler_t)(latency_trace_stats_t const *stats);
+
+#if LATENCY_TRACE_ENABLED
+
+void latency_trace_init(latency_trace_handler_t handler);
+
+/* Starts a trace, one that is still open is dropped */
+void latency_trace_start(latency_source_t source);
+
+/* Returns false if no trace is open */
+bool latency_trace_mark(latency_point_t point);
+
+/* Drops the open trace, if any */
+void latency_trace_abort(void);
+
+#else
+
+static inline void latency_trace_init(latency_trace_handler_t handler) {}
+static inline void latency_trace_start(latency_source_t source) {}
+static inline bool latency_trace_mark(latency_point_t point) { return false; }
+static inline void latency_trace_abort(void) {}
+
+#endif /* LATENCY_TRACE_ENABLED */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LATENCY_TRACE_H */
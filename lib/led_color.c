@@ -0,0 +1,87 @@
+#include "led_color.h"
+
+#include "app_util.h"
+
+/*
+ * The hue is kept as the position on the edge of the RGB hexagon: six
+ * sectors of LED_HUE_SECTOR, in each one channel is at the largest value,
+ * one at the smallest and the third one rises or falls between them.
+ * Going to and back from a position rounds to the nearest value, so a
+ * color that is not rotated comes back unchanged.
+ */
+#define LED_HUE_SECTOR 256
+#define LED_HUE_RANGE (6 * LED_HUE_SECTOR)
+
+static uint16_t led_hue_fraction(uint8_t value, uint8_t min, uint8_t span)
+{
+    return ((uint16_t) (value - min) * LED_HUE_SECTOR + span / 2) / span;
+}
+
+static uint8_t led_hue_value(uint16_t fraction, uint8_t span)
+{
+    return ((uint16_t) fraction * span + LED_HUE_SECTOR / 2) / LED_HUE_SECTOR;
+}
+
+static uint16_t led_hue_get(rgb_t c, uint8_t max, uint8_t min)
+{
+    uint8_t span = max - min;
+
+    if (c.r == max && c.b == min)
+        return 0 * LED_HUE_SECTOR + led_hue_fraction(c.g, min, span);
+
+    if (c.g == max && c.b == min)
+        return 2 * LED_HUE_SECTOR - led_hue_fraction(c.r, min, span);
+
+    if (c.g == max && c.r == min)
+        return 2 * LED_HUE_SECTOR + led_hue_fraction(c.b, min, span);
+
+    if (c.b == max && c.r == min)
+        return 4 * LED_HUE_SECTOR - led_hue_fraction(c.g, min, span);
+
+    if (c.b == max && c.g == min)
+        return 4 * LED_HUE_SECTOR + led_hue_fraction(c.r, min, span);
+
+    /* red is the largest, green the smallest */
+    return (6 * LED_HUE_SECTOR - led_hue_fraction(c.b, min, span)) % LED_HUE_RANGE;
+}
+
+static rgb_t led_hue_set(uint16_t hue, uint8_t max, uint8_t min)
+{
+    uint8_t span = max - min;
+    uint8_t rising = min + led_hue_value(hue % LED_HUE_SECTOR, span);
+    uint8_t falling = max - led_hue_value(hue % LED_HUE_SECTOR, span);
+
+    switch (hue / LED_HUE_SECTOR)
+    {
+        case 0:
+            return (rgb_t) { max, rising, min };
+        case 1:
+            return (rgb_t) { falling, max, min };
+        case 2:
+            return (rgb_t) { min, max, rising };
+        case 3:
+            return (rgb_t) { min, falling, max };
+        case 4:
+            return (rgb_t) { rising, min, max };
+        default:
+            return (rgb_t) { max, min, falling };
+    }
+}
+
+rgb_t led_color_hue_rotate(rgb_t color, int16_t degrees)
+{
+    uint8_t max = MAX(color.r, MAX(color.g, color.b));
+    uint8_t min = MIN(color.r, MIN(color.g, color.b));
+    int32_t hue;
+
+    if (max == min)
+        return color;
+
+    hue = led_hue_get(color, max, min) + (int32_t) degrees * LED_HUE_RANGE / 360;
+    hue %= LED_HUE_RANGE;
+
+    if (hue < 0)
+        hue += LED_HUE_RANGE;
+
+    return led_hue_set(hue, max, min);
+}
@@ -0,0 +1,21 @@
+#ifndef LED_COLOR_H
+#define LED_COLOR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "led_common.h"
+
+/* Turns the hue by degrees, negative ones turn it back. The largest and the
+ * smallest of the channels stay as they are, so saturation and value do not
+ * drift however often it is called. Grays have no hue and are returned as is */
+rgb_t led_color_hue_rotate(rgb_t color, int16_t degrees);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LED_COLOR_H */
@@ -7,9 +7,13 @@ typedef struct {
     uint8_t b;
 } rgb_t;
 
+#define LED_BRIGHTNESS_MIN 8
+#define LED_BRIGHTNESS_MAX 255
+
 typedef struct {
     rgb_t color;
     uint8_t state;
+    uint8_t brightness; /* scales the color, LED_BRIGHTNESS_MIN..LED_BRIGHTNESS_MAX */
 } led_params_t;
 
 #endif /* LED_COMMON_H */
@@ -0,0 +1,584 @@
+#include "led_journal.h"
+
+#include <string.h>
+
+#include "nrf.h"
+#include "app_util.h"
+
+#include "nrf_log.h"
+
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_sd.h"
+
+#include "fds.h"
+#include "fds_internal_defs.h"
+
+/*
+ * The journal lives in two flash pages right below the FDS pages.
+ *
+ * Page layout:
+ *   word 0     header, LED_JOURNAL_MAGIC | 16-bit sequence number
+ *   word 1..n  entries, 4-bit field id | 4-bit check | 24-bit value
+ *
+ * Every change appends only the fields that differ from the previous state,
+ * one word each. When the active page is full, the whole state is written
+ * as a snapshot into the other page, followed by its header with the next
+ * sequence number. The header is written last, so a page with a valid header
+ * always starts with a complete snapshot. On boot the page with the newest
+ * header is replayed up to the first erased word.
+ */
+
+#define LED_JOURNAL_PAGES 2
+#define LED_JOURNAL_PAGE_SIZE 4096
+#define LED_JOURNAL_PAGE_WORDS (LED_JOURNAL_PAGE_SIZE / sizeof(uint32_t))
+
+#define LED_JOURNAL_MAGIC 0x4C4A0000UL
+#define LED_JOURNAL_MAGIC_MASK 0xFFFF0000UL
+
+#define LED_JOURNAL_ERASED_WORD 0xFFFFFFFFUL
+
+/* gcc_nrf52.ld reserves the journal pages right below this much FDS flash,
+ * under its BOOTLOADER_START */
+#define LED_JOURNAL_LD_FDS_SIZE 0x3000
+
+STATIC_ASSERT(LED_JOURNAL_PAGES * LED_JOURNAL_PAGE_SIZE == 0x2000);
+STATIC_ASSERT((FDS_PHY_PAGES_RESERVED + FDS_PHY_PAGES) * FDS_PHY_PAGE_SIZE * sizeof(uint32_t) ==
+              LED_JOURNAL_LD_FDS_SIZE);
+
+/* Linker symbol of the reserved pages, the image ends below it */
+extern uint32_t __led_journal_start[];
+
+/* Appends queued in fstorage, each one write of the entries of a change */
+#define LED_JOURNAL_QUEUE_SIZE 4
+
+enum {
+    led_journal_field_color = 1,
+    led_journal_field_state = 2,
+    led_journal_field_brightness = 3,
+
+    /* Journals written before brightness existed replay at full brightness */
+    led_journal_fields_required = (1 << led_journal_field_color) |
+                                  (1 << led_journal_field_state)
+};
+
+enum {
+    led_journal_snapshot_len = 3
+};
+
+typedef enum {
+    journal_op_append = 1,
+    journal_op_erase,
+    journal_op_snapshot,
+    journal_op_header,
+    journal_op_clean
+} journal_op_t;
+
+static void journal_fstorage_evt_handler(nrf_fstorage_evt_t * p_evt);
+
+NRF_FSTORAGE_DEF(nrf_fstorage_t m_journal_fstorage) =
+{
+    .evt_handler = journal_fstorage_evt_handler,
+    .start_addr = 0,
+    .end_addr = 0,
+};
+
+static led_journal_ready_handler_t m_ready_handler;
+
+static uint8_t m_active_page;
+static uint16_t m_sequence;
+static uint32_t m_write_offset;
+
+static led_params_t m_state;
+static bool m_state_valid;
+
+static bool m_busy;
+
+static uint32_t m_queue[LED_JOURNAL_QUEUE_SIZE][led_journal_snapshot_len];
+static uint8_t m_queue_head;
+static uint8_t m_queue_count;
+
+static uint32_t m_snapshot[led_journal_snapshot_len];
+static uint32_t m_header;
+
+static led_journal_stats_t m_stats;
+
+static uint32_t journal_region_end(void)
+{
+    uint32_t const bootloader_addr = NRF_UICR->NRFFW[0];
+    uint32_t const page_size = NRF_FICR->CODEPAGESIZE;
+    uint32_t const code_size = NRF_FICR->CODESIZE;
+
+    uint32_t end_addr = (bootloader_addr != 0xFFFFFFFF) ? bootloader_addr
+                                                        : (code_size * page_size);
+
+    /* Same arithmetic as fds.c uses to place its pages */
+    end_addr -= FDS_PHY_PAGES_RESERVED * FDS_PHY_PAGE_SIZE * sizeof(uint32_t);
+    end_addr -= FDS_PHY_PAGES * FDS_PHY_PAGE_SIZE * sizeof(uint32_t);
+
+    return end_addr;
+}
+
+static uint32_t page_addr(uint8_t page)
+{
+    return m_journal_fstorage.start_addr + page * LED_JOURNAL_PAGE_SIZE;
+}
+
+static uint32_t const * page_words(uint8_t page)
+{
+    return (uint32_t const *) (uintptr_t) page_addr(page);
+}
+
+static bool page_is_erased(uint8_t page)
+{
+    uint32_t const *words = page_words(page);
+    uint32_t offset;
+
+    for (offset = 0; offset < LED_JOURNAL_PAGE_WORDS; offset++)
+    {
+        if (words[offset] != LED_JOURNAL_ERASED_WORD)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint32_t entry_check(uint8_t field, uint32_t value)
+{
+    uint32_t check = field;
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        check ^= (value >> (4 * i)) & 0xF;
+    }
+
+    return ~check & 0xF;
+}
+
+static uint32_t entry_encode(uint8_t field, uint32_t value)
+{
+    value &= 0xFFFFFF;
+
+    return ((uint32_t) field << 28) | (entry_check(field, value) << 24) | value;
+}
+
+static bool entry_decode(uint32_t entry, uint8_t *field, uint32_t *value)
+{
+    *field = entry >> 28;
+    *value = entry & 0xFFFFFF;
+
+    return ((entry >> 24) & 0xF) == entry_check(*field, *value);
+}
+
+static uint32_t color_to_value(rgb_t color)
+{
+    return ((uint32_t) color.r << 16) | ((uint32_t) color.g << 8) | color.b;
+}
+
+static rgb_t value_to_color(uint32_t value)
+{
+    return (rgb_t) { value >> 16, value >> 8, value };
+}
+
+/* Returns the mask of fields applied to params */
+static uint32_t entry_apply(uint8_t field, uint32_t value, led_params_t *params)
+{
+    switch (field)
+    {
+        case led_journal_field_color:
+            params->color = value_to_color(value);
+            break;
+
+        case led_journal_field_state:
+            params->state = value;
+            break;
+
+        case led_journal_field_brightness:
+            params->brightness = value;
+            break;
+
+        default:
+            return 0;
+    }
+
+    return 1 << field;
+}
+
+static bool header_is_valid(uint32_t header)
+{
+    return (header & LED_JOURNAL_MAGIC_MASK) == LED_JOURNAL_MAGIC;
+}
+
+static uint16_t header_sequence(uint32_t header)
+{
+    return header & 0xFFFF;
+}
+
+static void journal_notify_ready(void)
+{
+    if (m_ready_handler != NULL)
+    {
+        m_ready_handler();
+    }
+}
+
+static ret_code_t journal_snapshot_write(void)
+{
+    uint8_t target = m_active_page ^ 1;
+
+    return nrf_fstorage_write(&m_journal_fstorage,
+                              page_addr(target) + sizeof(uint32_t),
+                              m_snapshot,
+                              sizeof(m_snapshot),
+                              (void *) journal_op_snapshot);
+}
+
+static ret_code_t journal_compaction_start(led_params_t const *params)
+{
+    uint8_t target = m_active_page ^ 1;
+    ret_code_t ret_code;
+
+    m_snapshot[0] = entry_encode(led_journal_field_color, color_to_value(params->color));
+    m_snapshot[1] = entry_encode(led_journal_field_state, params->state);
+    m_snapshot[2] = entry_encode(led_journal_field_brightness, params->brightness);
+
+    if (page_is_erased(target))
+    {
+        /* A new or cleaned page, erasing it again would only wear it */
+        ret_code = journal_snapshot_write();
+    }
+    else
+    {
+        ret_code = nrf_fstorage_erase(&m_journal_fstorage,
+                                      page_addr(target),
+                                      1,
+                                      (void *) journal_op_erase);
+    }
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        /* Nothing has changed, the caller tries again or starts over */
+        NRF_LOG_WARNING("Unable to start journal compaction (0x%04X)", ret_code);
+        return ret_code;
+    }
+
+    m_state = *params;
+    m_state_valid = true;
+    m_busy = true;
+
+    return NRF_SUCCESS;
+}
+
+static void journal_on_erase(nrf_fstorage_evt_t const * p_evt)
+{
+    ret_code_t ret_code = p_evt->result;
+
+    m_stats.page_erases++;
+
+    if (ret_code == NRF_SUCCESS)
+    {
+        ret_code = journal_snapshot_write();
+    }
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        m_state_valid = false;
+        m_busy = false;
+        journal_notify_ready();
+    }
+}
+
+static void journal_on_snapshot(nrf_fstorage_evt_t const * p_evt)
+{
+    uint8_t target = m_active_page ^ 1;
+    ret_code_t ret_code = p_evt->result;
+
+    if (ret_code == NRF_SUCCESS)
+    {
+        m_header = LED_JOURNAL_MAGIC | (uint16_t) (m_sequence + 1);
+
+        ret_code = nrf_fstorage_write(&m_journal_fstorage,
+                                      page_addr(target),
+                                      &m_header,
+                                      sizeof(m_header),
+                                      (void *) journal_op_header);
+    }
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        m_state_valid = false;
+        m_busy = false;
+        journal_notify_ready();
+    }
+}
+
+static void journal_on_header(nrf_fstorage_evt_t const * p_evt)
+{
+    if (p_evt->result == NRF_SUCCESS)
+    {
+        m_active_page ^= 1;
+        m_sequence++;
+        m_write_offset = 1 + led_journal_snapshot_len;
+        m_stats.compactions++;
+
+        NRF_LOG_INFO("LED journal compacted into page %d", m_active_page);
+    }
+    else
+    {
+        m_state_valid = false;
+    }
+
+    m_busy = false;
+    journal_notify_ready();
+}
+
+static void journal_on_clean(nrf_fstorage_evt_t const * p_evt)
+{
+    m_stats.page_erases += LED_JOURNAL_PAGES;
+
+    /* The first append writes a snapshot into page 0 */
+    m_active_page = 1;
+    m_write_offset = LED_JOURNAL_PAGE_WORDS;
+    m_state_valid = false;
+
+    m_busy = false;
+    journal_notify_ready();
+}
+
+static void journal_fstorage_evt_handler(nrf_fstorage_evt_t * p_evt)
+{
+    switch ((journal_op_t) (uintptr_t) p_evt->p_param)
+    {
+        case journal_op_append:
+            m_queue_head = (m_queue_head + 1) % LED_JOURNAL_QUEUE_SIZE;
+            m_queue_count--;
+
+            if (p_evt->result != NRF_SUCCESS)
+            {
+                /* Rewrite everything with the next append */
+                m_state_valid = false;
+            }
+
+            journal_notify_ready();
+            break;
+
+        case journal_op_erase:
+            journal_on_erase(p_evt);
+            break;
+
+        case journal_op_snapshot:
+            journal_on_snapshot(p_evt);
+            break;
+
+        case journal_op_header:
+            journal_on_header(p_evt);
+            break;
+
+        case journal_op_clean:
+            journal_on_clean(p_evt);
+            break;
+
+        default:
+            break;
+    }
+}
+
+ret_code_t led_journal_append(led_params_t const *params)
+{
+    uint8_t slot = (m_queue_head + m_queue_count) % LED_JOURNAL_QUEUE_SIZE;
+    uint32_t entries = 0;
+    ret_code_t ret_code;
+
+    bool color_changed = !m_state_valid ||
+                         0 != memcmp(&m_state.color, &params->color, sizeof(rgb_t));
+    bool state_changed = !m_state_valid || m_state.state != params->state;
+    bool brightness_changed = !m_state_valid || m_state.brightness != params->brightness;
+
+    if (m_busy)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    if (!color_changed && !state_changed && !brightness_changed)
+    {
+        return NRF_SUCCESS;
+    }
+
+    if (!m_state_valid ||
+        m_write_offset + color_changed + state_changed + brightness_changed > LED_JOURNAL_PAGE_WORDS)
+    {
+        return journal_compaction_start(params);
+    }
+
+    if (m_queue_count == LED_JOURNAL_QUEUE_SIZE)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    if (color_changed)
+    {
+        m_queue[slot][entries++] = entry_encode(led_journal_field_color,
+                                                color_to_value(params->color));
+    }
+
+    if (state_changed)
+    {
+        m_queue[slot][entries++] = entry_encode(led_journal_field_state, params->state);
+    }
+
+    if (brightness_changed)
+    {
+        m_queue[slot][entries++] = entry_encode(led_journal_field_brightness, params->brightness);
+    }
+
+    /* All the entries of a change go in one write, so the journaled state
+     * follows only once the whole change is queued */
+    ret_code = nrf_fstorage_write(&m_journal_fstorage,
+                                  page_addr(m_active_page) + m_write_offset * sizeof(uint32_t),
+                                  m_queue[slot],
+                                  entries * sizeof(uint32_t),
+                                  (void *) journal_op_append);
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        return ret_code;
+    }
+
+    m_queue_count++;
+    m_write_offset += entries;
+    m_stats.entries_written += entries;
+
+    m_state = *params;
+
+    return NRF_SUCCESS;
+}
+
+bool led_journal_load(led_params_t *params)
+{
+    uint32_t const *words;
+    uint32_t header[LED_JOURNAL_PAGES];
+    uint32_t fields = 0;
+    uint32_t offset;
+    int i;
+
+    for (i = 0; i < LED_JOURNAL_PAGES; i++)
+    {
+        header[i] = page_words(i)[0];
+    }
+
+    if (header_is_valid(header[0]) && header_is_valid(header[1]))
+    {
+        int16_t diff = header_sequence(header[1]) - header_sequence(header[0]);
+        m_active_page = diff > 0 ? 1 : 0;
+    }
+    else if (header_is_valid(header[0]) || header_is_valid(header[1]))
+    {
+        m_active_page = header_is_valid(header[0]) ? 0 : 1;
+    }
+    else
+    {
+        /* Nothing journaled yet, the first append writes a snapshot into page 0 */
+        m_active_page = 1;
+        m_write_offset = LED_JOURNAL_PAGE_WORDS;
+        m_state_valid = false;
+
+        return false;
+    }
+
+    m_sequence = header_sequence(header[m_active_page]);
+    words = page_words(m_active_page);
+
+    m_state.brightness = LED_BRIGHTNESS_MAX;
+
+    for (offset = 1; offset < LED_JOURNAL_PAGE_WORDS; offset++)
+    {
+        uint8_t field;
+        uint32_t value;
+
+        if (words[offset] == LED_JOURNAL_ERASED_WORD)
+        {
+            break;
+        }
+
+        if (!entry_decode(words[offset], &field, &value))
+        {
+            /* Torn write: do not append after it, compact on the next change */
+            NRF_LOG_WARNING("Corrupted LED journal entry at %d", offset);
+            offset = LED_JOURNAL_PAGE_WORDS;
+            break;
+        }
+
+        fields |= entry_apply(field, value, &m_state);
+    }
+
+    m_write_offset = offset;
+    m_state_valid = (fields & led_journal_fields_required) == led_journal_fields_required;
+
+    NRF_LOG_INFO("LED journal replayed: page %d, %d entries",
+                 m_active_page,
+                 m_write_offset - 1);
+
+    if (m_state_valid)
+    {
+        *params = m_state;
+    }
+
+    return m_state_valid;
+}
+
+ret_code_t led_journal_clean(void)
+{
+    ret_code_t ret_code;
+
+    if (m_busy)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    ret_code = nrf_fstorage_erase(&m_journal_fstorage,
+                                  page_addr(0),
+                                  LED_JOURNAL_PAGES,
+                                  (void *) journal_op_clean);
+
+    if (ret_code == NRF_SUCCESS)
+    {
+        m_busy = true;
+    }
+
+    return ret_code;
+}
+
+bool led_journal_busy(void)
+{
+    return m_busy || m_queue_count > 0;
+}
+
+void led_journal_stats_get(led_journal_stats_t *stats)
+{
+    *stats = m_stats;
+    stats->entries_free = LED_JOURNAL_PAGE_WORDS - MIN(m_write_offset, LED_JOURNAL_PAGE_WORDS);
+}
+
+ret_code_t led_journal_init(led_journal_ready_handler_t ready_handler)
+{
+    uint32_t end_addr = journal_region_end();
+
+    m_ready_handler = ready_handler;
+
+    m_journal_fstorage.start_addr = end_addr - LED_JOURNAL_PAGES * LED_JOURNAL_PAGE_SIZE;
+    m_journal_fstorage.end_addr = end_addr;
+
+    /* Without the bootloader the pages move up to the end of flash, still
+     * clear of the image. A bootloader below BOOTLOADER_START moves them
+     * down into it */
+    if (m_journal_fstorage.start_addr < (uintptr_t) __led_journal_start)
+    {
+        NRF_LOG_ERROR("LED journal at 0x%08X is below the pages gcc_nrf52.ld reserves",
+                      m_journal_fstorage.start_addr);
+        return NRF_ERROR_INVALID_ADDR;
+    }
+
+    return nrf_fstorage_init(&m_journal_fstorage, &nrf_fstorage_sd, NULL);
+}
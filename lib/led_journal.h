@@ -0,0 +1,47 @@
+#ifndef LED_JOURNAL_H
+#define LED_JOURNAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+
+#include "led_common.h"
+
+/* Called every time a flash operation of the journal completes,
+ * so a caller that got NRF_ERROR_BUSY knows when to try again */
+typedef void (*led_journal_ready_handler_t)(void);
+
+typedef struct {
+    uint32_t entries_written; /* delta entries appended since boot */
+    uint32_t compactions;     /* snapshots written into a fresh page */
+    uint32_t page_erases;     /* flash pages erased by the journal */
+    uint32_t entries_free;    /* entries left in the active page */
+} led_journal_stats_t;
+
+ret_code_t led_journal_init(led_journal_ready_handler_t ready_handler);
+
+/* Replay the journal, returns false if it holds no complete state */
+bool led_journal_load(led_params_t *params);
+
+/* Append the fields that differ from the last journaled state.
+ * Returns NRF_ERROR_BUSY while a compaction or too many writes are in progress
+ * and NRF_ERROR_NO_MEM if the fstorage queue is full, nothing is journaled then */
+ret_code_t led_journal_append(led_params_t const *params);
+
+ret_code_t led_journal_clean(void);
+
+/* True while a write, compaction or clean is still in flash */
+bool led_journal_busy(void);
+
+void led_journal_stats_get(led_journal_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LED_JOURNAL_H */
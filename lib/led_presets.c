@@ -0,0 +1,327 @@
+#include "led_presets.h"
+
+#include <string.h>
+
+#include "app_util.h"
+
+#include "nrf_log.h"
+
+#include "fds.h"
+
+#include "led_record.h"
+
+/*
+ * Every slot is one FDS record (key = slot + 1) in its own file.
+ * The whole file is decoded into m_slots once FDS is initialized, after that
+ * a recall is served from RAM only. The encoded slot data doubles as the
+ * source buffer of the FDS write, so a slot can not be changed until its
+ * write has completed.
+ *
+ * A store or delete shows up in RAM at once. The previous contents are kept
+ * until FDS reports the result, and they come back if it failed, as the
+ * record in flash is then still the old one.
+ */
+
+#define LED_PRESETS_FILE_ID 0xBEF1
+#define LED_PRESETS_RECORD_KEY_BASE 0x0001
+
+typedef struct {
+    led_params_t params;
+    uint32_t data[LED_RECORD_WORDS];
+    uint32_t record_id;
+    bool used;
+    bool busy; /* a write or a delete is queued in FDS */
+
+    /* What is in flash while busy */
+    led_params_t prev_params;
+    uint32_t prev_record_id;
+    bool prev_used;
+} led_preset_slot_t;
+
+static led_preset_slot_t m_slots[LED_PRESETS_COUNT];
+static bool m_ready;
+
+static led_presets_change_handler_t m_change_handler;
+
+static void presets_notify_change(void)
+{
+    if (m_change_handler != NULL)
+    {
+        m_change_handler(led_presets_occupied_mask());
+    }
+}
+
+static void slot_busy_set(led_preset_slot_t *preset)
+{
+    preset->prev_params = preset->params;
+    preset->prev_record_id = preset->record_id;
+    preset->prev_used = preset->used;
+    preset->busy = true;
+}
+
+static void slot_restore(led_preset_slot_t *preset)
+{
+    preset->params = preset->prev_params;
+    preset->record_id = preset->prev_record_id;
+    preset->used = preset->prev_used;
+
+    presets_notify_change();
+}
+
+static bool record_key_to_slot(uint16_t record_key, uint8_t *slot)
+{
+    if (record_key < LED_PRESETS_RECORD_KEY_BASE ||
+        record_key >= LED_PRESETS_RECORD_KEY_BASE + LED_PRESETS_COUNT)
+    {
+        return false;
+    }
+
+    *slot = record_key - LED_PRESETS_RECORD_KEY_BASE;
+
+    return true;
+}
+
+static ret_code_t slot_check(uint8_t slot)
+{
+    if (!m_ready)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    if (slot >= LED_PRESETS_COUNT)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    if (m_slots[slot].busy)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t led_presets_store(uint8_t slot, led_params_t const *params)
+{
+    led_preset_slot_t *preset;
+    fds_record_desc_t record_desc;
+    fds_record_t record;
+    ret_code_t ret_code;
+
+    ret_code = slot_check(slot);
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        return ret_code;
+    }
+
+    preset = &m_slots[slot];
+
+    led_record_encode(preset->data, params);
+
+    record.file_id = LED_PRESETS_FILE_ID;
+    record.key = LED_PRESETS_RECORD_KEY_BASE + slot;
+    record.data.p_data = preset->data;
+    record.data.length_words = ARRAY_SIZE(preset->data);
+
+    if (preset->used)
+    {
+        fds_descriptor_from_rec_id(&record_desc, preset->record_id);
+        ret_code = fds_record_update(&record_desc, &record);
+    }
+    else
+    {
+        ret_code = fds_record_write(&record_desc, &record);
+    }
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        return ret_code;
+    }
+
+    slot_busy_set(preset);
+
+    preset->params = *params;
+    preset->record_id = record_desc.record_id;
+    preset->used = true;
+
+    presets_notify_change();
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t led_presets_recall(uint8_t slot, led_params_t *params)
+{
+    if (slot >= LED_PRESETS_COUNT || !m_slots[slot].used)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    *params = m_slots[slot].params;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t led_presets_delete(uint8_t slot)
+{
+    fds_record_desc_t record_desc;
+    ret_code_t ret_code;
+
+    ret_code = slot_check(slot);
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        return ret_code;
+    }
+
+    if (!m_slots[slot].used)
+    {
+        return NRF_ERROR_NOT_FOUND;
+    }
+
+    fds_descriptor_from_rec_id(&record_desc, m_slots[slot].record_id);
+    ret_code = fds_record_delete(&record_desc);
+
+    if (ret_code != NRF_SUCCESS)
+    {
+        return ret_code;
+    }
+
+    slot_busy_set(&m_slots[slot]);
+
+    m_slots[slot].used = false;
+
+    presets_notify_change();
+
+    return NRF_SUCCESS;
+}
+
+uint32_t led_presets_occupied_mask(void)
+{
+    uint32_t mask = 0;
+    int i;
+
+    for (i = 0; i < LED_PRESETS_COUNT; i++)
+    {
+        if (m_slots[i].used)
+        {
+            mask |= 1UL << i;
+        }
+    }
+
+    return mask;
+}
+
+static void presets_index_build(void)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_flash_record_t flash_record;
+    uint8_t slot;
+    bool migrated;
+    int loaded = 0;
+
+    memset(&record_token, 0, sizeof(fds_find_token_t));
+
+    while (NRF_SUCCESS == fds_record_find_in_file(LED_PRESETS_FILE_ID,
+                                                  &record_desc,
+                                                  &record_token))
+    {
+        if (NRF_SUCCESS != fds_record_open(&record_desc, &flash_record))
+        {
+            continue;
+        }
+
+        /* Old records are kept as they are, the next store of
+         * the slot writes it in the current format */
+        if (record_key_to_slot(flash_record.p_header->record_key, &slot) &&
+            led_record_decode(flash_record.p_data,
+                              flash_record.p_header->length_words,
+                              &m_slots[slot].params,
+                              &migrated))
+        {
+            m_slots[slot].record_id = record_desc.record_id;
+            m_slots[slot].used = true;
+
+            loaded++;
+        }
+
+        fds_record_close(&record_desc);
+    }
+
+    m_ready = true;
+
+    NRF_LOG_INFO("%d LED presets loaded", loaded);
+
+    presets_notify_change();
+}
+
+static void presets_on_write(fds_evt_t const * p_evt)
+{
+    uint8_t slot;
+
+    if (p_evt->write.file_id != LED_PRESETS_FILE_ID ||
+        !record_key_to_slot(p_evt->write.record_key, &slot))
+    {
+        return;
+    }
+
+    m_slots[slot].busy = false;
+
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Unable to store LED preset %d (0x%04X)", slot, p_evt->result);
+        slot_restore(&m_slots[slot]);
+    }
+}
+
+static void presets_on_delete(fds_evt_t const * p_evt)
+{
+    uint8_t slot;
+
+    if (p_evt->del.file_id != LED_PRESETS_FILE_ID ||
+        !record_key_to_slot(p_evt->del.record_key, &slot))
+    {
+        return;
+    }
+
+    m_slots[slot].busy = false;
+
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Unable to delete LED preset %d (0x%04X)", slot, p_evt->result);
+        slot_restore(&m_slots[slot]);
+    }
+}
+
+static void presets_fds_events_handler(fds_evt_t const * p_evt)
+{
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            if (p_evt->result == NRF_SUCCESS)
+            {
+                presets_index_build();
+            }
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            presets_on_write(p_evt);
+            break;
+
+        case FDS_EVT_DEL_RECORD:
+            presets_on_delete(p_evt);
+            break;
+
+        default:
+            break;
+    }
+}
+
+ret_code_t led_presets_init(led_presets_change_handler_t change_handler)
+{
+    m_change_handler = change_handler;
+
+    return fds_register(presets_fds_events_handler);
+}
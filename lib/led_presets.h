@@ -0,0 +1,36 @@
+#ifndef LED_PRESETS_H
+#define LED_PRESETS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+
+#include "led_common.h"
+
+#define LED_PRESETS_COUNT 32
+
+/* Called whenever the set of occupied slots changes, bit N stands for slot N */
+typedef void (*led_presets_change_handler_t)(uint32_t occupied_mask);
+
+/* Must be called before FDS is initialized */
+ret_code_t led_presets_init(led_presets_change_handler_t change_handler);
+
+ret_code_t led_presets_store(uint8_t slot, led_params_t const *params);
+
+/* Served from the RAM index, never touches flash */
+ret_code_t led_presets_recall(uint8_t slot, led_params_t *params);
+
+ret_code_t led_presets_delete(uint8_t slot);
+
+uint32_t led_presets_occupied_mask(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LED_PRESETS_H */
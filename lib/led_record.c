@@ -0,0 +1,114 @@
+#include "led_record.h"
+
+#include <string.h>
+
+#include "crc16.h"
+
+#include "nrf_log.h"
+
+/* Version 1 had no header: a bare led_params_t in a single word */
+#define LED_RECORD_V1_WORDS 1
+
+typedef void (*led_record_upgrade_t)(uint8_t const *payload, led_params_t *params);
+
+typedef struct {
+    uint8_t version;
+    uint8_t length;
+    led_record_upgrade_t upgrade;
+} led_record_migration_t;
+
+static void led_record_upgrade_v1(uint8_t const *payload, led_params_t *params)
+{
+    params->color.r = payload[0];
+    params->color.g = payload[1];
+    params->color.b = payload[2];
+    params->state = payload[3];
+    params->brightness = LED_BRIGHTNESS_MAX;
+}
+
+static led_record_migration_t const m_migrations[] = {
+    { .version = 1, .length = 4, .upgrade = led_record_upgrade_v1 },
+    /* Version 2 put the v1 payload behind a header, brightness came with version 3 */
+    { .version = 2, .length = 4, .upgrade = led_record_upgrade_v1 },
+};
+
+static uint16_t led_record_crc(led_record_header_t const *header, uint8_t const *payload)
+{
+    uint16_t crc = crc16_compute(&header->version, sizeof(header->version), NULL);
+
+    crc = crc16_compute(&header->length, sizeof(header->length), &crc);
+
+    return crc16_compute(payload, header->length, &crc);
+}
+
+void led_record_encode(uint32_t *words, led_params_t const *params)
+{
+    led_record_t *record = (led_record_t *) words;
+
+    memset(words, 0, LED_RECORD_WORDS * sizeof(uint32_t));
+
+    record->params = *params;
+    record->header.version = LED_RECORD_VERSION;
+    record->header.length = sizeof(led_params_t);
+    record->header.crc = led_record_crc(&record->header, (uint8_t const *) &record->params);
+}
+
+static bool led_record_migrate(uint8_t version,
+                               uint8_t const *payload,
+                               uint8_t length,
+                               led_params_t *params)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(m_migrations); i++)
+    {
+        if (m_migrations[i].version == version && m_migrations[i].length == length)
+        {
+            m_migrations[i].upgrade(payload, params);
+            return true;
+        }
+    }
+
+    NRF_LOG_WARNING("Unknown LED record version %d (%d bytes)", version, length);
+
+    return false;
+}
+
+bool led_record_decode(uint32_t const *words,
+                       uint16_t length_words,
+                       led_params_t *params,
+                       bool *migrated)
+{
+    led_record_header_t const *header = (led_record_header_t const *) words;
+    uint8_t const *payload = (uint8_t const *) (header + 1);
+
+    if (length_words == LED_RECORD_V1_WORDS)
+    {
+        *migrated = true;
+        return led_record_migrate(1, (uint8_t const *) words, sizeof(uint32_t), params);
+    }
+
+    if (length_words * sizeof(uint32_t) < sizeof(led_record_header_t) + header->length)
+    {
+        NRF_LOG_WARNING("Truncated LED record");
+        return false;
+    }
+
+    if (header->crc != led_record_crc(header, payload))
+    {
+        NRF_LOG_WARNING("LED record CRC mismatch");
+        return false;
+    }
+
+    if (header->version == LED_RECORD_VERSION && header->length == sizeof(led_params_t))
+    {
+        /* Hot path: the record already has the current layout */
+        *migrated = false;
+        memcpy(params, payload, sizeof(led_params_t));
+        return true;
+    }
+
+    *migrated = true;
+
+    return led_record_migrate(header->version, payload, header->length, params);
+}
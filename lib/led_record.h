@@ -0,0 +1,46 @@
+#ifndef LED_RECORD_H
+#define LED_RECORD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "app_util.h"
+
+#include "led_common.h"
+
+/* Bump when led_params_t changes and add the previous layout
+ * to the migration table in led_record.c */
+#define LED_RECORD_VERSION 3
+
+typedef struct {
+    uint8_t version;
+    uint8_t length;   /* payload bytes following the header */
+    uint16_t crc;     /* CRC16 over version, length and payload */
+} led_record_header_t;
+
+typedef struct {
+    led_record_header_t header;
+    led_params_t params;
+} led_record_t;
+
+#define LED_RECORD_WORDS BYTES_TO_WORDS(sizeof(led_record_t))
+
+/* Fill a record buffer of LED_RECORD_WORDS words */
+void led_record_encode(uint32_t *words, led_params_t const *params);
+
+/* Decode a record straight from flash. Records of an older version are
+ * upgraded and reported through migrated, so the caller can rewrite them */
+bool led_record_decode(uint32_t const *words,
+                       uint16_t length_words,
+                       led_params_t *params,
+                       bool *migrated);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LED_RECORD_H */
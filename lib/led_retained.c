@@ -0,0 +1,59 @@
+#include "led_retained.h"
+
+#include "nrf.h"
+#include "crc16.h"
+
+#include "nrf_log.h"
+
+/* Changed with every layout of led_params_t ("LEDR" before brightness) */
+#define LED_RETAINED_MAGIC 0x4C454433 /* "LED3" */
+
+typedef struct {
+    uint32_t magic;
+    led_params_t params;
+    uint16_t crc;
+} led_retained_t;
+
+/* Placed outside .bss (see gcc_nrf52.ld), so it keeps its value over a reset */
+static led_retained_t m_retained __attribute__((section(".led_retained")));
+
+static uint16_t retained_crc(void)
+{
+    return crc16_compute((uint8_t const *) &m_retained.params, sizeof(led_params_t), NULL);
+}
+
+bool led_retained_load(led_params_t *params)
+{
+    uint32_t reset_reason = NRF_POWER->RESETREAS;
+
+    /* The register is sticky, clear what has been read */
+    NRF_POWER->RESETREAS = reset_reason;
+
+    if (reset_reason == 0)
+    {
+        /* Power-on or brown-out reset, RAM content is undefined */
+        m_retained.magic = 0;
+
+        NRF_LOG_INFO("Cold boot, LED state comes from flash");
+        return false;
+    }
+
+    if (m_retained.magic != LED_RETAINED_MAGIC || m_retained.crc != retained_crc())
+    {
+        NRF_LOG_INFO("No retained LED state (reset reason 0x%08X)", reset_reason);
+        return false;
+    }
+
+    *params = m_retained.params;
+
+    NRF_LOG_INFO("Retained LED state survived reset (reset reason 0x%08X)", reset_reason);
+
+    return true;
+}
+
+void led_retained_store(led_params_t const *params)
+{
+    m_retained.params = *params;
+    m_retained.crc = retained_crc();
+    m_retained.magic = LED_RETAINED_MAGIC;
+}
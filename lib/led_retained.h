@@ -0,0 +1,26 @@
+#ifndef LED_RETAINED_H
+#define LED_RETAINED_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "led_common.h"
+
+/* Mirror of the LED state in RAM that is not cleared by the startup code,
+ * so it survives soft, watchdog and pin resets (but not a power cycle) */
+
+/* Returns true and fills params if the mirror survived the last reset.
+ * Must be called before the SoftDevice is enabled, as it reads RESETREAS */
+bool led_retained_load(led_params_t *params);
+
+void led_retained_store(led_params_t const *params);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LED_RETAINED_H */
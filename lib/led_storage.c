@@ -0,0 +1,1091 @@
+#include "led_storage.h"
+
+#include <string.h>
+
+#include "sdk_config.h"
+#include "app_timer.h"
+#include "app_util.h"
+
+#include "nrf_log.h"
+
+#include "fds.h"
+#include "fds_internal_defs.h"
+
+#include "led_record.h"
+#include "event_loop.h"
+#include "cpu_usage.h"
+
+#if LED_STORAGE_JOURNAL_ENABLED
+#include "led_journal.h"
+#endif
+
+#define ESTC_BLE_SERVICE_LED_SAVES_FILE_ID 0xBEEF
+#define ESTC_BLE_SERVICE_LED_SAVES_RECORD_KEY 0xBABE
+
+/* Erase counters survive resets in a separate file, so wiping the saves keeps them */
+#define LED_STORAGE_WEAR_FILE_ID 0xBEF0
+#define LED_STORAGE_WEAR_RECORD_KEY 0x0001
+
+/* Guaranteed erase cycles of the nRF52840 flash */
+#define LED_STORAGE_FLASH_ENDURANCE_CYCLES 10000
+
+#define LED_STORAGE_NO_PAGE 0xFF
+
+/* Garbage collection erases pages and competes with the SoftDevice for flash
+ * timeslots, so it waits until no link is open or the state has not changed
+ * for LED_STORAGE_GC_IDLE_MS. Only running short of free space forces it.
+ * The thresholds come from led_storage_sizing.h (tools/fds_sim/fds_size.sh). */
+#define LED_STORAGE_GC_IDLE_MS 5000
+
+#define LED_STORAGE_FDS_DATA_WORDS ((uint32_t) FDS_DATA_PAGES * FDS_PAGE_SIZE)
+
+/* A write FDS reports as failed is queued again this many times */
+#define LED_STORAGE_WRITE_RETRIES 3
+
+APP_TIMER_DEF(led_storage_gc_timer);
+
+/* The state is flushed once it has not changed for LED_STORAGE_FLUSH_QUIET_MS,
+ * but never later than LED_STORAGE_FLUSH_MAX_DELAY_MS after the first change */
+#define LED_STORAGE_FLUSH_QUIET_MS 1000
+#define LED_STORAGE_FLUSH_MAX_DELAY_MS 10000
+
+APP_TIMER_DEF(led_storage_flush_timer);
+
+/* FDS keeps a pointer to the record data until the write completes,
+ * so every queued operation gets its own snapshot of the state */
+#define LED_STORAGE_STAGING_BUFFERS FDS_OP_QUEUE_SIZE
+
+typedef struct {
+    uint32_t data[LED_RECORD_WORDS];
+    uint32_t record_id;
+    uint8_t dirty_page; /* page of the record replaced by this write */
+    bool in_use;
+} led_storage_staging_t;
+
+static led_storage_staging_t m_staging[LED_STORAGE_STAGING_BUFFERS];
+
+/* The pending state waits for an FDS operation to complete
+ * (a free queue slot, a staging buffer or garbage collection) */
+static bool m_flush_deferred;
+static uint8_t m_write_retries;
+
+static led_storage_load_handler_t m_load_handler;
+
+static led_params_t m_pending;
+static led_params_t m_persisted;
+static bool m_persisted_valid;
+static bool m_dirty;
+static bool m_flush_timer_active;
+
+static uint32_t m_first_change_ticks;
+static uint32_t m_last_change_ticks;
+
+static bool m_link_connected;
+static bool m_gc_timer_active;
+static bool m_gc_in_progress;
+
+static led_storage_stats_t m_stats;
+
+static led_storage_health_handler_t m_health_handler;
+static led_storage_health_t m_health;
+
+/* Pages holding records invalidated since the last garbage collection */
+static bool m_gc_dirty_pages[FDS_PHY_PAGES];
+static uint8_t m_deleted_page = LED_STORAGE_NO_PAGE;
+static uint32_t m_erases_since_boot;
+
+static led_storage_wipe_stage_t m_wipe_stage = LED_STORAGE_WIPE_IDLE;
+static led_storage_wipe_handler_t m_wipe_handler;
+static bool m_wipe_delete_queued;
+
+static uint32_t m_wear_record[FDS_PHY_PAGES];
+static bool m_wear_write_in_flight;
+static bool m_wear_save_pending;
+
+static uint8_t fds_page_index(uint32_t const *p_record)
+{
+    /* FDS pages are contiguous, so the physical page number modulo
+     * the page count tells them apart without knowing the region start */
+    return ((uintptr_t) p_record / (FDS_PHY_PAGE_SIZE * sizeof(uint32_t))) % FDS_PHY_PAGES;
+}
+
+static void health_load_stat(void)
+{
+    fds_stat_t stat;
+
+    if (NRF_SUCCESS != fds_stat(&stat))
+    {
+        NRF_LOG_INFO("Unable to retrieve file system statistics");
+        return;
+    }
+
+    m_health.valid_records = stat.valid_records;
+    m_health.dirty_records = stat.dirty_records;
+    m_health.words_used = stat.words_used;
+    m_health.freeable_words = stat.freeable_words;
+}
+
+static void health_update(void)
+{
+    uint16_t max_erases = 0;
+    uint32_t cycles_left;
+    int i;
+
+    for (i = 0; i < FDS_PHY_PAGES; i++)
+    {
+        max_erases = MAX(max_erases, m_health.page_erases[i]);
+    }
+
+    cycles_left = LED_STORAGE_FLASH_ENDURANCE_CYCLES - MIN(max_erases, LED_STORAGE_FLASH_ENDURANCE_CYCLES);
+
+    m_health.lifetime_left_pct = cycles_left * 100 / LED_STORAGE_FLASH_ENDURANCE_CYCLES;
+
+    if (m_erases_since_boot == 0)
+    {
+        m_health.saves_left_estimate = UINT32_MAX;
+    }
+    else
+    {
+        /* Assume the rest of the lifetime sees the same saves per erase as this session */
+        uint64_t saves_left = (uint64_t) cycles_left * m_stats.writes_saved / m_erases_since_boot;
+
+        m_health.saves_left_estimate = MIN(saves_left, UINT32_MAX);
+    }
+
+    if (m_health_handler != NULL)
+    {
+        m_health_handler(&m_health);
+    }
+}
+
+static void wear_record_save(void)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_record_t record;
+    ret_code_t ret_code;
+    int i;
+
+    if (m_wear_write_in_flight)
+    {
+        /* The counters are written again after the next garbage collection */
+        return;
+    }
+
+    for (i = 0; i < FDS_PHY_PAGES; i++)
+    {
+        m_wear_record[i] = m_health.page_erases[i];
+    }
+
+    memset(&record_token, 0, sizeof(fds_find_token_t));
+
+    record.file_id = LED_STORAGE_WEAR_FILE_ID;
+    record.key = LED_STORAGE_WEAR_RECORD_KEY;
+    record.data.p_data = m_wear_record;
+    record.data.length_words = ARRAY_SIZE(m_wear_record);
+
+    if (NRF_SUCCESS == fds_record_find(LED_STORAGE_WEAR_FILE_ID,
+                                       LED_STORAGE_WEAR_RECORD_KEY,
+                                       &record_desc,
+                                       &record_token))
+    {
+        m_gc_dirty_pages[fds_page_index(record_desc.p_record)] = true;
+        ret_code = fds_record_update(&record_desc, &record);
+    }
+    else
+    {
+        ret_code = fds_record_write(&record_desc, &record);
+    }
+
+    m_wear_write_in_flight = (ret_code == NRF_SUCCESS);
+    m_wear_save_pending = (ret_code == FDS_ERR_NO_SPACE_IN_QUEUES);
+}
+
+static void wear_record_load(void)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_flash_record_t flash_record;
+    int i;
+
+    memset(&record_token, 0, sizeof(fds_find_token_t));
+
+    if (NRF_SUCCESS != fds_record_find(LED_STORAGE_WEAR_FILE_ID,
+                                       LED_STORAGE_WEAR_RECORD_KEY,
+                                       &record_desc,
+                                       &record_token))
+    {
+        return;
+    }
+
+    if (NRF_SUCCESS == fds_record_open(&record_desc, &flash_record))
+    {
+        uint32_t const *counters = flash_record.p_data;
+        uint16_t length = flash_record.p_header->length_words;
+
+        for (i = 0; i < MIN(length, FDS_PHY_PAGES); i++)
+        {
+            m_health.page_erases[i] = counters[i];
+        }
+
+        fds_record_close(&record_desc);
+    }
+}
+
+static void display_storage_state(void)
+{
+    NRF_LOG_INFO("\e[32mFDS stat\e[0m: %d valid record, %d dirty records, %d words used, %d words freeable",
+                 m_health.valid_records,
+                 m_health.dirty_records,
+                 m_health.words_used,
+                 m_health.freeable_words);
+}
+
+/* Returns true if garbage collection is queued or running */
+static bool gc_start(void)
+{
+    ret_code_t ret_code;
+
+    if (m_gc_in_progress)
+    {
+        return true;
+    }
+
+    ret_code = fds_gc();
+
+    switch (ret_code)
+    {
+        case NRF_SUCCESS:
+            m_gc_in_progress = true;
+            NRF_LOG_INFO("Trigger garbage collection");
+            break;
+
+        default:
+            NRF_LOG_WARNING("Unable to trigger garbage collection!");
+            break;
+    }
+
+    return m_gc_in_progress;
+}
+
+static uint32_t fds_free_words(void)
+{
+    return LED_STORAGE_FDS_DATA_WORDS - MIN(m_health.words_used, LED_STORAGE_FDS_DATA_WORDS);
+}
+
+static bool gc_link_is_busy(void)
+{
+    uint32_t idle = app_timer_cnt_diff_compute(app_timer_cnt_get(), m_last_change_ticks);
+
+    return m_link_connected &&
+           (m_dirty || idle < APP_TIMER_TICKS(LED_STORAGE_GC_IDLE_MS));
+}
+
+static void gc_schedule(void)
+{
+    if (m_health.freeable_words == 0 || m_gc_in_progress)
+    {
+        return;
+    }
+
+    if (fds_free_words() < LED_STORAGE_GC_FREE_WORDS_FLOOR)
+    {
+        NRF_LOG_INFO("Running out of flash, garbage collection can not wait");
+        gc_start();
+        return;
+    }
+
+    if (m_health.freeable_words <= LED_STORAGE_GC_FREEABLE_LIMIT_WORDS)
+    {
+        return;
+    }
+
+    if (!gc_link_is_busy())
+    {
+        gc_start();
+    }
+    else if (!m_gc_timer_active)
+    {
+        m_gc_timer_active = (NRF_SUCCESS == app_timer_start(led_storage_gc_timer,
+                                                            APP_TIMER_TICKS(LED_STORAGE_GC_IDLE_MS),
+                                                            NULL));
+    }
+}
+
+static void led_storage_gc_run(void *p_event_data, uint16_t event_size)
+{
+    cpu_usage_subsystem_t cpu = cpu_usage_enter(CPU_USAGE_FDS);
+    uint32_t idle = app_timer_cnt_diff_compute(app_timer_cnt_get(), m_last_change_ticks);
+
+    m_gc_timer_active = false;
+
+    if (gc_link_is_busy() && !m_dirty)
+    {
+        /* Wait for the rest of the idle period */
+        uint32_t rest = MAX(APP_TIMER_TICKS(LED_STORAGE_GC_IDLE_MS) - idle,
+                            APP_TIMER_MIN_TIMEOUT_TICKS);
+
+        m_gc_timer_active = (NRF_SUCCESS == app_timer_start(led_storage_gc_timer, rest, NULL));
+
+        if (m_gc_timer_active)
+        {
+            cpu_usage_exit(cpu);
+            return;
+        }
+
+        NRF_LOG_WARNING("Unable to re-arm the garbage collection timer");
+    }
+
+    gc_schedule();
+
+    cpu_usage_exit(cpu);
+}
+
+EVENT_LOOP_WORK_DEF(led_storage_gc_work, led_storage_gc_run);
+
+static void led_storage_gc_timer_handler(void *ctx)
+{
+    event_loop_defer(&led_storage_gc_work);
+}
+
+static void staging_release(led_storage_staging_t *staging)
+{
+    staging->in_use = false;
+    m_stats.writes_in_flight--;
+}
+
+static led_storage_staging_t * staging_find(uint32_t record_id)
+{
+    int i;
+
+    for (i = 0; i < LED_STORAGE_STAGING_BUFFERS; i++)
+    {
+        if (m_staging[i].in_use && m_staging[i].record_id == record_id)
+        {
+            return &m_staging[i];
+        }
+    }
+
+    return NULL;
+}
+
+#if !LED_STORAGE_JOURNAL_ENABLED
+static led_storage_staging_t * staging_acquire(void)
+{
+    int i;
+
+    for (i = 0; i < LED_STORAGE_STAGING_BUFFERS; i++)
+    {
+        if (!m_staging[i].in_use)
+        {
+            m_staging[i].in_use = true;
+            m_stats.writes_in_flight++;
+
+            return &m_staging[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns false if the write has to be retried later */
+static bool led_save_state(void)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_record_t record;
+    led_storage_staging_t *staging;
+
+    ret_code_t ret_code;
+
+    staging = staging_acquire();
+
+    if (staging == NULL)
+    {
+        NRF_LOG_INFO("All staging buffers are busy, postpone saving");
+        return false;
+    }
+
+    led_record_encode(staging->data, &m_pending);
+
+    memset(&record_token, 0, sizeof(fds_find_token_t));
+
+    record.file_id = ESTC_BLE_SERVICE_LED_SAVES_FILE_ID;
+    record.key = ESTC_BLE_SERVICE_LED_SAVES_RECORD_KEY;
+    record.data.p_data = staging->data;
+    record.data.length_words = ARRAY_SIZE(staging->data);
+
+    if (NRF_SUCCESS == fds_record_find(ESTC_BLE_SERVICE_LED_SAVES_FILE_ID,
+                                       ESTC_BLE_SERVICE_LED_SAVES_RECORD_KEY,
+                                       &record_desc,
+                                       &record_token))
+    {
+        staging->dirty_page = fds_page_index(record_desc.p_record);
+        ret_code = fds_record_update(&record_desc, &record);
+    }
+    else
+    {
+        staging->dirty_page = LED_STORAGE_NO_PAGE;
+        ret_code = fds_record_write(&record_desc, &record);
+    }
+
+    if (ret_code == NRF_SUCCESS)
+    {
+        staging->record_id = record_desc.record_id;
+
+        m_persisted = m_pending;
+        m_persisted_valid = true;
+        m_stats.writes_saved++;
+
+        NRF_LOG_INFO("LED parameters saved to flash memory (%d saved, %d skipped)",
+                     m_stats.writes_saved,
+                     m_stats.writes_skipped);
+
+        display_storage_state();
+
+        return true;
+    }
+
+    staging_release(staging);
+
+    switch (ret_code)
+    {
+        case FDS_ERR_NO_SPACE_IN_QUEUES:
+            NRF_LOG_INFO("FDS queue is full, postpone saving");
+            m_stats.writes_retried++;
+            return false;
+
+        case FDS_ERR_NO_SPACE_IN_FLASH:
+            if (m_gc_in_progress || m_health.freeable_words > 0)
+            {
+                /* Garbage collection first, the write follows its completion */
+                NRF_LOG_INFO("No space in flash, save after garbage collection");
+                m_stats.writes_retried++;
+                gc_start();
+                return false;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    m_health.write_failures++;
+    health_update();
+
+    NRF_LOG_WARNING("Unable to save LED parameters (0x%04X)", ret_code);
+
+    return true;
+}
+#else
+/* Returns false if the write has to be retried later */
+static bool led_journal_save_state(void)
+{
+    ret_code_t ret_code = led_journal_append(&m_pending);
+
+    switch (ret_code)
+    {
+        case NRF_SUCCESS:
+            m_persisted = m_pending;
+            m_persisted_valid = true;
+            m_stats.writes_saved++;
+
+            NRF_LOG_INFO("LED parameters appended to journal (%d saved, %d skipped)",
+                         m_stats.writes_saved,
+                         m_stats.writes_skipped);
+            break;
+
+        case NRF_ERROR_BUSY:
+            return false;
+
+        case NRF_ERROR_NO_MEM:
+            /* The fstorage queue is shared with FDS and full */
+            NRF_LOG_INFO("fstorage queue is full, postpone saving");
+            m_stats.writes_retried++;
+            return false;
+
+        default:
+            m_health.write_failures++;
+            health_update();
+
+            NRF_LOG_WARNING("Unable to append LED parameters to journal (0x%04X)", ret_code);
+            break;
+    }
+
+    return true;
+}
+#endif
+
+static bool wipe_in_progress(void)
+{
+    return m_wipe_stage == LED_STORAGE_WIPE_DELETING ||
+           m_wipe_stage == LED_STORAGE_WIPE_COLLECTING;
+}
+
+static void led_storage_flush(void)
+{
+    if (!m_dirty)
+    {
+        return;
+    }
+
+    if (wipe_in_progress())
+    {
+        /* A write now could land in the file being deleted */
+        m_flush_deferred = true;
+        return;
+    }
+
+    if (m_persisted_valid &&
+        0 == memcmp(&m_pending, &m_persisted, sizeof(led_params_t)))
+    {
+        m_dirty = false;
+        m_stats.writes_skipped++;
+        return;
+    }
+
+#if LED_STORAGE_JOURNAL_ENABLED
+    if (led_journal_save_state())
+#else
+    if (led_save_state())
+#endif
+    {
+        m_dirty = false;
+    }
+    else
+    {
+        m_flush_deferred = true;
+    }
+}
+
+static void led_storage_flush_run(void *p_event_data, uint16_t event_size)
+{
+    cpu_usage_subsystem_t cpu = cpu_usage_enter(CPU_USAGE_FDS);
+    uint32_t now = app_timer_cnt_get();
+    uint32_t quiet = app_timer_cnt_diff_compute(now, m_last_change_ticks);
+    uint32_t waited = app_timer_cnt_diff_compute(now, m_first_change_ticks);
+
+    if (m_dirty &&
+        quiet < APP_TIMER_TICKS(LED_STORAGE_FLUSH_QUIET_MS) &&
+        waited < APP_TIMER_TICKS(LED_STORAGE_FLUSH_MAX_DELAY_MS))
+    {
+        /* Still changing: re-arm for the rest of the quiet period,
+         * app_timer rejects a timeout shorter than its minimum */
+        uint32_t rest = MAX(APP_TIMER_TICKS(LED_STORAGE_FLUSH_QUIET_MS) - quiet,
+                            APP_TIMER_MIN_TIMEOUT_TICKS);
+
+        if (NRF_SUCCESS == app_timer_start(led_storage_flush_timer, rest, NULL))
+        {
+            cpu_usage_exit(cpu);
+            return;
+        }
+
+        NRF_LOG_WARNING("Unable to re-arm the flush timer, flushing now");
+    }
+
+    m_flush_timer_active = false;
+    led_storage_flush();
+
+    cpu_usage_exit(cpu);
+}
+
+/* Encoding and writing the record is left to the main loop */
+EVENT_LOOP_WORK_DEF(led_storage_flush_work, led_storage_flush_run);
+
+static void led_storage_flush_timer_handler(void *ctx)
+{
+    event_loop_defer(&led_storage_flush_work);
+}
+
+void led_storage_mark_dirty(led_params_t const *params)
+{
+    uint32_t now = app_timer_cnt_get();
+
+    m_stats.writes_requested++;
+
+    if (m_dirty)
+    {
+        /* The previous pending state never reaches flash */
+        m_stats.writes_skipped++;
+    }
+    else
+    {
+        m_first_change_ticks = now;
+    }
+
+    m_pending = *params;
+    m_last_change_ticks = now;
+    m_dirty = true;
+
+    if (!m_flush_timer_active)
+    {
+        m_flush_timer_active = (NRF_SUCCESS == app_timer_start(led_storage_flush_timer,
+                                                               APP_TIMER_TICKS(LED_STORAGE_FLUSH_QUIET_MS),
+                                                               NULL));
+
+        if (!m_flush_timer_active)
+        {
+            /* Nothing would ever flush the change, better write it uncoalesced */
+            NRF_LOG_WARNING("Unable to start the flush timer, flushing now");
+            led_storage_flush();
+        }
+    }
+}
+
+void led_storage_commit(void)
+{
+    if (m_flush_timer_active)
+    {
+        app_timer_stop(led_storage_flush_timer);
+        m_flush_timer_active = false;
+    }
+
+    led_storage_flush();
+}
+
+void led_storage_link_state_set(bool connected)
+{
+    m_link_connected = connected;
+
+    if (!connected)
+    {
+        /* A good moment to catch up with a postponed garbage collection */
+        gc_schedule();
+    }
+}
+
+bool led_storage_busy(void)
+{
+    if (m_dirty || m_flush_deferred || m_stats.writes_in_flight > 0 ||
+        m_gc_in_progress || m_wear_write_in_flight || wipe_in_progress())
+    {
+        return true;
+    }
+
+#if LED_STORAGE_JOURNAL_ENABLED
+    return led_journal_busy();
+#else
+    return false;
+#endif
+}
+
+void led_storage_stats_get(led_storage_stats_t *stats)
+{
+    *stats = m_stats;
+}
+
+void led_storage_health_get(led_storage_health_t *health)
+{
+    *health = m_health;
+}
+
+static void wipe_stage_set(led_storage_wipe_stage_t stage)
+{
+    m_wipe_stage = stage;
+
+    if (m_wipe_handler != NULL)
+    {
+        m_wipe_handler(stage);
+    }
+
+    if (stage == LED_STORAGE_WIPE_DONE || stage == LED_STORAGE_WIPE_FAILED)
+    {
+        /* The change that was pending before or came during the wipe */
+        led_storage_flush();
+    }
+}
+
+/* Issue the FDS request of the current stage, again if FDS was busy */
+static void wipe_step(void)
+{
+    ret_code_t ret_code;
+
+    switch (m_wipe_stage)
+    {
+        case LED_STORAGE_WIPE_DELETING:
+            if (m_wipe_delete_queued)
+            {
+                return;
+            }
+
+            ret_code = fds_file_delete(ESTC_BLE_SERVICE_LED_SAVES_FILE_ID);
+
+            if (ret_code == NRF_SUCCESS)
+            {
+                m_wipe_delete_queued = true;
+            }
+            else if (ret_code != FDS_ERR_NO_SPACE_IN_QUEUES)
+            {
+                NRF_LOG_WARNING("Unable to delete saves (0x%04X)", ret_code);
+                wipe_stage_set(LED_STORAGE_WIPE_FAILED);
+            }
+            break;
+
+        case LED_STORAGE_WIPE_COLLECTING:
+            /* Not waiting for the link to go idle: the user asked for it */
+            gc_start();
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void wipe_on_del_file(fds_evt_t const * p_evt)
+{
+    if (m_wipe_stage != LED_STORAGE_WIPE_DELETING)
+    {
+        return;
+    }
+
+    m_wipe_delete_queued = false;
+
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Deleting saves failed (0x%04X)", p_evt->result);
+        wipe_stage_set(LED_STORAGE_WIPE_FAILED);
+        return;
+    }
+
+    wipe_stage_set(LED_STORAGE_WIPE_COLLECTING);
+    wipe_step();
+}
+
+static void wipe_on_gc(fds_evt_t const * p_evt)
+{
+    if (m_wipe_stage != LED_STORAGE_WIPE_COLLECTING)
+    {
+        return;
+    }
+
+    /* A failed collection still leaves the records deleted */
+    if (p_evt->result != NRF_SUCCESS)
+    {
+        NRF_LOG_WARNING("Garbage collection after wipe failed (0x%04X)", p_evt->result);
+    }
+
+    wipe_stage_set(LED_STORAGE_WIPE_DONE);
+}
+
+static void led_storage_on_backend_ready(void)
+{
+    wipe_step();
+
+    if (m_wear_save_pending)
+    {
+        m_wear_save_pending = false;
+        wear_record_save();
+    }
+
+    if (m_flush_deferred)
+    {
+        m_flush_deferred = false;
+        led_storage_flush();
+    }
+}
+
+static void fds_on_init(void)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_flash_record_t flash_record;
+    bool migrated = false;
+    bool loaded;
+
+    health_load_stat();
+    wear_record_load();
+    health_update();
+
+#if LED_STORAGE_JOURNAL_ENABLED
+    if (led_journal_load(&m_persisted))
+    {
+        m_persisted_valid = true;
+
+        NRF_LOG_INFO("Read LED parameters from journal");
+
+        m_load_handler(&m_persisted);
+        return;
+    }
+
+    /* Fall back to the record saved before the journal was enabled */
+#endif
+
+    memset(&record_token, 0, sizeof(fds_find_token_t));
+
+    if (NRF_SUCCESS == fds_record_find(ESTC_BLE_SERVICE_LED_SAVES_FILE_ID,
+                                       ESTC_BLE_SERVICE_LED_SAVES_RECORD_KEY,
+                                       &record_desc,
+                                       &record_token))
+    {
+        if (NRF_SUCCESS == fds_record_open(&record_desc, &flash_record))
+        {
+            /* Decoded in place, the record is not copied out of flash first */
+            m_persisted_valid = led_record_decode(flash_record.p_data,
+                                                  flash_record.p_header->length_words,
+                                                  &m_persisted,
+                                                  &migrated);
+            fds_record_close(&record_desc);
+
+            NRF_LOG_INFO("Read LED parameters from flash memory");
+        }
+    }
+
+    loaded = m_persisted_valid;
+
+    if (loaded && migrated)
+    {
+        /* Rewrite the record in the current format with the next flush */
+        NRF_LOG_INFO("LED record is upgraded to version %d", LED_RECORD_VERSION);
+
+        m_persisted_valid = false;
+        led_storage_mark_dirty(&m_persisted);
+    }
+
+    m_load_handler(loaded ? &m_persisted : NULL);
+}
+
+static void fds_on_write_failed(ret_code_t result)
+{
+    if (m_dirty)
+    {
+        /* A newer state is pending anyway and replaces the lost one */
+        return;
+    }
+
+    if (m_write_retries >= LED_STORAGE_WRITE_RETRIES)
+    {
+        NRF_LOG_WARNING("Giving up saving LED parameters");
+        return;
+    }
+
+    /* m_pending still holds the state of the failed write */
+    m_write_retries++;
+    m_stats.writes_retried++;
+    m_dirty = true;
+    m_flush_deferred = true;
+
+    if (result == FDS_ERR_NO_SPACE_IN_FLASH)
+    {
+        gc_start();
+    }
+}
+
+static void fds_on_write_done(fds_evt_t const * p_evt)
+{
+    led_storage_staging_t *staging;
+    uint16_t record_words;
+
+    if (p_evt->write.file_id == LED_STORAGE_WEAR_FILE_ID)
+    {
+        m_wear_write_in_flight = false;
+        health_load_stat();
+        return;
+    }
+
+    if (p_evt->write.file_id != ESTC_BLE_SERVICE_LED_SAVES_FILE_ID)
+    {
+        /* Someone else (e.g. Peer Manager) changed the file system */
+        health_load_stat();
+        health_update();
+        return;
+    }
+
+    staging = staging_find(p_evt->write.record_id);
+
+    if (p_evt->result == NRF_SUCCESS)
+    {
+        record_words = FDS_HEADER_SIZE + ARRAY_SIZE(m_staging[0].data);
+
+        m_health.words_used += record_words;
+
+        if (p_evt->id == FDS_EVT_UPDATE)
+        {
+            m_health.dirty_records++;
+            m_health.freeable_words += record_words;
+        }
+        else
+        {
+            m_health.valid_records++;
+        }
+
+        if (staging != NULL && staging->dirty_page != LED_STORAGE_NO_PAGE)
+        {
+            m_gc_dirty_pages[staging->dirty_page] = true;
+        }
+
+        m_write_retries = 0;
+    }
+    else
+    {
+        /* Make sure the same state is not skipped as already saved */
+        m_persisted_valid = false;
+        m_health.write_failures++;
+        NRF_LOG_WARNING("Saving LED parameters failed (0x%04X)", p_evt->result);
+
+        fds_on_write_failed(p_evt->result);
+    }
+
+    if (staging != NULL)
+    {
+        staging_release(staging);
+    }
+
+    health_update();
+    gc_schedule();
+}
+
+static void fds_on_gc(void)
+{
+    int i;
+
+    for (i = 0; i < FDS_PHY_PAGES; i++)
+    {
+        if (m_gc_dirty_pages[i])
+        {
+            m_gc_dirty_pages[i] = false;
+            m_health.page_erases[i]++;
+            m_erases_since_boot++;
+        }
+    }
+
+    m_health.gc_runs++;
+    m_gc_in_progress = false;
+
+    /* Garbage collection rearranges everything, start counting from scratch */
+    health_load_stat();
+    health_update();
+    wear_record_save();
+}
+
+static void fds_events_handler(fds_evt_t const * p_evt)
+{
+    cpu_usage_subsystem_t cpu = cpu_usage_enter(CPU_USAGE_FDS);
+
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            fds_on_init();
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            fds_on_write_done(p_evt);
+            break;
+
+        case FDS_EVT_GC:
+            NRF_LOG_INFO("Garbage collection is done");
+            fds_on_gc();
+            wipe_on_gc(p_evt);
+            display_storage_state();
+            break;
+
+        case FDS_EVT_DEL_FILE:
+            if (p_evt->del.file_id == ESTC_BLE_SERVICE_LED_SAVES_FILE_ID &&
+                m_deleted_page != LED_STORAGE_NO_PAGE)
+            {
+                m_gc_dirty_pages[m_deleted_page] = true;
+                m_deleted_page = LED_STORAGE_NO_PAGE;
+            }
+
+            health_load_stat();
+            health_update();
+
+            if (p_evt->del.file_id == ESTC_BLE_SERVICE_LED_SAVES_FILE_ID)
+            {
+                NRF_LOG_INFO("Saves are deleted");
+                wipe_on_del_file(p_evt);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    /* Any completed operation frees a queue slot for what had to wait */
+    led_storage_on_backend_ready();
+
+    cpu_usage_exit(cpu);
+}
+
+ret_code_t led_storage_clean(led_storage_wipe_handler_t progress_handler)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+
+    if (wipe_in_progress())
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+#if LED_STORAGE_JOURNAL_ENABLED
+    {
+        ret_code_t ret_code = led_journal_clean();
+
+        if (ret_code != NRF_SUCCESS)
+        {
+            return ret_code;
+        }
+    }
+#endif
+
+    /* A pending change is not written into the file about to be deleted,
+     * it stays pending and is flushed when the wipe is over */
+    if (m_flush_timer_active)
+    {
+        app_timer_stop(led_storage_flush_timer);
+        m_flush_timer_active = false;
+    }
+
+    m_flush_deferred = false;
+    m_write_retries = 0;
+    m_persisted_valid = false;
+
+    memset(&record_token, 0, sizeof(fds_find_token_t));
+
+    if (NRF_SUCCESS == fds_record_find(ESTC_BLE_SERVICE_LED_SAVES_FILE_ID,
+                                       ESTC_BLE_SERVICE_LED_SAVES_RECORD_KEY,
+                                       &record_desc,
+                                       &record_token))
+    {
+        m_deleted_page = fds_page_index(record_desc.p_record);
+    }
+
+    /* Writes queued before this point are deleted along with the file,
+     * as FDS executes its queue in order */
+    m_wipe_handler = progress_handler;
+    m_wipe_delete_queued = false;
+    wipe_stage_set(LED_STORAGE_WIPE_DELETING);
+    wipe_step();
+
+    return (m_wipe_stage == LED_STORAGE_WIPE_FAILED) ? NRF_ERROR_INTERNAL : NRF_SUCCESS;
+}
+
+ret_code_t led_storage_init(led_storage_load_handler_t load_handler,
+                            led_storage_health_handler_t health_handler)
+{
+    m_load_handler = load_handler;
+    m_health_handler = health_handler;
+
+#if LED_STORAGE_JOURNAL_ENABLED
+    {
+        ret_code_t ret_code = led_journal_init(led_storage_on_backend_ready);
+
+        if (ret_code != NRF_SUCCESS)
+        {
+            return ret_code;
+        }
+    }
+#endif
+
+    app_timer_create(&led_storage_flush_timer,
+                     APP_TIMER_MODE_SINGLE_SHOT,
+                     led_storage_flush_timer_handler);
+
+    app_timer_create(&led_storage_gc_timer,
+                     APP_TIMER_MODE_SINGLE_SHOT,
+                     led_storage_gc_timer_handler);
+
+    fds_register(fds_events_handler);
+
+    return fds_init();
+}
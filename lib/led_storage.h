@@ -0,0 +1,83 @@
+#ifndef LED_STORAGE_H
+#define LED_STORAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+#include "fds_internal_defs.h"
+
+#include "led_common.h"
+
+/* Called once the storage is ready, params is NULL if nothing was saved yet */
+typedef void (*led_storage_load_handler_t)(led_params_t const *params);
+
+typedef struct {
+    uint32_t writes_requested; /* state changes reported via led_storage_mark_dirty */
+    uint32_t writes_saved;     /* records actually written to flash */
+    uint32_t writes_skipped;   /* changes coalesced or identical to the persisted value */
+    uint32_t writes_in_flight; /* writes queued in FDS and not completed yet */
+    uint32_t writes_retried;   /* writes queued again after FDS was busy, full or failed */
+} led_storage_stats_t;
+
+/* Everything before page_erases has to fit a notification at the default MTU */
+typedef struct {
+    uint32_t saves_left_estimate;   /* saves until the most worn page reaches its endurance */
+    uint16_t valid_records;
+    uint16_t dirty_records;
+    uint16_t words_used;
+    uint16_t freeable_words;
+    uint16_t gc_runs;
+    uint16_t write_failures;
+    uint16_t lifetime_left_pct;
+    uint16_t page_erases[FDS_PHY_PAGES];
+} led_storage_health_t;
+
+typedef enum {
+    LED_STORAGE_WIPE_IDLE = 0,
+    LED_STORAGE_WIPE_DELETING,   /* the saves file is being deleted */
+    LED_STORAGE_WIPE_COLLECTING, /* garbage collection reclaims the deleted records */
+    LED_STORAGE_WIPE_DONE,
+    LED_STORAGE_WIPE_FAILED
+} led_storage_wipe_stage_t;
+
+/* Called on every stage change of a wipe */
+typedef void (*led_storage_wipe_handler_t)(led_storage_wipe_stage_t stage);
+
+/* Called whenever the health counters change */
+typedef void (*led_storage_health_handler_t)(led_storage_health_t const *health);
+
+ret_code_t led_storage_init(led_storage_load_handler_t load_handler,
+                            led_storage_health_handler_t health_handler);
+
+/* Remember the new state and write it to flash once the changes settle down */
+void led_storage_mark_dirty(led_params_t const *params);
+
+/* Write the pending state right away (e.g. on disconnect) */
+void led_storage_commit(void);
+
+/* Wipe the saved state. A change still pending and the saves requested
+ * in the meantime are held back and written once the wipe is done.
+ * Returns NRF_ERROR_BUSY if a wipe is already running */
+ret_code_t led_storage_clean(led_storage_wipe_handler_t progress_handler);
+
+/* Garbage collection is postponed while a link is open and in use */
+void led_storage_link_state_set(bool connected);
+
+/* True while a change is pending or still being written, wiped or
+ * collected. Powering off now would lose it */
+bool led_storage_busy(void);
+
+void led_storage_stats_get(led_storage_stats_t *stats);
+
+void led_storage_health_get(led_storage_health_t *health);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LED_STORAGE_H */
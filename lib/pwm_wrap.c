@@ -1,5 +1,9 @@
 #include "pwm_wrap.h"
 
+/* A period at the 1 MHz base clock is 100 us, a few thousand polls of
+ * the events cover it several times over */
+#define PWM_RELOAD_WAIT_SPINS_MAX 4096
+
 bool pwm_init(pwm_wrapper_t *pwm,
               uint8_t const *channels,
               uint16_t pwm_top_value,
@@ -76,3 +80,30 @@ void pwm_set_duty_cycle(pwm_wrapper_t *pwm,
     }
 }
 
+
+bool pwm_wait_reload(pwm_wrapper_t *pwm)
+{
+    NRF_PWM_Type *p_reg = pwm->pwm->p_registers;
+    uint32_t spins = 0;
+
+    if (nrfx_pwm_is_stopped(pwm->pwm))
+    {
+        return false;
+    }
+
+    /* The looped sequence is one period long and the next period is loaded
+     * from RAM once it ends, either half of the loop may be playing */
+    nrf_pwm_event_clear(p_reg, NRF_PWM_EVENT_SEQEND0);
+    nrf_pwm_event_clear(p_reg, NRF_PWM_EVENT_SEQEND1);
+
+    while (!nrf_pwm_event_check(p_reg, NRF_PWM_EVENT_SEQEND0) &&
+           !nrf_pwm_event_check(p_reg, NRF_PWM_EVENT_SEQEND1))
+    {
+        if (++spins == PWM_RELOAD_WAIT_SPINS_MAX)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -28,6 +28,10 @@ void pwm_set_duty_cycle(pwm_wrapper_t *pwm,
                         uint8_t channel,
                         uint32_t duty_cycle);
 
+/* Busy-waits, one PWM period at most, until the duty cycles set so far
+ * have been loaded. Returns false if the PWM is not running */
+bool pwm_wait_reload(pwm_wrapper_t *pwm);
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,6 +16,7 @@
 #include "nrf_sdh_soc.h"
 #include "nrf_sdh_ble.h"
 #include "app_timer.h"
+#include "app_scheduler.h"
 #include "peer_manager.h"
 #include "peer_manager_handler.h"
 #include "bsp_btn_ble.h"
@@ -31,6 +32,10 @@
 #include "nrf_log_backend_usb.h"
 
 #include "estc_service.h"
+#include "button.h"
+#include "encoder.h"
+#include "event_loop.h"
+#include "cpu_usage.h"
 
 #define DEVICE_NAME                     "Custom LED controller"                 /**< Name of device. Will be included in the advertising data. */
 #define MANUFACTURER_NAME               "NordicSemiconductor"                   /**< Manufacturer. Will be passed to Device Information Service. */
@@ -49,6 +54,11 @@
 #define NEXT_CONN_PARAMS_UPDATE_DELAY   APP_TIMER_TICKS(30000)                  /**< Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
 #define MAX_CONN_PARAMS_UPDATE_COUNT    3                                       /**< Number of attempts before giving up the connection parameter negotiation. */
 
+#define SCHED_MAX_EVENT_DATA_SIZE       EVENT_LOOP_EVENT_DATA_SIZE              /**< Maximum size of scheduler events. */
+#define SCHED_QUEUE_SIZE                (EVENT_LOOP_WORK_MAX + \
+                                         BUTTON_SCHED_EVENTS_MAX + \
+                                         ENCODER_SCHED_EVENTS_MAX)              /**< Every producer has at most one event queued, so the queue can never overflow. */
+
 #define DEAD_BEEF                       0xDEADBEEF                              /**< Value used as error code on stack dump, can be used to identify stack location on stack unwind. */
 
 NRF_BLE_GATT_DEF(m_gatt);                                                       /**< GATT module instance. */
@@ -56,6 +66,9 @@ NRF_BLE_QWR_DEF(m_qwr);
 BLE_ADVERTISING_DEF(m_advertising);                                             /**< Advertising module instance. */
 
 static uint16_t m_conn_handle = BLE_CONN_HANDLE_INVALID;                        /**< Handle of the current connection. */
+#if SYSOFF_ON_ADV_IDLE
+static bool m_sysoff_pending;                                                   /**< Advertising timed out, power off once the LED is off. */
+#endif
 
 static ble_uuid_t m_adv_uuids[] =                                               /**< Universally unique service identifiers. */
 {
@@ -96,6 +109,18 @@ static void timers_init(void)
 
 }
 
+/**@brief Function for the Event Scheduler initialization.
+ *
+ * @details SoftDevice events, button callbacks, encoder reports and the app_timer
+ *          handlers that touch flash or BLE are queued here and run from the main loop.
+ *          None of them is ever run in an interrupt because the queue is full.
+ */
+static void scheduler_init(void)
+{
+    APP_SCHED_INIT(SCHED_MAX_EVENT_DATA_SIZE, SCHED_QUEUE_SIZE);
+    event_loop_init(SCHED_QUEUE_SIZE);
+}
+
 /**@brief Function for the GAP initialization.
  *
  * @details This function sets up all the necessary GAP (Generic Access Profile) parameters of the
@@ -243,7 +268,11 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 
         case BLE_ADV_EVT_IDLE:
             NRF_LOG_INFO("ADV Event: idle, no connectable advertising is ongoing");
-            //sleep_mode_enter();
+#if SYSOFF_ON_ADV_IDLE
+            /* Powered off from the main loop, see sysoff_check() */
+            led_storage_commit();
+            m_sysoff_pending = true;
+#endif
             break;
 
         default:
@@ -259,6 +288,7 @@ static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
 static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
 {
     ret_code_t err_code = NRF_SUCCESS;
+    cpu_usage_subsystem_t cpu = cpu_usage_enter(CPU_USAGE_BLE);
 
     switch (p_ble_evt->header.evt_id)
     {
@@ -273,6 +303,9 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
             APP_ERROR_CHECK(err_code);
 
             m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+#if SYSOFF_ON_ADV_IDLE
+            m_sysoff_pending = false;
+#endif
             err_code = nrf_ble_qwr_conn_handle_assign(&m_qwr, m_conn_handle);
             APP_ERROR_CHECK(err_code);
 
@@ -312,6 +345,8 @@ static void ble_evt_handler(ble_evt_t const * p_ble_evt, void * p_context)
     }
 
     estc_ble_service_on_ble_event(p_ble_evt, p_context);
+
+    cpu_usage_exit(cpu);
 }
 
 /**@brief Function for initializing the BLE stack.
@@ -385,17 +420,69 @@ static void power_management_init(void)
     APP_ERROR_CHECK(err_code);
 }
 
+/**@brief Function for preparing the wake-up from System OFF.
+ *
+ * @details Any button press wakes the chip up, through the DETECT signal of its pin.
+ */
+static bool shutdown_handler(nrf_pwr_mgmt_evt_t event)
+{
+    if (event == NRF_PWR_MGMT_EVT_PREPARE_WAKEUP)
+    {
+        button_wakeup_prepare();
+    }
+
+    return true;
+}
+
+NRF_PWR_MGMT_HANDLER_REGISTER(shutdown_handler, 0);
+
+#if SYSOFF_ON_ADV_IDLE
+/**@brief Function for entering System OFF once advertising has timed out.
+ *
+ * @details Runs from the main loop. A lit LED keeps the controller on, it powers off
+ *          once the LED is switched off and its state is in flash.
+ */
+static void sysoff_check(void)
+{
+    if (!m_sysoff_pending || estc_ble_service_led_is_on() || led_storage_busy())
+    {
+        return;
+    }
+
+    NRF_LOG_INFO("Entering System OFF, a button press wakes the controller");
+
+    m_sysoff_pending = false;
+    nrf_pwr_mgmt_shutdown(NRF_PWR_MGMT_SHUTDOWN_GOTO_SYSOFF);
+}
+#endif
+
 /**@brief Function for handling the idle state (main loop).
  *
  * @details If there is no pending log operation, then sleep until next the next event occurs.
  */
 static void idle_state_handle(void)
 {
-    if (NRF_LOG_PROCESS() == false)
+    cpu_usage_subsystem_t cpu;
+    bool log_pending;
+
+    event_loop_run();
+
+#if SYSOFF_ON_ADV_IDLE
+    sysoff_check();
+#endif
+
+    cpu = cpu_usage_enter(CPU_USAGE_LOG);
+    log_pending = NRF_LOG_PROCESS();
+    cpu_usage_exit(cpu);
+
+    if (log_pending == false)
     {
         nrf_pwr_mgmt_run();
     }
-	LOG_BACKEND_USB_PROCESS();
+
+    cpu = cpu_usage_enter(CPU_USAGE_LOG);
+    LOG_BACKEND_USB_PROCESS();
+    cpu_usage_exit(cpu);
 }
 
 /**@brief Clear bond information from persistent storage.
@@ -492,6 +579,7 @@ int main(void)
 {
     timers_init();
     log_init();
+    scheduler_init();
 
     estc_ble_service_deps_init();
 
@@ -0,0 +1,1039 @@
+/*
+ * Button state machine harness: runs lib/button.c on the virtual clock and
+ * app_timer of ../fds_sim/sim.c, with fake GPIO, GPIOTE and app_scheduler,
+ * feeds it press traces with contact bounce and checks the click and hold
+ * callbacks and their timing.
+ *
+ * Build and run from this directory:
+ *   gcc -std=gnu99 -O2 -Wall -DUSE_APP_CONFIG -Iinclude -I../fds_sim/include -I../fds_sim \
+ *       -I../../lib -I../../config button_sim.c ../fds_sim/sim.c ../fds_sim/sim_fds.c \
+ *       ../../lib/button.c ../../lib/latency_trace.c ../../lib/cycle_counter.c -o button_sim
+ *   ./button_sim [-v] [-n traces] [-r seed] [-l lag]
+ *
+ * The scripted traces run first, then -n randomized ones (5000 by default),
+ * each driving three buttons at once. Both run once with the countdown
+ * debouncer and once with the sampling integrator. The expected callbacks of a random
+ * trace come from a model of the timings in estc_service.c, and the traces
+ * keep clear of the thresholds by more than a tick, so only a change in
+ * the state machine can make them fail. The callbacks are checked at the
+ * time their interrupt stamped, -l delays the main loop by that many ms to
+ * show that a busy loop does not move them. A tick that app_timer refuses to
+ * start has to be retried. Last, button_wakeup_prepare() has to
+ * leave every pin sensing its pressed level. Exits with 1 on the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+
+#include "nrf.h"
+#include "nrfx_gpiote.h"
+#include "app_scheduler.h"
+
+#include "button.h"
+
+/* Same as in estc_service.c */
+#define SIM_DBLCLK_MS 200
+#define SIM_HOLD_FIRST_MS 500
+#define SIM_HOLD_NEXT_MS 50
+#define SIM_DEBOUNCE_MS 50
+#define SIM_DEBOUNCE_SAMPLES 3
+
+/* The share of SCHED_QUEUE_SIZE in main.c that the buttons may take */
+#define SIM_SCHED_QUEUE_SIZE BUTTON_SCHED_EVENTS_MAX
+#define SIM_SCHED_EVENT_DATA_SIZE 8
+
+#define SIM_BUTTONS 3
+#define SIM_PIN_BASE 10
+
+#define SIM_MAX_PRESSES 16
+#define SIM_MAX_EVENTS 512
+#define SIM_MAX_EDGES (SIM_BUTTONS * SIM_MAX_PRESSES * 20)
+
+/* Bounces end before the nominal edge, at most this long before it */
+#define SIM_BOUNCE_SPAN_US 16000
+/* Random traces keep this far from every threshold */
+#define SIM_MARGIN_US 25000
+
+/* The simulated app_timer rounds every period down to a whole microsecond */
+#define SIM_ROUNDING_US 500
+
+#define SIM_MS(ms) ((uint64_t) (ms) * 1000)
+
+typedef enum {
+    sim_mode_countdown,
+    sim_mode_integrator,
+    sim_mode_count
+} sim_mode_t;
+
+static char const * const m_mode_names[] = { "countdown debounce", "integrator debounce" };
+
+typedef enum {
+    sim_evt_click,
+    sim_evt_hold, /* a run of holds, count is its length */
+    sim_evt_hold_end
+} sim_evt_type_t;
+
+static char const * const m_evt_names[] = { "click", "hold", "hold end" };
+
+typedef struct {
+    uint64_t press_us;
+    uint64_t release_us;
+    uint8_t bounces;     /* extra edge pairs before the press and the release */
+    uint16_t bounce_us;  /* between two edges of a bounce */
+} sim_press_t;
+
+typedef struct {
+    sim_press_t presses[SIM_MAX_PRESSES];
+    uint8_t count;
+} sim_trace_t;
+
+typedef struct {
+    uint64_t time_us;
+    uint8_t button;
+    uint8_t type;
+    uint8_t count;
+    uint8_t clicks; /* before a hold */
+} sim_evt_t;
+
+typedef struct {
+    uint8_t button;
+    uint8_t type;
+    uint8_t count_min;
+    uint8_t count_max;
+    uint8_t clicks; /* before a hold */
+    uint64_t time_min_us;
+    uint64_t time_max_us;
+    double accepted_us; /* from the settled edge to the first callback, less the edge's acceptance */
+    bool press;         /* the edge accepted is a press */
+} sim_expect_t;
+
+typedef struct {
+    double sum_us;
+    double max_us;
+    uint32_t count;
+} sim_accept_stats_t;
+
+typedef struct {
+    uint64_t time_us;
+    uint8_t button;
+    bool pressed;
+} sim_edge_t;
+
+typedef struct {
+    uint8_t data[SIM_SCHED_EVENT_DATA_SIZE];
+    uint16_t size;
+    app_sched_event_handler_t handler;
+} sim_sched_evt_t;
+
+DWT_Type sim_dwt;
+CoreDebug_Type sim_core_debug;
+uint32_t SystemCoreClock = 64000000;
+
+static bool m_verbose;
+
+static bool m_pin_level[NUMBER_OF_PINS];
+static bool m_pin_enabled[NUMBER_OF_PINS];
+static nrf_gpio_pin_sense_t m_pin_sense[NUMBER_OF_PINS];
+static nrfx_gpiote_evt_handler_t m_gpiote_handler;
+static bool m_gpiote_init;
+
+static sim_sched_evt_t m_sched_queue[SIM_SCHED_QUEUE_SIZE];
+static uint8_t m_sched_head;
+static uint8_t m_sched_count;
+static uint64_t m_sched_first_us; /* when the oldest queued event was put */
+static uint64_t m_loop_lag_us;    /* the main loop gets to the queue this late */
+static uint32_t m_sched_full;     /* puts rejected, the buttons took more than their share */
+
+static sim_mode_t m_mode;
+static button_t m_buttons[sim_mode_count][SIM_BUTTONS];
+static uint32_t m_accepted_edges;
+
+static sim_evt_t m_events[SIM_MAX_EVENTS];
+static uint32_t m_events_count;
+
+static sim_expect_t m_expected[SIM_MAX_EVENTS];
+static uint32_t m_expected_count;
+
+static sim_edge_t m_edges[SIM_MAX_EDGES];
+static uint32_t m_edges_count;
+
+static double m_tick_us;
+static double m_rtc_tick_us;
+
+static sim_accept_stats_t m_accept_stats[2]; /* release, press */
+
+uint32_t nrf_gpio_pin_read(uint32_t pin_number)
+{
+    return m_pin_level[pin_number];
+}
+
+void nrf_gpio_cfg_sense_set(uint32_t pin_number, nrf_gpio_pin_sense_t sense)
+{
+    m_pin_sense[pin_number] = sense;
+}
+
+ret_code_t nrfx_gpiote_init(void)
+{
+    m_gpiote_init = true;
+    return NRF_SUCCESS;
+}
+
+bool nrfx_gpiote_is_init(void)
+{
+    return m_gpiote_init;
+}
+
+ret_code_t nrfx_gpiote_in_init(nrfx_gpiote_pin_t pin,
+                               nrfx_gpiote_in_config_t const * p_config,
+                               nrfx_gpiote_evt_handler_t evt_handler)
+{
+    /* The pull-up keeps an active low button released */
+    m_pin_level[pin] = (p_config->pull == NRF_GPIO_PIN_PULLUP);
+    m_gpiote_handler = evt_handler;
+    return NRF_SUCCESS;
+}
+
+void nrfx_gpiote_in_event_enable(nrfx_gpiote_pin_t pin, bool int_enable)
+{
+    m_pin_enabled[pin] = true;
+}
+
+void nrfx_gpiote_in_event_disable(nrfx_gpiote_pin_t pin)
+{
+    m_pin_enabled[pin] = false;
+}
+
+ret_code_t app_sched_event_put(void const * p_event_data,
+                               uint16_t event_size,
+                               app_sched_event_handler_t handler)
+{
+    sim_sched_evt_t *evt;
+
+    if (m_sched_count == SIM_SCHED_QUEUE_SIZE || event_size > SIM_SCHED_EVENT_DATA_SIZE)
+    {
+        m_sched_full++;
+        return NRF_ERROR_NO_MEM;
+    }
+
+    if (m_sched_count == 0)
+    {
+        m_sched_first_us = sim_now_us();
+    }
+
+    evt = &m_sched_queue[(m_sched_head + m_sched_count) % SIM_SCHED_QUEUE_SIZE];
+    memcpy(evt->data, p_event_data, event_size);
+    evt->size = event_size;
+    evt->handler = handler;
+    m_sched_count++;
+
+    return NRF_SUCCESS;
+}
+
+void app_sched_execute(void)
+{
+    while (m_sched_count != 0)
+    {
+        sim_sched_evt_t evt = m_sched_queue[m_sched_head];
+
+        m_sched_head = (m_sched_head + 1) % SIM_SCHED_QUEUE_SIZE;
+        m_sched_count--;
+
+        evt.handler(evt.data, evt.size);
+    }
+}
+
+static void event_record(void *p_context, sim_evt_type_t type, uint8_t count, uint8_t clicks)
+{
+    uint32_t lag_ticks;
+    sim_evt_t *evt;
+
+    if (m_events_count == SIM_MAX_EVENTS)
+    {
+        return;
+    }
+
+    /* The time the interrupt stamped, not when the main loop got to it */
+    lag_ticks = app_timer_cnt_diff_compute(app_timer_cnt_get(), button_event_time_get());
+
+    evt = &m_events[m_events_count++];
+    evt->time_us = sim_now_us() - (uint64_t) (lag_ticks * m_rtc_tick_us);
+    evt->button = (uint8_t) (uintptr_t) p_context;
+    evt->type = type;
+    evt->count = count;
+    evt->clicks = clicks;
+
+    if (m_verbose)
+    {
+        printf("%10.3f ms  button %d  %s %d\n",
+               evt->time_us / 1000.0, evt->button, m_evt_names[type], count);
+    }
+}
+
+static void sim_onclick(void *p_context, uint8_t clicks)
+{
+    event_record(p_context, sim_evt_click, clicks, 0);
+}
+
+static void sim_onhold(void *p_context, uint8_t clicks, uint8_t repeat)
+{
+    event_record(p_context, sim_evt_hold, repeat, clicks);
+}
+
+static void sim_onhold_end(void *p_context)
+{
+    event_record(p_context, sim_evt_hold_end, 0, 0);
+}
+
+static button_timings_t const sim_timings[sim_mode_count] = {
+    [sim_mode_countdown] = {
+        .dblclk_pause_ms = SIM_DBLCLK_MS,
+        .hold_pause_short_ms = SIM_HOLD_NEXT_MS,
+        .hold_pause_long_ms = SIM_HOLD_FIRST_MS,
+        .debounce_period_ms = SIM_DEBOUNCE_MS
+    },
+    [sim_mode_integrator] = {
+        .dblclk_pause_ms = SIM_DBLCLK_MS,
+        .hold_pause_short_ms = SIM_HOLD_NEXT_MS,
+        .hold_pause_long_ms = SIM_HOLD_FIRST_MS,
+        .debounce_period_ms = SIM_DEBOUNCE_MS,
+        .debounce_samples = SIM_DEBOUNCE_SAMPLES
+    }
+};
+
+static button_callbacks_t const sim_callbacks = {
+    .onclick = sim_onclick,
+    .onhold = sim_onhold,
+    .onhold_end = sim_onhold_end,
+    .is_pressed = NULL
+};
+
+static uint64_t sched_due_us(void)
+{
+    return m_sched_count == 0 ? UINT64_MAX : m_sched_first_us + m_loop_lag_us;
+}
+
+/* Timer interrupts run as they fall due, the main loop drains the
+ * scheduler queue -l ms after an event was put into it */
+static void sim_advance(uint64_t time_us)
+{
+    uint64_t next;
+
+    while ((next = MIN(sim_timer_next_us(), sched_due_us())) <= time_us)
+    {
+        sim_run_until(next);
+        sim_dwt.CYCCNT = sim_now_us() * (SystemCoreClock / 1000000);
+
+        if (sim_now_us() >= sched_due_us())
+            app_sched_execute();
+    }
+
+    sim_run_until(time_us);
+    sim_dwt.CYCCNT = sim_now_us() * (SystemCoreClock / 1000000);
+}
+
+static void sim_idle(void)
+{
+    uint64_t next;
+
+    while ((next = MIN(sim_timer_next_us(), sched_due_us())) != UINT64_MAX)
+    {
+        sim_advance(next);
+    }
+}
+
+static void edge_add(uint64_t time_us, uint8_t button, bool pressed)
+{
+    m_edges[m_edges_count].time_us = time_us;
+    m_edges[m_edges_count].button = button;
+    m_edges[m_edges_count].pressed = pressed;
+    m_edges_count++;
+}
+
+/* The contact settles at the nominal time, after 2 * bounces edges */
+static void edges_add_settling(uint64_t time_us, uint8_t button, bool pressed, sim_press_t const *press)
+{
+    int i;
+
+    for (i = 2 * press->bounces; i > 0; i--)
+    {
+        edge_add(time_us - (uint64_t) i * press->bounce_us, button, (i % 2 == 0) == pressed);
+    }
+
+    edge_add(time_us, button, pressed);
+}
+
+static int edge_compare(void const *a, void const *b)
+{
+    sim_edge_t const *ea = a;
+    sim_edge_t const *eb = b;
+
+    return (ea->time_us > eb->time_us) - (ea->time_us < eb->time_us);
+}
+
+static void edges_build(sim_trace_t const *traces, uint64_t base_us)
+{
+    uint8_t button;
+    uint8_t i;
+
+    m_edges_count = 0;
+
+    for (button = 0; button < SIM_BUTTONS; button++)
+    {
+        for (i = 0; i < traces[button].count; i++)
+        {
+            sim_press_t const *press = &traces[button].presses[i];
+
+            edges_add_settling(base_us + press->press_us, button, true, press);
+            edges_add_settling(base_us + press->release_us, button, false, press);
+        }
+    }
+
+    qsort(m_edges, m_edges_count, sizeof(sim_edge_t), edge_compare);
+}
+
+static void edges_play(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < m_edges_count; i++)
+    {
+        button_t const *b = &m_buttons[m_mode][m_edges[i].button];
+
+        sim_advance(m_edges[i].time_us);
+
+        m_pin_level[b->pin] = m_edges[i].pressed ? b->active_level : !b->active_level;
+
+        if (m_pin_enabled[b->pin])
+            m_gpiote_handler(b->pin, NRF_GPIOTE_POLARITY_TOGGLE);
+    }
+
+    sim_idle();
+}
+
+static sim_expect_t *expect_add(uint8_t button, sim_evt_type_t type,
+                                uint8_t count_min, uint8_t count_max,
+                                double time_min_us, double time_max_us,
+                                double edge_us, double delay_us, bool press)
+{
+    sim_expect_t *exp = &m_expected[m_expected_count++];
+
+    exp->accepted_us = edge_us + delay_us;
+    exp->press = press;
+
+    exp->button = button;
+    exp->type = type;
+    exp->count_min = count_min;
+    exp->count_max = count_max;
+    exp->time_min_us = (uint64_t) (time_min_us - SIM_ROUNDING_US);
+    exp->time_max_us = (uint64_t) (time_max_us + SIM_ROUNDING_US);
+    exp->clicks = 0;
+
+    return exp;
+}
+
+/* When an edge that settles at time_us after bouncing for bounce_us is
+ * accepted. The countdown runs out between debounce - 1 and debounce ticks
+ * after the last bounce, depending on the phase of the shared tick timer.
+ * The integrator may already count the bounces, but once the contact has
+ * settled it needs debounce_samples ticks at most */
+static void accept_window(double time_us, double bounce_us, double *min_us, double *max_us)
+{
+    if (m_mode == sim_mode_countdown)
+    {
+        double debounce = (SIM_DEBOUNCE_MS / BUTTON_TICK_MS) * m_tick_us;
+
+        *min_us = time_us + debounce - m_tick_us;
+        *max_us = time_us + debounce;
+    }
+    else
+    {
+        *min_us = time_us - bounce_us + (SIM_DEBOUNCE_SAMPLES - 1) * m_tick_us;
+        *max_us = time_us + SIM_DEBOUNCE_SAMPLES * m_tick_us;
+    }
+}
+
+/* Presses this short are never accepted */
+static double glitch_us(void)
+{
+    if (m_mode == sim_mode_countdown)
+        return (SIM_DEBOUNCE_MS / BUTTON_TICK_MS - 1) * m_tick_us;
+
+    return (SIM_DEBOUNCE_SAMPLES - 1) * m_tick_us;
+}
+
+/*
+ * Model of the state machine: an edge is accepted within accept_window(),
+ * and a press undone before glitch_us() is not seen at all. Holds start
+ * hold_first after the accepted press and repeat while the pin reads
+ * pressed. Clicks are reported dblclk after the last accepted release,
+ * unless the button is pressed again by then. A hold takes over the clicks
+ * of its gesture, it reports them instead.
+ */
+static void expect_build(sim_trace_t const *trace, uint8_t button, uint64_t base_us)
+{
+    double dblclk = (SIM_DBLCLK_MS / BUTTON_TICK_MS) * m_tick_us;
+    double hold_first = (SIM_HOLD_FIRST_MS / BUTTON_TICK_MS) * m_tick_us;
+    double hold_next = (SIM_HOLD_NEXT_MS / BUTTON_TICK_MS) * m_tick_us;
+    uint8_t clicks = 0;
+    uint8_t i;
+
+    for (i = 0; i < trace->count; i++)
+    {
+        sim_press_t const *press = &trace->presses[i];
+        double press_us = base_us + press->press_us;
+        double release_us = base_us + press->release_us;
+        double bounce_us = 2.0 * press->bounces * press->bounce_us;
+        double pressed_min_us, pressed_max_us;
+        double released_min_us, released_max_us;
+        int holds_min = 0;
+        int holds_max = 0;
+
+        if (release_us - press_us < glitch_us())
+            continue;
+
+        m_accepted_edges += 2;
+
+        accept_window(press_us, bounce_us, &pressed_min_us, &pressed_max_us);
+        accept_window(release_us, bounce_us, &released_min_us, &released_max_us);
+
+        /* Holds surely seen while the contact is closed, and those that
+         * may still be seen while it bounces open */
+        while (pressed_max_us + hold_first + holds_min * hold_next < release_us - bounce_us - SIM_ROUNDING_US)
+            holds_min++;
+
+        while (pressed_min_us + hold_first + holds_max * hold_next < release_us + SIM_ROUNDING_US)
+            holds_max++;
+
+        clicks++;
+
+        if (holds_max > 0)
+        {
+            /* The clicks of the gesture before the held press */
+            expect_add(button, sim_evt_hold, holds_min, holds_max,
+                       pressed_min_us + hold_first,
+                       pressed_max_us + hold_first,
+                       press_us, hold_first, true)->clicks = clicks - 1;
+
+            expect_add(button, sim_evt_hold_end, 0, 0,
+                       released_min_us,
+                       released_max_us,
+                       release_us, 0, false);
+
+            clicks = 0;
+        }
+
+        if (i + 1 == trace->count ||
+            trace->presses[i + 1].press_us - press->release_us > SIM_DBLCLK_MS * 1000)
+        {
+            if (clicks != 0)
+            {
+                expect_add(button, sim_evt_click, clicks, clicks,
+                           released_min_us + dblclk,
+                           released_max_us + dblclk,
+                           release_us, dblclk, false);
+            }
+
+            clicks = 0;
+        }
+    }
+}
+
+static bool expect_check(char const *name)
+{
+    uint32_t pos[SIM_BUTTONS] = { 0 };
+    uint32_t i;
+
+    for (i = 0; i < m_expected_count; i++)
+    {
+        sim_expect_t const *exp = &m_expected[i];
+        uint32_t *p = &pos[exp->button];
+        uint32_t run = 0;
+        uint64_t first_us = 0;
+
+        /* Events of the other buttons are checked by their own expectations */
+        while (*p < m_events_count && m_events[*p].button != exp->button)
+            (*p)++;
+
+        while (*p < m_events_count)
+        {
+            sim_evt_t const *evt = &m_events[*p];
+
+            if (evt->button != exp->button)
+            {
+                (*p)++;
+                continue;
+            }
+
+            if (evt->type != exp->type)
+                break;
+
+            if (exp->type != sim_evt_hold)
+            {
+                run = 1;
+                first_us = evt->time_us;
+                (*p)++;
+
+                if (exp->type == sim_evt_click && evt->count != exp->count_min)
+                {
+                    printf("%s: button %d: %d clicks instead of %d at %.3f ms\n",
+                           name, exp->button, evt->count, exp->count_min, evt->time_us / 1000.0);
+                    return false;
+                }
+                break;
+            }
+
+            if (evt->clicks != exp->clicks)
+            {
+                printf("%s: button %d: hold after %d clicks instead of %d at %.3f ms\n",
+                       name, exp->button, evt->clicks, exp->clicks, evt->time_us / 1000.0);
+                return false;
+            }
+
+            if (evt->count != run)
+            {
+                printf("%s: button %d: hold repeat %d instead of %d at %.3f ms\n",
+                       name, exp->button, evt->count, run, evt->time_us / 1000.0);
+                return false;
+            }
+
+            if (run == 0)
+                first_us = evt->time_us;
+
+            run++;
+            (*p)++;
+        }
+
+        if (run == 0)
+        {
+            printf("%s: button %d: missing %s, expected at %.3f..%.3f ms\n",
+                   name, exp->button, m_evt_names[exp->type],
+                   exp->time_min_us / 1000.0, exp->time_max_us / 1000.0);
+            return false;
+        }
+
+        if (first_us < exp->time_min_us || first_us > exp->time_max_us)
+        {
+            printf("%s: button %d: %s at %.3f ms, expected at %.3f..%.3f ms\n",
+                   name, exp->button, m_evt_names[exp->type], first_us / 1000.0,
+                   exp->time_min_us / 1000.0, exp->time_max_us / 1000.0);
+            return false;
+        }
+
+        if (exp->type == sim_evt_hold && (run < exp->count_min || run > exp->count_max))
+        {
+            printf("%s: button %d: %d holds, expected %d..%d\n",
+                   name, exp->button, run, exp->count_min, exp->count_max);
+            return false;
+        }
+
+        {
+            sim_accept_stats_t *stats = &m_accept_stats[exp->press];
+            double accept_us = first_us - exp->accepted_us;
+
+            stats->sum_us += accept_us;
+            stats->max_us = MAX(stats->max_us, accept_us);
+            stats->count++;
+        }
+    }
+
+    for (i = 0; i < SIM_BUTTONS; i++)
+    {
+        while (pos[i] < m_events_count && m_events[pos[i]].button != i)
+            pos[i]++;
+
+        if (pos[i] < m_events_count)
+        {
+            printf("%s: button %d: unexpected %s %d at %.3f ms\n",
+                   name, i, m_evt_names[m_events[pos[i]].type],
+                   m_events[pos[i]].count, m_events[pos[i]].time_us / 1000.0);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void trace_print(sim_trace_t const *traces, uint64_t base_us)
+{
+    uint8_t button;
+    uint8_t i;
+
+    for (button = 0; button < SIM_BUTTONS; button++)
+    {
+        for (i = 0; i < traces[button].count; i++)
+        {
+            sim_press_t const *press = &traces[button].presses[i];
+
+            printf("%10.3f ms  button %d  pressed for %.3f ms, %d bounces of %d us\n",
+                   (base_us + press->press_us) / 1000.0, button,
+                   (press->release_us - press->press_us) / 1000.0,
+                   press->bounces, press->bounce_us);
+        }
+    }
+}
+
+static bool trace_run(char const *name, sim_trace_t const *traces)
+{
+    uint64_t base_us = sim_now_us() + SIM_MS(100);
+    uint8_t button;
+
+    m_events_count = 0;
+    m_expected_count = 0;
+
+    for (button = 0; button < SIM_BUTTONS; button++)
+    {
+        expect_build(&traces[button], button, base_us);
+    }
+
+    if (m_verbose)
+        trace_print(traces, base_us);
+
+    edges_build(traces, base_us);
+    edges_play();
+
+    if (!expect_check(name))
+    {
+        if (!m_verbose)
+            trace_print(traces, base_us);
+
+        return false;
+    }
+
+    return true;
+}
+
+/* Scripted traces, times in ms relative to the start of the trace */
+typedef struct {
+    char const *name;
+    sim_trace_t traces[SIM_BUTTONS];
+    char const *expected; /* what the model has to predict, for the reader */
+} sim_script_t;
+
+#define P(press, release) { SIM_MS(press), SIM_MS(release), 0, 0 }
+#define PB(press, release, n) { SIM_MS(press), SIM_MS(release), n, 1500 }
+
+static sim_script_t const m_scripts[] = {
+    { "clean click",      { { { P(0, 100) }, 1 } },
+      "click 1" },
+    { "bouncy click",     { { { PB(0, 100, 4) }, 1 } },
+      "click 1" },
+    { "glitch",           { { { P(0, 15) }, 1 } },
+      "nothing, the press is shorter than the debounce" },
+    { "double click",     { { { P(0, 80), P(180, 260) }, 2 } },
+      "click 2" },
+    { "triple click",     { { { PB(0, 80, 2), PB(180, 260, 3), PB(360, 440, 1) }, 3 } },
+      "click 3" },
+    { "slow clicks",      { { { P(0, 80), P(400, 480) }, 2 } },
+      "click 1, click 1" },
+    { "hold",             { { { P(0, 1225) }, 1 } },
+      "a hold every 50 ms from about 550 ms, hold end" },
+    { "click then hold",  { { { P(0, 80), P(180, 1000) }, 2 } },
+      "holds after 1 click, hold end" },
+    { "two buttons",      { { { P(0, 100) }, 1 }, { { P(30, 130) }, 1 } },
+      "button 0 click 1, button 1 click 1 30 ms later" },
+    { "hold and clicks",  { { { P(0, 700) }, 1 }, { { P(100, 180), P(280, 360) }, 2 },
+                            { { PB(50, 150, 3) }, 1 } },
+      "button 0 holds, button 1 double clicks, button 2 clicks, all at once" },
+};
+
+static bool scripts_run(void)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(m_scripts); i++)
+    {
+        if (!trace_run(m_scripts[i].name, m_scripts[i].traces))
+        {
+            printf("expected: %s\n", m_scripts[i].expected);
+            return false;
+        }
+
+        printf("%-16s ok  (%d events) %s\n", m_scripts[i].name, m_events_count, m_scripts[i].expected);
+    }
+
+    return true;
+}
+
+static uint32_t random_range(uint32_t min, uint32_t max)
+{
+    return min + (uint32_t) (rand() % (max - min + 1));
+}
+
+/* The earliest a press is accepted, which is where its hold timer starts.
+ * The integrator may count the bounces before the nominal edge */
+static uint32_t accept_min_ms(void)
+{
+    if (m_mode == sim_mode_countdown)
+        return SIM_DEBOUNCE_MS - BUTTON_TICK_MS;
+
+    return (SIM_DEBOUNCE_SAMPLES - 1) * BUTTON_TICK_MS - SIM_BOUNCE_SPAN_US / 1000;
+}
+
+/* Gestures separated by pauses longer than a double click: either
+ * a hold or up to four clicks with presses shorter than a hold */
+static void random_trace(sim_trace_t *trace)
+{
+    uint64_t t = SIM_MS(random_range(0, 300));
+    uint8_t gestures = random_range(1, 4);
+    uint8_t g;
+
+    trace->count = 0;
+
+    for (g = 0; g < gestures; g++)
+    {
+        bool hold = random_range(0, 9) < 3;
+        uint8_t presses = hold ? 1 : random_range(1, 4);
+        uint8_t i;
+
+        for (i = 0; i < presses; i++)
+        {
+            sim_press_t *press = &trace->presses[trace->count++];
+            uint32_t min_ms = (SIM_DEBOUNCE_MS + SIM_MARGIN_US / 1000);
+            uint32_t max_ms = (accept_min_ms() + SIM_HOLD_FIRST_MS - SIM_MARGIN_US / 1000);
+            /* Held until after the first hold, even if accepted late */
+            uint32_t hold_ms = (SIM_DEBOUNCE_MS + SIM_HOLD_FIRST_MS +
+                                (SIM_MARGIN_US + SIM_BOUNCE_SPAN_US) / 1000);
+
+            press->bounces = random_range(0, 4);
+            press->bounce_us = random_range(200, SIM_BOUNCE_SPAN_US / 8);
+            press->press_us = t;
+            press->release_us = t + SIM_MS(hold ? random_range(hold_ms, 3000)
+                                                : random_range(min_ms, max_ms));
+
+            /* A short gap still has to outlast the debounce of the release
+             * and the bounces of the next press */
+            t = press->release_us + SIM_MS(random_range(SIM_DEBOUNCE_MS + (SIM_MARGIN_US + SIM_BOUNCE_SPAN_US) / 1000,
+                                                        SIM_DBLCLK_MS - SIM_MARGIN_US / 1000 - BUTTON_TICK_MS));
+        }
+
+        t = trace->presses[trace->count - 1].release_us +
+            SIM_MS(random_range(SIM_DEBOUNCE_MS + SIM_DBLCLK_MS + SIM_MARGIN_US / 1000, 800));
+    }
+}
+
+static bool random_run(uint32_t count)
+{
+    sim_trace_t traces[SIM_BUTTONS];
+    uint64_t sim_start_us = sim_now_us();
+    uint64_t events = 0;
+    uint64_t edges = 0;
+    clock_t start = clock();
+    double host_s;
+    button_stats_t stats_start;
+    button_stats_t stats;
+    uint32_t n;
+    uint8_t button;
+    uint8_t i;
+
+    button_stats_get(&stats_start);
+    memset(m_accept_stats, 0, sizeof(m_accept_stats));
+    m_accepted_edges = 0;
+
+    for (n = 0; n < count; n++)
+    {
+        char name[32];
+
+        for (button = 0; button < SIM_BUTTONS; button++)
+        {
+            random_trace(&traces[button]);
+        }
+
+        snprintf(name, sizeof(name), "random trace %u", n);
+
+        if (!trace_run(name, traces))
+        {
+            return false;
+        }
+
+        events += m_events_count;
+        edges += m_edges_count;
+    }
+
+    host_s = (double) (clock() - start) / CLOCKS_PER_SEC;
+    button_stats_get(&stats);
+
+    printf("%u random traces ok: %llu edges, %llu callbacks, %.0f s simulated in %.2f s (%.0f edges/s)\n",
+           count, (unsigned long long) edges, (unsigned long long) events,
+           (sim_now_us() - sim_start_us) / 1e6, host_s, host_s > 0 ? edges / host_s : 0);
+    printf("scheduler: %u events deferred, %u dropped, %u pending at most, %u puts rejected\n",
+           stats.events_deferred - stats_start.events_deferred,
+           stats.events_dropped - stats_start.events_dropped,
+           stats.queue_depth_max,
+           m_sched_full);
+
+    if (m_sched_full != 0)
+    {
+        printf("the buttons took more than BUTTON_SCHED_EVENTS_MAX scheduler entries\n");
+        return false;
+    }
+    printf("%u edges accepted for %u edge interrupts and %u samples (%.1f interrupts, %.1f samples each)\n",
+           m_accepted_edges,
+           stats.edge_irqs - stats_start.edge_irqs,
+           stats.samples - stats_start.samples,
+           (double) (stats.edge_irqs - stats_start.edge_irqs) / m_accepted_edges,
+           (double) (stats.samples - stats_start.samples) / m_accepted_edges);
+
+    for (i = 0; i < 2; i++)
+    {
+        printf("%s accepted after %.1f ms on average, %.1f ms at most\n",
+               i ? "press" : "release",
+               m_accept_stats[i].sum_us / MAX(m_accept_stats[i].count, 1) / 1000,
+               m_accept_stats[i].max_us / 1000);
+    }
+
+    return true;
+}
+
+/* A tick that app_timer refused to start is retried from the main loop,
+ * so a click on a full app_timer operation queue is still seen. Run with
+ * no main loop lag: the debounce would end before a late retry */
+static bool tick_retry_check(void)
+{
+    uint64_t lag_us = m_loop_lag_us;
+    uint64_t base_us = sim_now_us() + SIM_MS(1000);
+    button_stats_t before;
+    button_stats_t after;
+    uint32_t failures;
+
+    button_stats_get(&before);
+
+    m_loop_lag_us = 0;
+    m_events_count = 0;
+    m_edges_count = 0;
+
+    edge_add(base_us, 0, true);
+    edge_add(base_us + SIM_MS(100), 0, false);
+
+    sim_timer_start_fail(3);
+    edges_play();
+
+    m_loop_lag_us = lag_us;
+
+    button_stats_get(&after);
+    failures = after.tick_start_failures - before.tick_start_failures;
+
+    if (m_events_count != 1 || m_events[0].type != sim_evt_click || m_events[0].count != 1 ||
+        failures != 3)
+    {
+        printf("tick retry: %u events instead of click 1, %u failed starts\n",
+               m_events_count, failures);
+        return false;
+    }
+
+    printf("%-16s ok  (%u failed starts) click 1\n", "tick retry", failures);
+
+    return true;
+}
+
+/* Every button pin is left sensing its pressed level with its input off */
+static bool wakeup_check(void)
+{
+    uint8_t mode;
+    uint8_t i;
+
+    button_wakeup_prepare();
+
+    for (mode = 0; mode < sim_mode_count; mode++)
+    {
+        for (i = 0; i < SIM_BUTTONS; i++)
+        {
+            button_t const *b = &m_buttons[mode][i];
+            nrf_gpio_pin_sense_t sense = b->active_level ? NRF_GPIO_PIN_SENSE_HIGH
+                                                         : NRF_GPIO_PIN_SENSE_LOW;
+
+            if (m_pin_enabled[b->pin] || m_pin_sense[b->pin] != sense)
+            {
+                printf("wake-up: pin %d %s, sense %d instead of %d\n", b->pin,
+                       m_pin_enabled[b->pin] ? "still enabled" : "disabled",
+                       m_pin_sense[b->pin], sense);
+                return false;
+            }
+        }
+    }
+
+    printf("wake-up: %d pins sense their pressed level\n", sim_mode_count * SIM_BUTTONS);
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t count = 5000;
+    unsigned int seed = 1;
+    uint8_t i;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vn:r:l:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'v':
+                m_verbose = true;
+                break;
+
+            case 'n':
+                count = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'r':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'l':
+                m_loop_lag_us = SIM_MS(strtoul(optarg, NULL, 0));
+                break;
+
+            default:
+                fprintf(stderr, "usage: %s [-v] [-n traces] [-r seed] [-l main loop lag ms]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    srand(seed);
+    sim_reset(&sim_nrf52840_timing);
+
+    m_rtc_tick_us = 1e6 * (APP_TIMER_CONFIG_RTC_FREQUENCY + 1) / APP_TIMER_CLOCK_FREQ;
+    m_tick_us = APP_TIMER_TICKS(BUTTON_TICK_MS) * m_rtc_tick_us;
+
+    for (m_mode = 0; m_mode < sim_mode_count; m_mode++)
+    {
+        for (i = 0; i < SIM_BUTTONS; i++)
+        {
+            button_config_t config = {
+                .pin = SIM_PIN_BASE + m_mode * SIM_BUTTONS + i,
+                .active_level = i % 2, /* both polarities */
+                .pull = i % 2 ? NRF_GPIO_PIN_PULLDOWN : NRF_GPIO_PIN_PULLUP,
+                .timings = &sim_timings[m_mode],
+                .callbacks = &sim_callbacks,
+                .p_context = (void *) (uintptr_t) i
+            };
+
+            if (NRF_SUCCESS != button_init(&m_buttons[m_mode][i], &config))
+            {
+                printf("button_init failed\n");
+                return 1;
+            }
+        }
+    }
+
+    for (m_mode = 0; m_mode < sim_mode_count; m_mode++)
+    {
+        printf("--- %s\n", m_mode_names[m_mode]);
+
+        if (!scripts_run() || !random_run(count) || !tick_retry_check())
+        {
+            return 1;
+        }
+    }
+
+    if (!wakeup_check())
+    {
+        return 1;
+    }
+
+    return 0;
+}
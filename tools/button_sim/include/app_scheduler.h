@@ -0,0 +1,17 @@
+/* Host build of the button module: the harness runs the queue like the main loop */
+#ifndef APP_SCHEDULER_H__
+#define APP_SCHEDULER_H__
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+typedef void (*app_sched_event_handler_t)(void * p_event_data, uint16_t event_size);
+
+ret_code_t app_sched_event_put(void const * p_event_data,
+                               uint16_t event_size,
+                               app_sched_event_handler_t handler);
+
+void app_sched_execute(void);
+
+#endif /* APP_SCHEDULER_H__ */
@@ -0,0 +1,8 @@
+/* Host build of the button modules: the interrupts never preempt the main loop */
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#define CRITICAL_REGION_ENTER() {
+#define CRITICAL_REGION_EXIT()  }
+
+#endif /* APP_UTIL_PLATFORM_H__ */
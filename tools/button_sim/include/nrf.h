@@ -0,0 +1,27 @@
+/* Host build of the button module: the DWT cycle counter follows the simulated clock */
+#ifndef NRF_H
+#define NRF_H
+
+#include <stdint.h>
+
+typedef struct {
+    volatile uint32_t CTRL;
+    volatile uint32_t CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+#define DWT_CTRL_CYCCNTENA_Msk      (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk  (1UL << 24)
+
+extern DWT_Type sim_dwt;
+extern CoreDebug_Type sim_core_debug;
+
+#define DWT       (&sim_dwt)
+#define CoreDebug (&sim_core_debug)
+
+extern uint32_t SystemCoreClock;
+
+#endif /* NRF_H */
@@ -0,0 +1,29 @@
+/* Host build of the button module: pin levels are set by the harness */
+#ifndef NRF_GPIO_H__
+#define NRF_GPIO_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define NUMBER_OF_PINS 48
+
+#define NRF_GPIO_PIN_MAP(port, pin) (((port) << 5) | ((pin) & 0x1F))
+
+typedef enum
+{
+    NRF_GPIO_PIN_NOPULL   = 0,
+    NRF_GPIO_PIN_PULLDOWN = 1,
+    NRF_GPIO_PIN_PULLUP   = 3
+} nrf_gpio_pin_pull_t;
+
+typedef enum
+{
+    NRF_GPIO_PIN_NOSENSE    = 0,
+    NRF_GPIO_PIN_SENSE_LOW  = 3,
+    NRF_GPIO_PIN_SENSE_HIGH = 2
+} nrf_gpio_pin_sense_t;
+
+uint32_t nrf_gpio_pin_read(uint32_t pin_number);
+void nrf_gpio_cfg_sense_set(uint32_t pin_number, nrf_gpio_pin_sense_t sense);
+
+#endif /* NRF_GPIO_H__ */
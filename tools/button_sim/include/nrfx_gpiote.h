@@ -0,0 +1,42 @@
+/* Host build of the button module: the harness calls the handler on every edge it injects */
+#ifndef NRFX_GPIOTE_H__
+#define NRFX_GPIOTE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+#include "nrf_gpio.h"
+
+typedef uint32_t nrfx_gpiote_pin_t;
+
+typedef enum
+{
+    NRF_GPIOTE_POLARITY_LOTOHI = 1,
+    NRF_GPIOTE_POLARITY_HITOLO = 2,
+    NRF_GPIOTE_POLARITY_TOGGLE = 3
+} nrf_gpiote_polarity_t;
+
+typedef void (*nrfx_gpiote_evt_handler_t)(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_t action);
+
+typedef struct
+{
+    nrf_gpiote_polarity_t sense;
+    nrf_gpio_pin_pull_t pull;
+    bool is_watcher;
+    bool hi_accuracy;
+    bool skip_gpio_setup;
+} nrfx_gpiote_in_config_t;
+
+#define NRFX_GPIOTE_CONFIG_IN_SENSE_TOGGLE(hi_accu) \
+    { NRF_GPIOTE_POLARITY_TOGGLE, NRF_GPIO_PIN_NOPULL, false, hi_accu, false }
+
+ret_code_t nrfx_gpiote_init(void);
+bool nrfx_gpiote_is_init(void);
+ret_code_t nrfx_gpiote_in_init(nrfx_gpiote_pin_t pin,
+                               nrfx_gpiote_in_config_t const * p_config,
+                               nrfx_gpiote_evt_handler_t evt_handler);
+void nrfx_gpiote_in_event_enable(nrfx_gpiote_pin_t pin, bool int_enable);
+void nrfx_gpiote_in_event_disable(nrfx_gpiote_pin_t pin);
+
+#endif /* NRFX_GPIOTE_H__ */
@@ -0,0 +1,555 @@
+/*
+ * Rotary encoder harness: runs lib/encoder.c against a model of the QDEC
+ * registers, fed with the quadrature waveforms of a detented knob with
+ * contact bounce, and checks that the detents reaching the handler add up
+ * to the ones turned and how often the CPU was interrupted for them.
+ *
+ * Build and run from this directory:
+ *   gcc -std=gnu99 -O2 -Wall -DUSE_APP_CONFIG -DENCODER_ENABLED=1 -Iinclude \
+ *       -I../button_sim/include -I../fds_sim/include -I../../lib -I../../config \
+ *       encoder_sim.c ../../lib/encoder.c -o encoder_sim
+ *   ./encoder_sim [-v] [-n traces] [-r seed]
+ *
+ * The QDEC model covers what the encoder uses of it:
+ * - both inputs are sampled every SAMPLEPER. With DBFEN a level only gets
+ *   through once it has been stable for a whole sample period, which is a
+ *   simplification of the debounce filter
+ * - a change of one input is a step of +1 or -1 in ACC, a change of both
+ *   is counted in ACCDBL instead
+ * - every REPORTPER samples, REPORTRDY if ACC is not 0. The REPORTRDY to
+ *   READCLRACC short moves ACC and ACCDBL to ACCREAD and ACCDBLREAD and
+ *   clears them, the driver hands those to the handler in the interrupt
+ * The main loop drains the app_scheduler queue every SIM_MAIN_LOOP_US.
+ *
+ * Scripted cases run first, then -n random traces of whole detents within
+ * the speed the sample period allows (1000 by default). Exits with 1 on
+ * the first mismatch.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sdk_config.h"
+#include "app_util.h"
+#include "app_scheduler.h"
+#include "nrfx_qdec.h"
+#include "nrf_gpio.h"
+
+#include "encoder.h"
+
+#define SIM_MAIN_LOOP_US 1000
+
+#define SIM_SCHED_QUEUE_SIZE 16
+
+#define SIM_MAX_EDGES 8192
+
+/* Bounces end before the nominal edge, at most this long before it */
+#define SIM_BOUNCE_SPAN_US 800
+
+typedef struct {
+    uint64_t time_us;
+    uint8_t input; /* 0 is A, 1 is B */
+    uint8_t level;
+} sim_edge_t;
+
+/* Registers and state of the QDEC model */
+typedef struct {
+    nrfx_qdec_config_t config;
+    nrfx_qdec_event_handler_t handler;
+    bool enabled;
+
+    uint32_t sample_us;
+    uint32_t report_samples;
+
+    uint8_t raw[2];
+    uint64_t changed_us[2];
+    uint8_t filtered[2];
+
+    int16_t acc;
+    uint16_t accdbl;
+    uint32_t samples; /* since the last report */
+} sim_qdec_t;
+
+typedef struct {
+    uint64_t samples;
+    uint64_t edges;
+    uint32_t calls;
+    int32_t detents;
+    uint64_t last_call_us;
+    uint64_t min_interval_us;
+} sim_counters_t;
+
+static bool m_verbose;
+
+static sim_qdec_t m_qdec;
+static nrf_gpio_pin_pull_t m_pull[NUMBER_OF_PINS];
+
+static app_sched_event_handler_t m_sched_queue[SIM_SCHED_QUEUE_SIZE];
+static uint8_t m_sched_head;
+static uint8_t m_sched_count;
+
+static sim_edge_t m_edges[SIM_MAX_EDGES];
+static uint32_t m_edges_count;
+
+static uint64_t m_now_us;
+static sim_counters_t m_counters;
+
+/* Quadrature position of the inputs, A changes first when counting up.
+ * Both are pulled up, so a detent rests with both high */
+static uint8_t const m_gray_to_ab[4] = { 0x3, 0x1, 0x0, 0x2 };
+static uint8_t const m_ab_to_gray[4] = { 2, 1, 3, 0 };
+
+static uint32_t const m_reportper_samples[] = { 10, 40, 80, 120, 160, 200, 240, 280 };
+
+void sim_log(char const *level, char const *fmt, ...)
+{
+    va_list args;
+
+    if (!m_verbose)
+        return;
+
+    va_start(args, fmt);
+    printf("%10.3f ms  %s: ", m_now_us / 1000.0, level);
+    vprintf(fmt, args);
+    printf("\n");
+    va_end(args);
+}
+
+void nrf_gpio_cfg_input(uint32_t pin_number, nrf_gpio_pin_pull_t pull_config)
+{
+    m_pull[pin_number] = pull_config;
+}
+
+ret_code_t nrfx_qdec_init(nrfx_qdec_config_t const * p_config,
+                          nrfx_qdec_event_handler_t event_handler)
+{
+    m_qdec.config = *p_config;
+    m_qdec.handler = event_handler;
+    m_qdec.sample_us = 128 << p_config->sampleper;
+    m_qdec.report_samples = m_reportper_samples[p_config->reportper];
+
+    return NRF_SUCCESS;
+}
+
+void nrfx_qdec_enable(void)
+{
+    m_qdec.enabled = true;
+}
+
+ret_code_t app_sched_event_put(void const * p_event_data,
+                               uint16_t event_size,
+                               app_sched_event_handler_t handler)
+{
+    if (m_sched_count == SIM_SCHED_QUEUE_SIZE)
+        return NRF_ERROR_NO_MEM;
+
+    m_sched_queue[(m_sched_head + m_sched_count) % SIM_SCHED_QUEUE_SIZE] = handler;
+    m_sched_count++;
+
+    return NRF_SUCCESS;
+}
+
+void app_sched_execute(void)
+{
+    while (m_sched_count != 0)
+    {
+        app_sched_event_handler_t handler = m_sched_queue[m_sched_head];
+
+        m_sched_head = (m_sched_head + 1) % SIM_SCHED_QUEUE_SIZE;
+        m_sched_count--;
+
+        handler(NULL, 0);
+    }
+}
+
+static void encoder_handler(int16_t detents)
+{
+    if (m_counters.calls != 0)
+        m_counters.min_interval_us = MIN(m_counters.min_interval_us, m_now_us - m_counters.last_call_us);
+
+    m_counters.calls++;
+    m_counters.detents += detents;
+    m_counters.last_call_us = m_now_us;
+
+    sim_log("H", "%d detents", detents);
+}
+
+/* One sample of both inputs as seen at m_now_us */
+static void qdec_sample(void)
+{
+    uint8_t before = m_ab_to_gray[(m_qdec.filtered[0] << 1) | m_qdec.filtered[1]];
+    uint8_t after;
+    uint8_t i;
+
+    for (i = 0; i < 2; i++)
+    {
+        if (!m_qdec.config.dbfen || m_now_us - m_qdec.changed_us[i] >= m_qdec.sample_us)
+            m_qdec.filtered[i] = m_qdec.raw[i];
+    }
+
+    after = m_ab_to_gray[(m_qdec.filtered[0] << 1) | m_qdec.filtered[1]];
+
+    switch ((after - before) & 3)
+    {
+        case 1:
+            m_qdec.acc++;
+            break;
+
+        case 3:
+            m_qdec.acc--;
+            break;
+
+        case 2:
+            m_qdec.accdbl++;
+            break;
+
+        default:
+            break;
+    }
+
+    m_counters.samples++;
+
+    if (++m_qdec.samples < m_qdec.report_samples)
+        return;
+
+    m_qdec.samples = 0;
+
+    if (m_qdec.acc != 0)
+    {
+        nrfx_qdec_event_t event = {
+            .type = NRF_QDEC_EVENT_REPORTRDY,
+            .data.report = { .acc = m_qdec.acc, .accdbl = m_qdec.accdbl }
+        };
+
+        m_qdec.acc = 0;
+        m_qdec.accdbl = 0;
+
+        m_qdec.handler(event);
+    }
+}
+
+/* Plays the edges, samples and main loop runs up to end_us. The main loop
+ * is stalled until stall_us */
+static void sim_run(uint64_t end_us, uint64_t stall_us)
+{
+    uint64_t next_sample_us = m_now_us - m_now_us % m_qdec.sample_us + m_qdec.sample_us;
+    uint64_t next_loop_us = m_now_us - m_now_us % SIM_MAIN_LOOP_US + SIM_MAIN_LOOP_US;
+    uint32_t edge = 0;
+
+    while (m_now_us < end_us)
+    {
+        uint64_t edge_us = edge < m_edges_count ? m_edges[edge].time_us : UINT64_MAX;
+
+        m_now_us = MIN(MIN(edge_us, next_sample_us), MIN(next_loop_us, end_us));
+
+        if (m_now_us == edge_us)
+        {
+            sim_edge_t const *e = &m_edges[edge++];
+
+            if (m_qdec.raw[e->input] != e->level)
+            {
+                m_qdec.raw[e->input] = e->level;
+                m_qdec.changed_us[e->input] = m_now_us;
+                m_counters.edges++;
+            }
+            continue;
+        }
+
+        if (m_now_us == next_sample_us)
+        {
+            qdec_sample();
+            next_sample_us += m_qdec.sample_us;
+        }
+
+        if (m_now_us == next_loop_us)
+        {
+            if (m_now_us >= stall_us)
+                app_sched_execute();
+
+            next_loop_us += SIM_MAIN_LOOP_US;
+        }
+    }
+
+    m_edges_count = 0;
+}
+
+static void edge_add(uint64_t time_us, uint8_t input, uint8_t level)
+{
+    sim_edge_t *e;
+    uint32_t i = m_edges_count++;
+
+    /* Kept sorted, bounces are added behind later edges of the other input */
+    while (i > 0 && m_edges[i - 1].time_us > time_us)
+    {
+        m_edges[i] = m_edges[i - 1];
+        i--;
+    }
+
+    e = &m_edges[i];
+    e->time_us = time_us;
+    e->input = input;
+    e->level = level;
+}
+
+/* Steps the knob from its current position, one step every step_us. An
+ * edge bounces up to bounces times before it settles */
+static void steps_add(uint64_t start_us, int32_t steps, uint32_t step_us, uint8_t bounces)
+{
+    static uint8_t position; /* gray code of the last step added */
+    int32_t i;
+
+    for (i = 0; i < abs(steps); i++)
+    {
+        uint64_t time_us = start_us + (uint64_t) (i + 1) * step_us;
+        uint8_t from = m_gray_to_ab[position];
+        uint8_t to;
+        uint8_t input;
+        uint8_t b;
+
+        position = (position + (steps > 0 ? 1 : 3)) & 3;
+        to = m_gray_to_ab[position];
+        input = (from ^ to) == 0x2 ? 0 : 1;
+
+        for (b = 0; b < bounces; b++)
+        {
+            uint32_t bounce_us = SIM_BOUNCE_SPAN_US * (bounces - b) / (bounces + 1);
+
+            edge_add(time_us - bounce_us, input, (to >> (1 - input)) & 1);
+            edge_add(time_us - bounce_us + bounce_us / 4, input, (from >> (1 - input)) & 1);
+        }
+
+        edge_add(time_us, input, (to >> (1 - input)) & 1);
+    }
+}
+
+static void counters_reset(void)
+{
+    memset(&m_counters, 0, sizeof(m_counters));
+    m_counters.min_interval_us = UINT64_MAX;
+}
+
+static bool check(char const *name, bool ok, char const *what)
+{
+    printf("%-22s %s  (%llu edges, %llu samples, %u handler calls, %d detents) %s\n",
+           name, ok ? "ok" : "FAILED",
+           (unsigned long long) m_counters.edges,
+           (unsigned long long) m_counters.samples,
+           m_counters.calls, m_counters.detents, what);
+
+    return ok;
+}
+
+static uint32_t report_us(void)
+{
+    return m_qdec.sample_us * m_qdec.report_samples;
+}
+
+/* Handler calls wait for the next main loop run after their report */
+static bool calls_apart(void)
+{
+    return m_counters.calls < 2 || m_counters.min_interval_us + SIM_MAIN_LOOP_US >= report_us();
+}
+
+static bool scripts_run(void)
+{
+    uint32_t const detent_steps = ENCODER_STEPS_PER_DETENT;
+    encoder_stats_t before;
+    encoder_stats_t after;
+    bool ok = true;
+
+    counters_reset();
+    steps_add(m_now_us, detent_steps, 10000, 0);
+    sim_run(m_now_us + 200000, 0);
+    ok = ok && check("one detent", m_counters.detents == 1 && m_counters.calls == 1, "1 detent");
+
+    counters_reset();
+    steps_add(m_now_us, -3 * detent_steps, 8000, 3);
+    sim_run(m_now_us + 300000, 0);
+    ok = ok && check("bouncy turn back", m_counters.detents == -3, "-3 detents");
+
+    counters_reset();
+    encoder_stats_get(&before);
+    sim_run(m_now_us + 10000000, 0);
+    encoder_stats_get(&after);
+    ok = ok && check("rest", after.reports == before.reports && m_counters.samples > 0,
+                     "no report, no interrupt");
+
+    counters_reset();
+    steps_add(m_now_us, detent_steps / 2, 15000, 2);
+    steps_add(m_now_us + 15000 * detent_steps / 2, -(int32_t) detent_steps / 2, 15000, 2);
+    sim_run(m_now_us + 300000, 0);
+    ok = ok && check("jiggle", m_counters.calls == 0, "half a detent and back, nothing");
+
+    counters_reset();
+    steps_add(m_now_us, 12 * detent_steps, 6000, 1);
+    sim_run(m_now_us + 12 * detent_steps * 6000 + 2 * report_us(), 0);
+    ok = ok && check("steady spin", m_counters.detents == 12 && calls_apart(),
+                     "12 detents, a call per report at most");
+
+    counters_reset();
+    steps_add(m_now_us, 12 * detent_steps, 6000, 1);
+    sim_run(m_now_us + 12 * detent_steps * 6000 + 2 * report_us(),
+            m_now_us + 12 * detent_steps * 6000 + report_us());
+    ok = ok && check("busy main loop", m_counters.detents == 12 && m_counters.calls == 1,
+                     "the reports of the stall are merged into one call");
+
+    counters_reset();
+    encoder_stats_get(&before);
+    steps_add(m_now_us, 24 * detent_steps, m_qdec.sample_us * 3 / 5, 0);
+    sim_run(m_now_us + 24 * detent_steps * m_qdec.sample_us * 3 / 5 + 2 * report_us(), 0);
+    encoder_stats_get(&after);
+    ok = ok && check("too fast", m_counters.detents < 24,
+                     "steps shorter than a sample are lost");
+    printf("                       %u double transitions, %d of 24 detents seen\n",
+           after.double_steps - before.double_steps, m_counters.detents);
+
+    /* Turn back the steps short of a detent the lost ones left in the encoder */
+    steps_add(m_now_us, -((after.steps - before.steps) % (int32_t) detent_steps), 10000, 0);
+    sim_run(m_now_us + 200000, 0);
+
+    return ok;
+}
+
+static uint32_t random_range(uint32_t min, uint32_t max)
+{
+    return min + (uint32_t) (rand() % (max - min + 1));
+}
+
+/* Turns of whole detents in both directions with pauses between them, each
+ * step long enough for the sampling and the filter */
+static bool random_run(uint32_t count)
+{
+    uint32_t min_step_us = 3 * m_qdec.sample_us + SIM_BOUNCE_SPAN_US;
+    encoder_stats_t before;
+    encoder_stats_t after;
+    uint64_t edges = 0;
+    uint64_t samples = 0;
+    uint64_t turned_total = 0;
+    uint32_t calls = 0;
+    uint32_t n;
+
+    encoder_stats_get(&before);
+
+    for (n = 0; n < count; n++)
+    {
+        uint8_t turns = random_range(1, 6);
+        int32_t turned = 0;
+        uint64_t t = m_now_us;
+        uint8_t i;
+
+        counters_reset();
+
+        for (i = 0; i < turns; i++)
+        {
+            int32_t detents = (int32_t) random_range(1, 24) * (random_range(0, 1) ? 1 : -1);
+            uint32_t step_us = random_range(min_step_us, 60000);
+
+            if (m_edges_count + abs(detents) * ENCODER_STEPS_PER_DETENT * 7 > SIM_MAX_EDGES)
+                break;
+
+            steps_add(t, detents * ENCODER_STEPS_PER_DETENT, step_us, random_range(0, 3));
+
+            t += (uint64_t) abs(detents) * ENCODER_STEPS_PER_DETENT * step_us + random_range(0, 1500000);
+            turned += detents;
+            turned_total += abs(detents);
+        }
+
+        sim_run(t + 2 * report_us(), 0);
+
+        if (m_counters.detents != turned)
+        {
+            printf("random trace %u: %d detents instead of %d\n", n, m_counters.detents, turned);
+            return false;
+        }
+
+        if (!calls_apart())
+        {
+            printf("random trace %u: handler calls %llu us apart, reports are %u us\n",
+                   n, (unsigned long long) m_counters.min_interval_us, report_us());
+            return false;
+        }
+
+        edges += m_counters.edges;
+        samples += m_counters.samples;
+        calls += m_counters.calls;
+    }
+
+    encoder_stats_get(&after);
+
+    if (after.double_steps != before.double_steps)
+    {
+        printf("random traces: %u double transitions\n", after.double_steps - before.double_steps);
+        return false;
+    }
+
+    printf("%u random traces ok: %llu detents, %llu edges, %llu samples\n",
+           count, (unsigned long long) turned_total,
+           (unsigned long long) edges, (unsigned long long) samples);
+    printf("%u report interrupts, %u handler calls, %u queue full\n",
+           after.reports - before.reports, calls, after.queue_full - before.queue_full);
+    printf("per detent: %.2f interrupts, %.1f with one per edge\n",
+           (double) (after.reports - before.reports) / turned_total,
+           (double) edges / turned_total);
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t count = 1000;
+    unsigned int seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "vn:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'v':
+                m_verbose = true;
+                break;
+
+            case 'n':
+                count = strtoul(optarg, NULL, 0);
+                break;
+
+            case 'r':
+                seed = strtoul(optarg, NULL, 0);
+                break;
+
+            default:
+                fprintf(stderr, "usage: %s [-v] [-n traces] [-r seed]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    srand(seed);
+
+    m_qdec.raw[0] = m_qdec.raw[1] = 1;
+    m_qdec.filtered[0] = m_qdec.filtered[1] = 1;
+
+    if (encoder_init(encoder_handler) != NRF_SUCCESS || !m_qdec.enabled)
+    {
+        printf("encoder_init failed\n");
+        return 1;
+    }
+
+    if (!m_qdec.config.dbfen ||
+        m_pull[m_qdec.config.psela] != NRF_GPIO_PIN_PULLUP ||
+        m_pull[m_qdec.config.pselb] != NRF_GPIO_PIN_PULLUP)
+    {
+        printf("QDEC inputs are not pulled up and filtered\n");
+        return 1;
+    }
+
+    printf("QDEC: a sample every %u us, a report every %u samples (%.1f ms)\n",
+           m_qdec.sample_us, m_qdec.report_samples, report_us() / 1000.0);
+
+    if (!scripts_run() || !random_run(count))
+    {
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,106 @@
+/* Host build of the encoder module: the harness models the QDEC registers
+ * behind these calls and raises REPORTRDY like the peripheral */
+#ifndef NRFX_QDEC_H__
+#define NRFX_QDEC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sdk_errors.h"
+
+typedef enum
+{
+    NRF_QDEC_EVENT_SAMPLERDY,
+    NRF_QDEC_EVENT_REPORTRDY,
+    NRF_QDEC_EVENT_ACCOF
+} nrf_qdec_event_t;
+
+typedef enum
+{
+    NRF_QDEC_REPORTPER_10 = 0,
+    NRF_QDEC_REPORTPER_40,
+    NRF_QDEC_REPORTPER_80,
+    NRF_QDEC_REPORTPER_120,
+    NRF_QDEC_REPORTPER_160,
+    NRF_QDEC_REPORTPER_200,
+    NRF_QDEC_REPORTPER_240,
+    NRF_QDEC_REPORTPER_280,
+    NRF_QDEC_REPORTPER_DISABLED
+} nrf_qdec_reportper_t;
+
+typedef enum
+{
+    NRF_QDEC_SAMPLEPER_128us = 0,
+    NRF_QDEC_SAMPLEPER_256us,
+    NRF_QDEC_SAMPLEPER_512us,
+    NRF_QDEC_SAMPLEPER_1024us,
+    NRF_QDEC_SAMPLEPER_2048us,
+    NRF_QDEC_SAMPLEPER_4096us,
+    NRF_QDEC_SAMPLEPER_8192us,
+    NRF_QDEC_SAMPLEPER_16384us
+} nrf_qdec_sampleper_t;
+
+typedef enum
+{
+    NRF_QDEC_LEPOL_ACTIVE_LOW = 0,
+    NRF_QDEC_LEPOL_ACTIVE_HIGH
+} nrf_qdec_ledpol_t;
+
+#define NRF_QDEC_LED_NOT_CONNECTED 0xFFFFFFFF
+
+typedef struct
+{
+    nrf_qdec_reportper_t reportper;
+    nrf_qdec_sampleper_t sampleper;
+    uint32_t psela;
+    uint32_t pselb;
+    uint32_t pselled;
+    uint32_t ledpre;
+    nrf_qdec_ledpol_t ledpol;
+    bool dbfen;
+    bool sample_inten;
+    uint8_t interrupt_priority;
+} nrfx_qdec_config_t;
+
+#define NRFX_QDEC_DEFAULT_CONFIG                    \
+{                                                   \
+    .reportper = NRF_QDEC_REPORTPER_10,             \
+    .sampleper = NRF_QDEC_SAMPLEPER_16384us,        \
+    .psela = NRF_QDEC_LED_NOT_CONNECTED,            \
+    .pselb = NRF_QDEC_LED_NOT_CONNECTED,            \
+    .pselled = NRF_QDEC_LED_NOT_CONNECTED,          \
+    .ledpre = 511,                                  \
+    .ledpol = NRF_QDEC_LEPOL_ACTIVE_HIGH,           \
+    .dbfen = false,                                 \
+    .sample_inten = false,                          \
+    .interrupt_priority = 6                         \
+}
+
+typedef struct
+{
+    int16_t acc;
+    uint16_t accdbl;
+} nrfx_qdec_report_event_t;
+
+typedef struct
+{
+    int8_t value;
+} nrfx_qdec_sample_data_evt_t;
+
+typedef struct
+{
+    nrf_qdec_event_t type;
+    union
+    {
+        nrfx_qdec_sample_data_evt_t sample;
+        nrfx_qdec_report_event_t report;
+    } data;
+} nrfx_qdec_event_t;
+
+typedef void (*nrfx_qdec_event_handler_t)(nrfx_qdec_event_t event);
+
+ret_code_t nrfx_qdec_init(nrfx_qdec_config_t const * p_config,
+                          nrfx_qdec_event_handler_t event_handler);
+void nrfx_qdec_enable(void);
+
+#endif /* NRFX_QDEC_H__ */
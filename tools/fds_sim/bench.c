@@ -0,0 +1,650 @@
+/*
+ * Persistence benchmark: replays LED write-rate profiles against
+ * lib/led_storage.c running on the RAM-backed flash model in sim.c and
+ * sim_fds.c, and reports what each profile costs in flash wear and latency.
+ *
+ * Build and run from this directory:
+ *   gcc -std=gnu99 -O2 -Wall -DUSE_APP_CONFIG -Iinclude -I. -I../../lib -I../../config \
+ *       bench.c sim.c sim_fds.c ../../lib/led_storage.c ../../lib/led_record.c -o fds_bench
+ *   ./fds_bench [-v] [profile]
+ *
+ * The build uses the FDS geometry from config/led_storage_sizing.h and the
+ * queue size from config/sdk_config.h, so changes there show up in the numbers.
+ * "pwm max" is the write-to-PWM latency: how long a change waits for the
+ * CPU that a flash write or erase halts.
+ *
+ * With -DLED_STORAGE_JOURNAL_ENABLED=1, plus sim_fstorage.c, led_journal.c and
+ * the linker symbols described in sim_fstorage.c, the state goes to the journal
+ * instead. journal_bench.sh builds both and compares them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "sim.h"
+
+#include "led_storage.h"
+#include "led_record.h"
+
+#if LED_STORAGE_JOURNAL_ENABLED
+#include "led_journal.h"
+#endif
+
+/* Same as in led_storage.c */
+#define BENCH_LED_FILE_ID 0xBEEF
+#define BENCH_LED_RECORD_KEY 0xBABE
+
+/* Another FDS user, like Peer Manager, updating a few records of its own */
+#define BENCH_OTHER_FILE_ID 0x1000
+#define BENCH_OTHER_RECORDS 4
+
+#define BENCH_SEC(s) ((uint64_t) (s) * 1000000)
+#define BENCH_MS(ms) ((uint64_t) (ms) * 1000)
+
+typedef struct {
+    char const *name;
+    char const *description;
+    void (*run)(void);
+    bool timeline; /* list every garbage collection after the summary */
+} bench_profile_t;
+
+static led_params_t m_state;
+static uint32_t m_changes;
+
+static uint32_t m_other_data[BENCH_OTHER_RECORDS][8];
+static uint32_t m_other_rejected;
+
+/* Every change writes its sequence number into the color, so a completed
+ * write tells which changes it carried */
+#define BENCH_MAX_CHANGES 65536
+
+static uint64_t m_change_us[BENCH_MAX_CHANGES];
+static uint32_t m_changes_persisted;
+static uint64_t m_lag_total_us;
+static uint64_t m_lag_max_us;
+
+/* Write-to-PWM latency: a change is applied as soon as the CPU runs,
+ * unless a flash write or erase has halted it */
+static uint64_t m_pwm_total_us;
+static uint64_t m_pwm_max_us;
+static uint32_t m_pwm_stalled;
+
+#define BENCH_MAX_GC_LOG 64
+
+typedef struct {
+    uint64_t done_us;
+    uint64_t queued_us;
+    uint64_t since_change_us; /* how long the user had been idle when it was queued */
+} bench_gc_log_t;
+
+static bench_gc_log_t m_gc_log[BENCH_MAX_GC_LOG];
+static uint32_t m_gc_log_count;
+
+static bool flash_state_get(led_params_t *params)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_flash_record_t flash_record;
+    bool migrated;
+    bool found = false;
+
+    memset(&record_token, 0, sizeof(record_token));
+
+    if (NRF_SUCCESS == fds_record_find(BENCH_LED_FILE_ID,
+                                       BENCH_LED_RECORD_KEY,
+                                       &record_desc,
+                                       &record_token) &&
+        NRF_SUCCESS == fds_record_open(&record_desc, &flash_record))
+    {
+        found = led_record_decode(flash_record.p_data,
+                                  flash_record.p_header->length_words,
+                                  params,
+                                  &migrated);
+        fds_record_close(&record_desc);
+    }
+
+    return found;
+}
+
+static uint32_t state_sequence(led_params_t const *params)
+{
+    return params->color.r | (params->color.g << 8) | ((uint32_t) params->color.b << 16);
+}
+
+static void changes_persisted_set(uint32_t sequence)
+{
+    sequence = MIN(sequence, m_changes);
+
+    while (m_changes_persisted < sequence)
+    {
+        uint64_t lag = sim_now_us() - m_change_us[m_changes_persisted % BENCH_MAX_CHANGES];
+
+        m_lag_total_us += lag;
+        m_lag_max_us = MAX(m_lag_max_us, lag);
+        m_changes_persisted++;
+    }
+}
+
+#if LED_STORAGE_JOURNAL_ENABLED
+/* Journal entries are 4-bit field id | 4-bit check | 24-bit value, and field 1
+ * is the color as 0xRRGGBB (see led_journal.c). Headers never use field 1 */
+#define BENCH_JOURNAL_FIELD_COLOR 1
+
+static void bench_journal_observer(uint32_t const *p_words, uint32_t count)
+{
+    led_params_t persisted;
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((p_words[i] >> 28) == BENCH_JOURNAL_FIELD_COLOR)
+        {
+            persisted.color.r = p_words[i] >> 16;
+            persisted.color.g = p_words[i] >> 8;
+            persisted.color.b = p_words[i];
+
+            changes_persisted_set(state_sequence(&persisted));
+        }
+    }
+}
+#endif
+
+static void gc_log_add(void)
+{
+    bench_gc_log_t *entry;
+
+    if (m_gc_log_count == BENCH_MAX_GC_LOG)
+    {
+        return;
+    }
+
+    entry = &m_gc_log[m_gc_log_count++];
+
+    entry->done_us = sim_now_us();
+    entry->queued_us = sim_fds_event_queued_us();
+    entry->since_change_us = 0;
+
+    if (m_changes > 0)
+    {
+        uint64_t last_change_us = m_change_us[(m_changes - 1) % BENCH_MAX_CHANGES];
+
+        entry->since_change_us = entry->queued_us - MIN(entry->queued_us, last_change_us);
+    }
+}
+
+static void bench_fds_handler(fds_evt_t const * p_evt)
+{
+    led_params_t persisted;
+
+    if (p_evt->id == FDS_EVT_GC)
+    {
+        gc_log_add();
+        return;
+    }
+
+    if ((p_evt->id != FDS_EVT_WRITE && p_evt->id != FDS_EVT_UPDATE) ||
+        p_evt->write.file_id != BENCH_LED_FILE_ID ||
+        p_evt->result != NRF_SUCCESS ||
+        !flash_state_get(&persisted))
+    {
+        return;
+    }
+
+    /* Time from each change to the completed write that made it durable */
+    changes_persisted_set(state_sequence(&persisted));
+}
+
+static void on_load(led_params_t const *params)
+{
+    if (params != NULL)
+    {
+        m_state = *params;
+    }
+}
+
+static void led_change_commit(void)
+{
+    uint64_t now = sim_now_us();
+    uint64_t pwm_us = sim_flash_stall_end_us(now) - now;
+
+    m_pwm_total_us += pwm_us;
+    m_pwm_max_us = MAX(m_pwm_max_us, pwm_us);
+    m_pwm_stalled += (pwm_us > 0);
+
+    m_change_us[m_changes % BENCH_MAX_CHANGES] = now;
+    m_changes++;
+
+    m_state.color.r = m_changes;
+    m_state.color.g = m_changes >> 8;
+    m_state.color.b = m_changes >> 16;
+
+    led_storage_mark_dirty(&m_state);
+}
+
+static void led_change(void)
+{
+    led_change_commit();
+}
+
+static void led_toggle(void)
+{
+    m_state.state = !m_state.state;
+    led_change_commit();
+}
+
+static void other_user_burst(void)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_record_t record;
+    ret_code_t ret_code;
+    int i;
+
+    for (i = 0; i < BENCH_OTHER_RECORDS; i++)
+    {
+        m_other_data[i][0]++;
+
+        record.file_id = BENCH_OTHER_FILE_ID;
+        record.key = i + 1;
+        record.data.p_data = m_other_data[i];
+        record.data.length_words = ARRAY_SIZE(m_other_data[i]);
+
+        memset(&record_token, 0, sizeof(record_token));
+
+        if (NRF_SUCCESS == fds_record_find(BENCH_OTHER_FILE_ID, i + 1, &record_desc, &record_token))
+        {
+            ret_code = fds_record_update(&record_desc, &record);
+        }
+        else
+        {
+            ret_code = fds_record_write(&record_desc, &record);
+        }
+
+        m_other_rejected += (ret_code != NRF_SUCCESS);
+
+        if (ret_code == FDS_ERR_NO_SPACE_IN_FLASH)
+        {
+            /* Peer Manager collects garbage itself when it runs out of space */
+            fds_gc();
+        }
+    }
+}
+
+/* Same calls as estc_service.c makes on GAP events */
+static void link_connect(void)
+{
+    led_storage_link_state_set(true);
+}
+
+static void link_disconnect(void)
+{
+    led_storage_commit();
+    led_storage_link_state_set(false);
+}
+
+static void wait_until(uint64_t time_us)
+{
+    sim_run_until(time_us);
+}
+
+static void profile_slider(void)
+{
+    uint64_t t = sim_now_us();
+    int minute;
+    int i;
+
+    link_connect();
+
+    for (minute = 0; minute < 60; minute++)
+    {
+        /* A 3 second drag, one write every 30 ms, once a minute */
+        for (i = 0; i < 100; i++)
+        {
+            wait_until(t + BENCH_MS(30 * i));
+            led_change();
+        }
+
+        t += BENCH_SEC(60);
+    }
+
+    wait_until(t);
+    link_disconnect();
+}
+
+static void profile_steady(void)
+{
+    uint64_t t = sim_now_us();
+    int i;
+
+    link_connect();
+
+    for (i = 0; i < 1800; i++)
+    {
+        wait_until(t + BENCH_SEC(2) * i);
+        led_change();
+    }
+
+    link_disconnect();
+}
+
+static void profile_wear(void)
+{
+    uint64_t t = sim_now_us();
+    int i;
+
+    link_connect();
+
+    /* Long enough for both paths to reach their steady erase rate */
+    for (i = 0; i < 21600; i++)
+    {
+        wait_until(t + BENCH_SEC(2) * i);
+        led_change();
+    }
+
+    link_disconnect();
+}
+
+static void profile_sessions(void)
+{
+    uint64_t t = sim_now_us();
+    int session;
+    int i;
+
+    for (session = 0; session < 12; session++)
+    {
+        /* Connect, toggle the LED ten times, disconnect, every 5 minutes */
+        wait_until(t);
+        link_connect();
+
+        for (i = 0; i < 10; i++)
+        {
+            wait_until(t + BENCH_SEC(1) * (i + 1));
+            led_toggle();
+        }
+
+        wait_until(t + BENCH_SEC(12));
+        link_disconnect();
+
+        t += BENCH_SEC(300);
+    }
+
+    wait_until(t);
+}
+
+static void profile_rare(void)
+{
+    uint64_t t = sim_now_us();
+    int i;
+
+    for (i = 0; i < 6; i++)
+    {
+        /* One change per short session every 10 minutes */
+        wait_until(t);
+        link_connect();
+
+        wait_until(t + BENCH_SEC(1));
+        led_change();
+
+        wait_until(t + BENCH_SEC(2));
+        link_disconnect();
+
+        t += BENCH_SEC(600);
+    }
+
+    wait_until(t);
+}
+
+static void profile_stress(void)
+{
+    uint64_t t = sim_now_us();
+    int i;
+
+    link_connect();
+
+    /* A change every 100 ms for an hour: only the flush deadline stops the writes */
+    for (i = 0; i < 36000; i++)
+    {
+        wait_until(t + BENCH_MS(100) * i);
+        led_change();
+    }
+
+    link_disconnect();
+}
+
+static void profile_contention(void)
+{
+    uint64_t t = sim_now_us();
+    int i;
+
+    link_connect();
+
+    /* A change every 250 ms while another user fills the FDS queue every second */
+    for (i = 0; i < 2400; i++)
+    {
+        wait_until(t + BENCH_MS(250) * i);
+
+        if (i % 4 == 0)
+        {
+            other_user_burst();
+        }
+
+        led_change();
+    }
+
+    link_disconnect();
+}
+
+static void profile_timeline(void)
+{
+    uint64_t t = sim_now_us();
+    int burst;
+    int i;
+
+    link_connect();
+
+    /* Bursts of 20 changes 1.2 s apart, each one saved, with 8 s pauses
+     * that garbage collection can go into, for 32 minutes */
+    for (burst = 0; burst < 60; burst++)
+    {
+        for (i = 0; i < 20; i++)
+        {
+            wait_until(t + BENCH_MS(1200) * i);
+            led_change();
+        }
+
+        t += BENCH_MS(1200) * 20 + BENCH_SEC(8);
+    }
+
+    wait_until(t);
+    link_disconnect();
+}
+
+static bench_profile_t const m_profiles[] = {
+    { "slider",   "3 s slider drag (33 changes/s) once a minute, connected", profile_slider },
+    { "steady",   "a change every 2 s, connected",                           profile_steady },
+    { "wear",     "a change every 2 s for 12 hours, connected",              profile_wear },
+    { "sessions", "10 toggles per 12 s session every 5 min",                 profile_sessions },
+    { "rare",     "one change per short session every 10 min",               profile_rare },
+    { "stress",   "a change every 100 ms, connected",                        profile_stress },
+    { "contention", "a change every 250 ms, another FDS user bursts 4 updates/s", profile_contention },
+    { "timeline", "24 s bursts of saves every 32 s, connected, lists the GC runs", profile_timeline, true },
+};
+
+static void report_header(void)
+{
+    printf("%-10s %7s %6s %7s %7s %6s %4s %4s %9s %9s %9s %9s %8s %8s %8s %5s %4s %s\n",
+           "profile", "changes", "saves", "skipped", "words",
+           "erases", "max", "gc",
+           "wr avg", "wr p99", "wr max", "gc max", "pwm max",
+           "lag avg", "lag max", "lost", "viol", "restore");
+    printf("%-10s %7s %6s %7s %7s %6s %4s %4s %9s %9s %9s %9s %8s %8s %8s %5s %4s\n",
+           "", "", "", "", "written",
+           "", "page", "runs",
+           "ms", "ms", "ms", "ms", "ms",
+           "s", "s", "", "");
+}
+
+static void bench_run(bench_profile_t const *profile)
+{
+    led_storage_stats_t stats;
+    sim_stats_t sim;
+    sim_latency_t write_latency;
+    sim_latency_t gc_latency;
+    led_params_t restored;
+    uint32_t erases = 0;
+    uint32_t max_erases = 0;
+    bool restore_ok;
+    int i;
+
+    sim_reset(&sim_nrf52840_timing);
+
+    led_storage_init(on_load, NULL);
+    fds_register(bench_fds_handler);
+#if LED_STORAGE_JOURNAL_ENABLED
+    sim_raw_write_observer_set(bench_journal_observer);
+#endif
+    sim_run_idle();
+
+    profile->run();
+
+    sim_run_idle();
+
+    led_storage_stats_get(&stats);
+    sim_stats_get(&sim);
+    sim_latency_get(sim_op_write, &write_latency);
+    sim_latency_get(sim_op_gc, &gc_latency);
+
+    for (i = 0; i < FDS_PHY_PAGES; i++)
+    {
+        erases += sim.page_erases[i];
+        max_erases = MAX(max_erases, sim.page_erases[i]);
+    }
+
+    for (i = 0; i < SIM_RAW_PAGES; i++)
+    {
+        erases += sim.raw_page_erases[i];
+        max_erases = MAX(max_erases, sim.raw_page_erases[i]);
+    }
+
+    /* Reset the device and check what it would boot with */
+    sim_reboot();
+    fds_init();
+    sim_run_idle();
+
+#if LED_STORAGE_JOURNAL_ENABLED
+    restore_ok = led_journal_load(&restored) &&
+                 0 == memcmp(&restored, &m_state, sizeof(led_params_t));
+#else
+    restore_ok = flash_state_get(&restored) &&
+                 0 == memcmp(&restored, &m_state, sizeof(led_params_t));
+#endif
+
+    printf("%-10s %7u %6u %7u %7u %6u %4u %4u %9.2f %9.2f %9.2f %9.2f %8.2f %8.2f %8.2f %5u %4u %s\n",
+           profile->name,
+           m_changes,
+           stats.writes_saved,
+           stats.writes_skipped,
+           sim.words_written,
+           erases,
+           max_erases,
+           sim.gc_runs,
+           write_latency.avg_us / 1000.0,
+           write_latency.p99_us / 1000.0,
+           write_latency.max_us / 1000.0,
+           gc_latency.max_us / 1000.0,
+           m_pwm_max_us / 1000.0,
+           m_changes_persisted ? m_lag_total_us / 1000000.0 / m_changes_persisted : 0.0,
+           m_lag_max_us / 1000000.0,
+           m_changes - m_changes_persisted,
+           sim.bit_set_violations + sim.buffer_changes + sim.timer_errors,
+           restore_ok ? "ok" : "LOST");
+
+    if (sim.queue_full || sim.no_space || sim.timer_errors ||
+        sim.bit_set_violations || sim.buffer_changes)
+    {
+        printf("           queue full %u, no space %u, timer errors %u, "
+               "bit-set writes %u, buffers changed %u, retried %u, other user rejected %u\n",
+               sim.queue_full, sim.no_space, sim.timer_errors,
+               sim.bit_set_violations, sim.buffer_changes,
+               stats.writes_retried, m_other_rejected);
+    }
+
+    if (m_pwm_stalled)
+    {
+        printf("           %u of %u changes waited for the flash, %.2f ms on average\n",
+               m_pwm_stalled, m_changes, m_pwm_total_us / 1000.0 / m_pwm_stalled);
+    }
+
+    if (profile->timeline)
+    {
+        for (i = 0; i < m_gc_log_count; i++)
+        {
+            printf("           gc %2d at %8.2f s, queued %.2f s after the last change, took %.2f ms\n",
+                   i + 1,
+                   m_gc_log[i].done_us / 1000000.0,
+                   m_gc_log[i].since_change_us / 1000000.0,
+                   (m_gc_log[i].done_us - m_gc_log[i].queued_us) / 1000.0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char const *only = NULL;
+    int failures = 0;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-v"))
+        {
+            sim_log_enable(true);
+        }
+        else
+        {
+            only = argv[i];
+        }
+    }
+
+    for (i = 0; i < ARRAY_SIZE(m_profiles); i++)
+    {
+        printf("%-10s %s\n", m_profiles[i].name, m_profiles[i].description);
+    }
+
+    printf("\n");
+    report_header();
+
+    for (i = 0; i < ARRAY_SIZE(m_profiles); i++)
+    {
+        pid_t pid;
+        int status;
+
+        if (only != NULL && 0 != strcmp(only, m_profiles[i].name))
+        {
+            continue;
+        }
+
+        /* led_storage.c keeps its state in statics, every profile gets a fresh process */
+        fflush(stdout);
+        pid = fork();
+
+        if (pid == 0)
+        {
+            bench_run(&m_profiles[i]);
+            fflush(stdout);
+            _exit(0);
+        }
+
+        waitpid(pid, &status, 0);
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            printf("%-10s crashed\n", m_profiles[i].name);
+            failures++;
+        }
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,780 @@
+/*
+ * FDS sizing: replays a write trace against lib/led_storage.c on the flash
+ * model and reports the wear, latency and integrity of one FDS geometry.
+ * fds_size.sh builds it once for every candidate page count and GC threshold,
+ * collects the results and lets "fds_size -R" pick the configuration that
+ * reaches the lifetime target with the fewest pages.
+ *
+ * Build and run a single candidate from this directory:
+ *   gcc -std=gnu99 -O2 -Wall -DUSE_APP_CONFIG -Iinclude -I. -I../../lib -I../../config \
+ *       [-DFDS_VIRTUAL_PAGES=4] [-DLED_STORAGE_GC_FREEABLE_LIMIT_WORDS=512] \
+ *       fds_size.c sim.c sim_fds.c ../../lib/led_storage.c ../../lib/led_record.c -o fds_size
+ *   ./fds_size [-t trace | -s changes[:sessions[:peers]]] [-d days] [-y years]
+ *
+ * Trace format, one event per line, '#' starts a comment:
+ *   <ms> connect
+ *   <ms> disconnect
+ *   <ms> led [r g b state]     LED change, a new color if no values are given
+ *   <ms> toggle                LED switched on or off
+ *   <ms> other <key> <words>   another FDS user (Peer Manager) writes a record
+ * A trace shorter than the simulated period is repeated.
+ *
+ * The synthetic workload (-s) spreads the daily LED changes over the daily
+ * sessions, one every 300 ms, and models the Peer Manager of the bonded peers:
+ * bonding data once, the peer rank and the GATT database on every connection.
+ * All preset slots are taken, so their records count against the free space.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+
+#include "led_storage.h"
+#include "led_presets.h"
+#include "led_record.h"
+
+/* Same as in led_storage.c */
+#define SIZE_FLASH_ENDURANCE_CYCLES 10000
+
+/* Same as in led_journal.c: two pages of one-word entries behind a header,
+ * every compaction starts the other page with a three-word snapshot */
+#define SIZE_JOURNAL_PAGES 2
+#define SIZE_JOURNAL_PAGE_WORDS 1024
+#define SIZE_JOURNAL_ENTRIES_PER_PAGE (SIZE_JOURNAL_PAGE_WORDS - 1 - 3)
+
+/* Same as in led_presets.c */
+#define SIZE_PRESETS_FILE_ID 0xBEF1
+
+/* Peer Manager stores every peer in its own file, sizes of nRF5 SDK 17 */
+#define SIZE_PEER_FILE_ID_BASE 0xC000
+#define SIZE_PEER_BONDING_WORDS 20
+#define SIZE_PEER_RANK_WORDS 1
+#define SIZE_PEER_GATT_WORDS 4
+
+#define SIZE_DAY_MS (24ULL * 3600 * 1000)
+#define SIZE_CHANGE_INTERVAL_MS 300
+#define SIZE_SESSION_TAIL_MS 10000
+
+#define SIZE_RESULT_FIELDS 15
+#define SIZE_MAX_RESULTS 256
+#define SIZE_LIFETIME_CAP_YEARS 999.0
+
+typedef enum {
+    size_evt_connect,
+    size_evt_disconnect,
+    size_evt_led,
+    size_evt_toggle,
+    size_evt_other
+} size_evt_type_t;
+
+typedef struct {
+    uint64_t time_ms;
+    size_evt_type_t type;
+    bool has_params;
+    led_params_t params;
+    uint16_t file_id;
+    uint16_t key;
+    uint16_t words;
+} size_evt_t;
+
+typedef struct {
+    uint32_t pages;
+    uint32_t gc_limit_words;
+    uint32_t gc_floor_words;
+    double days;
+    uint32_t changes;
+    uint32_t saves;
+    uint32_t erases_max;
+    uint32_t gc_runs;
+    double lifetime_years;
+    double write_p99_ms;
+    double gc_max_ms;
+    uint32_t journal_entries;
+    double journal_years;
+    uint32_t failures;
+    uint32_t restore_ok;
+} size_result_t;
+
+static size_evt_t *m_trace;
+static size_t m_trace_len;
+static size_t m_trace_cap;
+static uint64_t m_trace_span_ms;
+
+static led_params_t m_state = { .brightness = LED_BRIGHTNESS_MAX };
+static led_params_t m_persisted;
+static bool m_persisted_valid;
+static uint32_t m_changes;
+static uint32_t m_journal_entries;
+static uint32_t m_other_failed;
+
+/* Source of all Peer Manager writes, never changed while a write is queued */
+static uint32_t const m_other_data[SIZE_PEER_BONDING_WORDS];
+
+static size_evt_t * trace_add(uint64_t time_ms, size_evt_type_t type)
+{
+    size_evt_t *evt;
+
+    if (m_trace_len == m_trace_cap)
+    {
+        m_trace_cap = m_trace_cap ? m_trace_cap * 2 : 1024;
+        m_trace = realloc(m_trace, m_trace_cap * sizeof(size_evt_t));
+
+        if (m_trace == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    evt = &m_trace[m_trace_len++];
+    memset(evt, 0, sizeof(size_evt_t));
+    evt->time_ms = time_ms;
+    evt->type = type;
+
+    m_trace_span_ms = MAX(m_trace_span_ms, time_ms);
+
+    return evt;
+}
+
+static void trace_add_other(uint64_t time_ms, uint16_t file_id, uint16_t key, uint16_t words)
+{
+    size_evt_t *evt = trace_add(time_ms, size_evt_other);
+
+    evt->file_id = file_id;
+    evt->key = key;
+    evt->words = MIN(words, ARRAY_SIZE(m_other_data));
+}
+
+static bool trace_load(char const *path)
+{
+    char line[128];
+    FILE *file = fopen(path, "r");
+    int line_no = 0;
+
+    if (file == NULL)
+    {
+        perror(path);
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        unsigned long long time_ms;
+        char name[16];
+        unsigned int a, b, c, d;
+        int fields;
+
+        line_no++;
+
+        if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0')
+        {
+            continue;
+        }
+
+        fields = sscanf(line, "%llu %15s %u %u %u %u", &time_ms, name, &a, &b, &c, &d);
+
+        if (fields >= 1 && m_trace_len > 0 && time_ms < m_trace[m_trace_len - 1].time_ms)
+        {
+            fprintf(stderr, "%s:%d: events out of order\n", path, line_no);
+            fclose(file);
+            return false;
+        }
+
+        if (fields >= 2 && 0 == strcmp(name, "connect"))
+        {
+            trace_add(time_ms, size_evt_connect);
+        }
+        else if (fields >= 2 && 0 == strcmp(name, "disconnect"))
+        {
+            trace_add(time_ms, size_evt_disconnect);
+        }
+        else if (fields >= 2 && 0 == strcmp(name, "toggle"))
+        {
+            trace_add(time_ms, size_evt_toggle);
+        }
+        else if ((fields == 2 || fields == 6) && 0 == strcmp(name, "led"))
+        {
+            size_evt_t *evt = trace_add(time_ms, size_evt_led);
+
+            if (fields == 6)
+            {
+                evt->has_params = true;
+                evt->params.color.r = a;
+                evt->params.color.g = b;
+                evt->params.color.b = c;
+                evt->params.state = d;
+                evt->params.brightness = LED_BRIGHTNESS_MAX;
+            }
+        }
+        else if (fields == 4 && 0 == strcmp(name, "other"))
+        {
+            trace_add_other(time_ms, SIZE_PEER_FILE_ID_BASE, a, b);
+        }
+        else
+        {
+            fprintf(stderr, "%s:%d: unknown event\n", path, line_no);
+            fclose(file);
+            return false;
+        }
+    }
+
+    fclose(file);
+
+    return m_trace_len > 0;
+}
+
+static void trace_synthesize(uint32_t changes, uint32_t sessions, uint32_t peers, double days)
+{
+    uint64_t spacing_ms = SIZE_DAY_MS / sessions;
+    uint32_t day;
+    uint32_t session;
+    uint32_t peer;
+    uint32_t i;
+
+    for (i = 0; i < LED_PRESETS_COUNT; i++)
+    {
+        trace_add_other(0, SIZE_PRESETS_FILE_ID, i + 1, LED_RECORD_WORDS);
+    }
+
+    for (peer = 0; peer < peers; peer++)
+    {
+        trace_add_other(0, SIZE_PEER_FILE_ID_BASE + peer, 1, SIZE_PEER_BONDING_WORDS);
+    }
+
+    for (day = 0; day < days; day++)
+    {
+        for (session = 0; session < sessions; session++)
+        {
+            uint64_t t = day * SIZE_DAY_MS + session * spacing_ms + 1000;
+            uint32_t count = changes / sessions + (session < changes % sessions);
+
+            trace_add(t, size_evt_connect);
+
+            if (peers > 0)
+            {
+                peer = session % peers;
+                trace_add_other(t, SIZE_PEER_FILE_ID_BASE + peer, 2, SIZE_PEER_RANK_WORDS);
+                trace_add_other(t, SIZE_PEER_FILE_ID_BASE + peer, 3, SIZE_PEER_GATT_WORDS);
+            }
+
+            for (i = 0; i < count; i++)
+            {
+                t += SIZE_CHANGE_INTERVAL_MS;
+                trace_add(t, (i % 10 == 9) ? size_evt_toggle : size_evt_led);
+            }
+
+            trace_add(t + SIZE_SESSION_TAIL_MS, size_evt_disconnect);
+        }
+    }
+
+    m_trace_span_ms = MAX(m_trace_span_ms, (uint64_t) (days * SIZE_DAY_MS));
+}
+
+static bool flash_state_get(led_params_t *params)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_flash_record_t flash_record;
+    bool migrated;
+    bool found = false;
+
+    memset(&record_token, 0, sizeof(record_token));
+
+    if (NRF_SUCCESS == fds_record_find_in_file(0xBEEF, &record_desc, &record_token) &&
+        NRF_SUCCESS == fds_record_open(&record_desc, &flash_record))
+    {
+        found = led_record_decode(flash_record.p_data,
+                                  flash_record.p_header->length_words,
+                                  params,
+                                  &migrated);
+        fds_record_close(&record_desc);
+    }
+
+    return found;
+}
+
+/* Entries the journal would have appended for the same saves: one per changed field */
+static void size_fds_handler(fds_evt_t const * p_evt)
+{
+    led_params_t saved;
+
+    if ((p_evt->id != FDS_EVT_WRITE && p_evt->id != FDS_EVT_UPDATE) ||
+        p_evt->write.file_id != 0xBEEF ||
+        p_evt->result != NRF_SUCCESS ||
+        !flash_state_get(&saved))
+    {
+        return;
+    }
+
+    if (!m_persisted_valid)
+    {
+        m_journal_entries += 3;
+    }
+    else
+    {
+        m_journal_entries += (0 != memcmp(&saved.color, &m_persisted.color, sizeof(rgb_t)));
+        m_journal_entries += (saved.state != m_persisted.state);
+        m_journal_entries += (saved.brightness != m_persisted.brightness);
+    }
+
+    m_persisted = saved;
+    m_persisted_valid = true;
+}
+
+static void on_load(led_params_t const *params)
+{
+    if (params != NULL)
+    {
+        m_state = *params;
+    }
+}
+
+static void other_write(size_evt_t const *evt)
+{
+    fds_record_desc_t record_desc;
+    fds_find_token_t record_token;
+    fds_record_t record;
+    ret_code_t ret_code;
+    int attempt;
+
+    record.file_id = evt->file_id;
+    record.key = evt->key;
+    record.data.p_data = m_other_data;
+    record.data.length_words = evt->words;
+
+    /* Peer Manager retries a full queue on the next FDS event */
+    for (attempt = 0; attempt < 1000; attempt++)
+    {
+        memset(&record_token, 0, sizeof(record_token));
+
+        if (NRF_SUCCESS == fds_record_find(evt->file_id, evt->key, &record_desc, &record_token))
+        {
+            ret_code = fds_record_update(&record_desc, &record);
+        }
+        else
+        {
+            ret_code = fds_record_write(&record_desc, &record);
+        }
+
+        if (ret_code != FDS_ERR_NO_SPACE_IN_QUEUES)
+        {
+            break;
+        }
+
+        sim_run_until(sim_now_us() + 1000);
+    }
+
+    m_other_failed += (ret_code != NRF_SUCCESS);
+}
+
+static void evt_replay(size_evt_t const *evt)
+{
+    switch (evt->type)
+    {
+        case size_evt_connect:
+            led_storage_link_state_set(true);
+            break;
+
+        /* Same calls as estc_service.c makes on GAP events */
+        case size_evt_disconnect:
+            led_storage_commit();
+            led_storage_link_state_set(false);
+            break;
+
+        case size_evt_led:
+            if (evt->has_params)
+            {
+                m_state = evt->params;
+            }
+            else
+            {
+                m_state.color.r += 37;
+                m_state.color.g += 11;
+            }
+            m_changes++;
+            led_storage_mark_dirty(&m_state);
+            break;
+
+        case size_evt_toggle:
+            m_state.state = !m_state.state;
+            m_changes++;
+            led_storage_mark_dirty(&m_state);
+            break;
+
+        case size_evt_other:
+            other_write(evt);
+            break;
+    }
+}
+
+static double years_left(double erases, double days)
+{
+    if (erases <= 0)
+    {
+        return SIZE_LIFETIME_CAP_YEARS;
+    }
+
+    return MIN(SIZE_LIFETIME_CAP_YEARS,
+               SIZE_FLASH_ENDURANCE_CYCLES * days / erases / 365.0);
+}
+
+static void size_run(double days)
+{
+    uint64_t end_ms = (uint64_t) (days * SIZE_DAY_MS);
+    uint64_t offset_ms = 0;
+    led_storage_stats_t stats;
+    led_storage_health_t health;
+    sim_stats_t sim;
+    sim_latency_t write_latency;
+    sim_latency_t gc_latency;
+    led_params_t restored;
+    size_result_t result;
+    double erases_journal;
+    size_t i;
+    int page;
+
+    sim_reset(&sim_nrf52840_timing);
+
+    led_storage_init(on_load, NULL);
+    fds_register(size_fds_handler);
+    sim_run_idle();
+
+    while (offset_ms < end_ms)
+    {
+        for (i = 0; i < m_trace_len && offset_ms + m_trace[i].time_ms < end_ms; i++)
+        {
+            sim_run_until((offset_ms + m_trace[i].time_ms) * 1000);
+            evt_replay(&m_trace[i]);
+        }
+
+        offset_ms += MAX(m_trace_span_ms, 1);
+    }
+
+    sim_run_until(end_ms * 1000);
+    sim_run_idle();
+
+    led_storage_stats_get(&stats);
+    led_storage_health_get(&health);
+    sim_stats_get(&sim);
+    sim_latency_get(sim_op_write, &write_latency);
+    sim_latency_get(sim_op_gc, &gc_latency);
+
+    memset(&result, 0, sizeof(result));
+
+    for (page = 0; page < FDS_PHY_PAGES; page++)
+    {
+        result.erases_max = MAX(result.erases_max, sim.page_erases[page]);
+    }
+
+    sim_reboot();
+    fds_init();
+    sim_run_idle();
+
+    /* The journal erases its two pages in turns, one per full page */
+    erases_journal = (double) m_journal_entries / (SIZE_JOURNAL_ENTRIES_PER_PAGE * SIZE_JOURNAL_PAGES);
+
+    result.pages = FDS_VIRTUAL_PAGES;
+    result.gc_limit_words = LED_STORAGE_GC_FREEABLE_LIMIT_WORDS;
+    result.gc_floor_words = LED_STORAGE_GC_FREE_WORDS_FLOOR;
+    result.days = days;
+    result.changes = m_changes;
+    result.saves = stats.writes_saved;
+    result.gc_runs = sim.gc_runs;
+    result.lifetime_years = years_left(result.erases_max, days);
+    result.write_p99_ms = write_latency.p99_us / 1000.0;
+    result.gc_max_ms = gc_latency.max_us / 1000.0;
+    result.journal_entries = m_journal_entries;
+    result.journal_years = years_left(erases_journal, days);
+    result.failures = health.write_failures + m_other_failed +
+                      sim.bit_set_violations + sim.buffer_changes + sim.timer_errors;
+    result.restore_ok = flash_state_get(&restored) &&
+                        0 == memcmp(&restored, &m_state, sizeof(led_params_t));
+
+    printf("%5u %8u %8u %6.1f %8u %7u %7u %6u %9.1f %9.2f %9.2f %8u %9.1f %5u %4u\n",
+           result.pages, result.gc_limit_words, result.gc_floor_words,
+           result.days, result.changes, result.saves, result.erases_max, result.gc_runs,
+           result.lifetime_years, result.write_p99_ms, result.gc_max_ms,
+           result.journal_entries, result.journal_years,
+           result.failures, result.restore_ok);
+}
+
+static void results_header(void)
+{
+    printf("#%4s %8s %8s %6s %8s %7s %7s %6s %9s %9s %9s %8s %9s %5s %4s\n",
+           "pages", "gc limit", "gc floor", "days", "changes", "saves",
+           "erases", "gc", "lifetime", "wr p99", "gc max",
+           "journal", "journal", "fail", "ok");
+    printf("#%4s %8s %8s %6s %8s %7s %7s %6s %9s %9s %9s %8s %9s %5s %4s\n",
+           "", "words", "words", "", "", "",
+           "max page", "runs", "years", "ms", "ms",
+           "entries", "years", "", "");
+}
+
+static bool result_parse(char const *line, size_result_t *result)
+{
+    return SIZE_RESULT_FIELDS == sscanf(line, "%u %u %u %lf %u %u %u %u %lf %lf %lf %u %lf %u %u",
+                                        &result->pages, &result->gc_limit_words,
+                                        &result->gc_floor_words, &result->days,
+                                        &result->changes, &result->saves,
+                                        &result->erases_max, &result->gc_runs,
+                                        &result->lifetime_years, &result->write_p99_ms,
+                                        &result->gc_max_ms, &result->journal_entries,
+                                        &result->journal_years, &result->failures,
+                                        &result->restore_ok);
+}
+
+/* Page erases per garbage collection, from the longest stall */
+static uint32_t gc_stall_erases(size_result_t const *result)
+{
+    return (uint32_t) (result->gc_max_ms * 1000 / sim_nrf52840_timing.erase_page_us);
+}
+
+/* Fewest pages first, then the fewest erases in one GC stall (each one blocks
+ * the flash for a whole t_ERASEPAGE), then the longest lifetime */
+static bool result_better(size_result_t const *a, size_result_t const *b, double target_years)
+{
+    bool a_meets = a->lifetime_years >= target_years;
+    bool b_meets = b->lifetime_years >= target_years;
+
+    if (a_meets != b_meets)
+    {
+        return a_meets;
+    }
+
+    if (a_meets && a->pages != b->pages)
+    {
+        return a->pages < b->pages;
+    }
+
+    if (a_meets && gc_stall_erases(a) != gc_stall_erases(b))
+    {
+        return gc_stall_erases(a) < gc_stall_erases(b);
+    }
+
+    return a->lifetime_years > b->lifetime_years;
+}
+
+static int recommend(char const *results_path, char const *header_path,
+                     char const *workload, double target_years)
+{
+    size_result_t results[SIZE_MAX_RESULTS];
+    size_result_t const *best = NULL;
+    char line[256];
+    FILE *file;
+    int count = 0;
+    int i;
+
+    file = fopen(results_path, "r");
+
+    if (file == NULL)
+    {
+        perror(results_path);
+        return EXIT_FAILURE;
+    }
+
+    while (count < SIZE_MAX_RESULTS && fgets(line, sizeof(line), file) != NULL)
+    {
+        if (line[0] != '#' && result_parse(line, &results[count]))
+        {
+            count++;
+        }
+    }
+
+    fclose(file);
+
+    /* A configuration that loses data or fails writes is never an option */
+    for (i = 0; i < count; i++)
+    {
+        if (results[i].failures == 0 && results[i].restore_ok &&
+            (best == NULL || result_better(&results[i], best, target_years)))
+        {
+            best = &results[i];
+        }
+    }
+
+    if (best == NULL)
+    {
+        fprintf(stderr, "no candidate kept the data intact\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("\nworkload: %s, lifetime target %.1f years\n", workload, target_years);
+    printf("FDS_VIRTUAL_PAGES %u, GC at %u freeable words, forced below %u free words\n",
+           best->pages, best->gc_limit_words, best->gc_floor_words);
+    printf("lifetime %.1f years, %u saves of %u words, GC stalls up to %.0f ms\n",
+           best->lifetime_years, best->saves,
+           FDS_HEADER_SIZE + (uint32_t) LED_RECORD_WORDS, best->gc_max_ms);
+
+    if (best->lifetime_years < target_years)
+    {
+        printf("no FDS geometry reaches the target");
+
+        if (best->journal_years >= target_years)
+        {
+            printf(", the journal layout (LED_STORAGE_JOURNAL_ENABLED) would last %.1f years",
+                   best->journal_years);
+        }
+
+        printf("\n");
+    }
+
+    if (header_path == NULL)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    file = fopen(header_path, "w");
+
+    if (file == NULL)
+    {
+        perror(header_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(file,
+            "/* Generated by tools/fds_sim/fds_size.sh, do not edit.\n"
+            " *\n"
+            " * Workload: %s\n"
+            " * Lifetime target %.1f years, estimated %.1f years.\n"
+            " * LED state as an FDS record of %u words per save (%.1f with the journal\n"
+            " * layout, estimated to last %.1f years). */\n"
+            "#ifndef LED_STORAGE_SIZING_H\n"
+            "#define LED_STORAGE_SIZING_H\n"
+            "\n"
+            "// <o> FDS_VIRTUAL_PAGES - Number of virtual flash pages to use.\n"
+            "// <i> Shared by the LED saves, the presets and the Peer Manager.\n"
+            "#ifndef FDS_VIRTUAL_PAGES\n"
+            "#define FDS_VIRTUAL_PAGES %u\n"
+            "#endif\n"
+            "\n"
+            "// <o> LED_STORAGE_GC_FREEABLE_LIMIT_WORDS - Garbage collection starts once more words are freeable\n"
+            "#ifndef LED_STORAGE_GC_FREEABLE_LIMIT_WORDS\n"
+            "#define LED_STORAGE_GC_FREEABLE_LIMIT_WORDS %u\n"
+            "#endif\n"
+            "\n"
+            "// <o> LED_STORAGE_GC_FREE_WORDS_FLOOR - Garbage collection can not wait below this many free words\n"
+            "#ifndef LED_STORAGE_GC_FREE_WORDS_FLOOR\n"
+            "#define LED_STORAGE_GC_FREE_WORDS_FLOOR %u\n"
+            "#endif\n"
+            "\n"
+            "#endif /* LED_STORAGE_SIZING_H */\n",
+            workload, target_years, best->lifetime_years,
+            FDS_HEADER_SIZE + (uint32_t) LED_RECORD_WORDS,
+            best->saves ? (double) best->journal_entries / best->saves : 0.0,
+            best->journal_years,
+            best->pages, best->gc_limit_words, best->gc_floor_words);
+
+    fclose(file);
+
+    printf("written to %s\n", header_path);
+
+    return EXIT_SUCCESS;
+}
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: fds_size [-t trace | -s changes[:sessions[:peers]]] [-d days] [-y years] [-H]\n"
+            "       fds_size -R results [-o header] [-s ... | -t ...] [-y years]\n");
+}
+
+int main(int argc, char **argv)
+{
+    char const *trace_path = NULL;
+    char const *results_path = NULL;
+    char const *header_path = NULL;
+    char workload[96];
+    unsigned int changes = 200;
+    unsigned int sessions = 10;
+    unsigned int peers = 2;
+    double days = 90;
+    double target_years = 10;
+    bool header_only = false;
+    int i;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-H"))
+        {
+            header_only = true;
+        }
+        else if (0 == strcmp(argv[i], "-v"))
+        {
+            sim_log_enable(true);
+        }
+        else if (i + 1 < argc && 0 == strcmp(argv[i], "-t"))
+        {
+            trace_path = argv[++i];
+        }
+        else if (i + 1 < argc && 0 == strcmp(argv[i], "-s"))
+        {
+            sscanf(argv[++i], "%u:%u:%u", &changes, &sessions, &peers);
+        }
+        else if (i + 1 < argc && 0 == strcmp(argv[i], "-d"))
+        {
+            days = atof(argv[++i]);
+        }
+        else if (i + 1 < argc && 0 == strcmp(argv[i], "-y"))
+        {
+            target_years = atof(argv[++i]);
+        }
+        else if (i + 1 < argc && 0 == strcmp(argv[i], "-R"))
+        {
+            results_path = argv[++i];
+        }
+        else if (i + 1 < argc && 0 == strcmp(argv[i], "-o"))
+        {
+            header_path = argv[++i];
+        }
+        else
+        {
+            usage();
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (trace_path != NULL)
+    {
+        snprintf(workload, sizeof(workload), "trace %s", trace_path);
+    }
+    else
+    {
+        sessions = MAX(sessions, 1);
+        snprintf(workload, sizeof(workload), "%u changes in %u sessions a day, %u bonded peers",
+                 changes, sessions, peers);
+    }
+
+    if (header_only)
+    {
+        results_header();
+        return EXIT_SUCCESS;
+    }
+
+    if (results_path != NULL)
+    {
+        return recommend(results_path, header_path, workload, target_years);
+    }
+
+    if (days <= 0)
+    {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    if (trace_path != NULL)
+    {
+        if (!trace_load(trace_path))
+        {
+            return EXIT_FAILURE;
+        }
+    }
+    else
+    {
+        trace_synthesize(changes, sessions, peers, days);
+    }
+
+    size_run(days);
+
+    return EXIT_SUCCESS;
+}
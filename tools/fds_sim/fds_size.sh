@@ -0,0 +1,44 @@
+#!/bin/sh
+# Sweeps the FDS page count and the garbage collection threshold for a
+# workload and writes the best configuration into config/led_storage_sizing.h.
+# Every candidate is a separate build of lib/led_storage.c, exactly as the
+# firmware would be compiled with it.
+#
+#   ./fds_size.sh [-t trace | -s changes[:sessions[:peers]]] [-d days] [-y years]
+#
+# PAGES and GC_LIMITS_PCT (percent of a virtual page) override the candidates,
+# SIZING_HEADER the output file. Fewer than 3 pages would move the FDS area of
+# devices already in the field, so 2 is only a candidate when asked for.
+set -e
+
+cd "$(dirname "$0")"
+
+PAGES=${PAGES:-"3 4 5 6"}
+GC_LIMITS_PCT=${GC_LIMITS_PCT:-"0 25 50 75 100 150"}
+SIZING_HEADER=${SIZING_HEADER:-../../config/led_storage_sizing.h}
+
+PAGE_WORDS=$(sed -n 's/^#define FDS_VIRTUAL_PAGE_SIZE \([0-9]*\).*/\1/p' ../../config/sdk_config.h)
+FLOOR_WORDS=$((PAGE_WORDS / 4))
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+build() {
+    gcc -std=gnu99 -O2 -Wall -DUSE_APP_CONFIG -Iinclude -I. -I../../lib -I../../config \
+        "$@" fds_size.c sim.c sim_fds.c ../../lib/led_storage.c ../../lib/led_record.c
+}
+
+build -o "$WORK/fds_size"
+"$WORK/fds_size" -H "$@" | tee "$WORK/results"
+
+for pages in $PAGES; do
+    for pct in $GC_LIMITS_PCT; do
+        build -DFDS_VIRTUAL_PAGES="$pages" \
+              -DLED_STORAGE_GC_FREEABLE_LIMIT_WORDS=$((PAGE_WORDS * pct / 100)) \
+              -DLED_STORAGE_GC_FREE_WORDS_FLOOR="$FLOOR_WORDS" \
+              -o "$WORK/candidate"
+        "$WORK/candidate" "$@" | tee -a "$WORK/results"
+    done
+done
+
+"$WORK/fds_size" -R "$WORK/results" -o "$SIZING_HEADER" "$@"
@@ -0,0 +1,12 @@
+/* Host build of the persistence code: sim.c runs deferred work at once,
+ * the timers already fire from the simulated main loop */
+#ifndef APP_SCHEDULER_H__
+#define APP_SCHEDULER_H__
+
+#include <stdint.h>
+
+#include "sdk_errors.h"
+
+typedef void (*app_sched_event_handler_t)(void *p_event_data, uint16_t event_size);
+
+#endif /* APP_SCHEDULER_H__ */
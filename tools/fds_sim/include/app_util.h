@@ -0,0 +1,27 @@
+/* Host builds of the persistence and button code: the subset of app_util.h they need */
+#ifndef APP_UTIL_H__
+#define APP_UTIL_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARRAY_SIZE(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+#define BYTES_TO_WORDS(n_bytes) (((n_bytes) + 3) >> 2)
+
+#define ROUNDED_DIV(A, B) (((A) + ((B) / 2)) / (B))
+
+#ifndef MIN
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#ifndef MAX
+#define MAX(a, b) ((a) < (b) ? (b) : (a))
+#endif
+
+#define STATIC_ASSERT(EXPR, ...) _Static_assert(EXPR, #EXPR)
+
+#define CONCAT_2(p1, p2)      CONCAT_2_(p1, p2)
+#define CONCAT_2_(p1, p2)     p1##p2
+
+#endif /* APP_UTIL_H__ */
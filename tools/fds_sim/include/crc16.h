@@ -0,0 +1,9 @@
+/* Host build of the persistence code: same CRC-16/CCITT as the SDK */
+#ifndef CRC16_H__
+#define CRC16_H__
+
+#include <stdint.h>
+
+uint16_t crc16_compute(uint8_t const * p_data, uint32_t size, uint16_t const * p_crc);
+
+#endif /* CRC16_H__ */
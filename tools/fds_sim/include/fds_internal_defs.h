@@ -0,0 +1,20 @@
+/* Host build of the persistence code: FDS geometry derived from sdk_config.h */
+#ifndef FDS_INTERNAL_DEFS_H__
+#define FDS_INTERNAL_DEFS_H__
+
+#include "sdk_config.h"
+#include "fds.h"
+
+#define FDS_PAGE_TAG_SIZE       (2)
+#define FDS_HEADER_SIZE         (3)
+
+/* nRF52 flash pages are 4 kB */
+#define FDS_PHY_PAGE_SIZE       (1024)
+#define FDS_PHY_PAGES_IN_VPAGE  (FDS_VIRTUAL_PAGE_SIZE / FDS_PHY_PAGE_SIZE)
+#define FDS_PHY_PAGES           (FDS_VIRTUAL_PAGES * FDS_PHY_PAGES_IN_VPAGE)
+#define FDS_PHY_PAGES_RESERVED  (FDS_VIRTUAL_PAGES_RESERVED * FDS_PHY_PAGES_IN_VPAGE)
+
+#define FDS_PAGE_SIZE           (FDS_VIRTUAL_PAGE_SIZE)
+#define FDS_DATA_PAGES          (FDS_VIRTUAL_PAGES - 1)
+
+#endif /* FDS_INTERNAL_DEFS_H__ */
@@ -0,0 +1,23 @@
+/* Host build of the persistence code: the UICR and FICR registers led_journal.c
+ * places its pages with, as on an nRF52840 without a bootloader */
+#ifndef NRF_H
+#define NRF_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint32_t NRFFW[15];
+} NRF_UICR_Type;
+
+typedef struct {
+    uint32_t CODEPAGESIZE;
+    uint32_t CODESIZE;
+} NRF_FICR_Type;
+
+extern NRF_UICR_Type sim_uicr;
+extern NRF_FICR_Type sim_ficr;
+
+#define NRF_UICR (&sim_uicr)
+#define NRF_FICR (&sim_ficr)
+
+#endif /* NRF_H */
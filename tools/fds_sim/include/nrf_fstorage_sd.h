@@ -0,0 +1,9 @@
+/* Host build of the persistence code: the SoftDevice backend is the simulated flash */
+#ifndef NRF_FSTORAGE_SD_H__
+#define NRF_FSTORAGE_SD_H__
+
+#include "nrf_fstorage.h"
+
+extern nrf_fstorage_api_t nrf_fstorage_sd;
+
+#endif /* NRF_FSTORAGE_SD_H__ */
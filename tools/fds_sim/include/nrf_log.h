@@ -0,0 +1,12 @@
+/* Host build of the persistence code: logs go to stdout when verbose */
+#ifndef NRF_LOG_H__
+#define NRF_LOG_H__
+
+void sim_log(char const *level, char const *fmt, ...);
+
+#define NRF_LOG_ERROR(...)   sim_log("E", __VA_ARGS__)
+#define NRF_LOG_WARNING(...) sim_log("W", __VA_ARGS__)
+#define NRF_LOG_INFO(...)    sim_log("I", __VA_ARGS__)
+#define NRF_LOG_DEBUG(...)   sim_log("D", __VA_ARGS__)
+
+#endif /* NRF_LOG_H__ */
@@ -0,0 +1,20 @@
+/* Host build of the persistence code: the subset of sdk_errors.h it needs */
+#ifndef SDK_ERRORS_H__
+#define SDK_ERRORS_H__
+
+#include <stdint.h>
+
+typedef uint32_t ret_code_t;
+
+#define NRF_SUCCESS                 0
+#define NRF_ERROR_INTERNAL          3
+#define NRF_ERROR_NO_MEM            4
+#define NRF_ERROR_NOT_FOUND         5
+#define NRF_ERROR_INVALID_PARAM     7
+#define NRF_ERROR_INVALID_STATE     8
+#define NRF_ERROR_INVALID_LENGTH    9
+#define NRF_ERROR_NULL              14
+#define NRF_ERROR_INVALID_ADDR      16
+#define NRF_ERROR_BUSY              17
+
+#endif /* SDK_ERRORS_H__ */
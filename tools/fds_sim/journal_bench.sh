@@ -0,0 +1,49 @@
+#!/bin/sh
+# Runs the persistence benchmark against both storage paths of lib/led_storage.c:
+# one FDS record per save, and the delta journal (LED_STORAGE_JOURNAL_ENABLED).
+# Prints both tables, then the flash words written and pages erased per
+# profile side by side, with how many times fewer the journal needs.
+#
+#   ./journal_bench.sh [profile]
+set -e
+
+cd "$(dirname "$0")"
+
+WORK=$(mktemp -d)
+trap 'rm -rf "$WORK"' EXIT
+
+CFLAGS="-std=gnu99 -O2 -Wall -DUSE_APP_CONFIG -Iinclude -I. -I../../lib -I../../config"
+SOURCES="bench.c sim.c sim_fds.c ../../lib/led_storage.c ../../lib/led_record.c"
+
+gcc $CFLAGS $SOURCES -o "$WORK/fds"
+
+# The journal pages are mapped at their flash address, which needs a fixed image
+gcc $CFLAGS -no-pie -DLED_STORAGE_JOURNAL_ENABLED=1 \
+    $SOURCES sim_fstorage.c ../../lib/led_journal.c \
+    -Wl,--defsym,__led_journal_start=0xdb000 \
+    -o "$WORK/journal"
+
+echo "FDS record per save"
+"$WORK/fds" "$@" | tee "$WORK/fds.txt"
+echo
+echo "Journal"
+"$WORK/journal" "$@" | tee "$WORK/journal.txt"
+echo
+
+# Result rows end with the restore check
+awk '
+    $NF == "ok" || $NF == "LOST" {
+        if (FILENAME ~ /fds.txt$/) { words[$1] = $5; erases[$1] = $6; order[n++] = $1 }
+        else { jwords[$1] = $5; jerases[$1] = $6 }
+    }
+    END {
+        printf "%-10s %9s %9s %7s %9s %9s %7s\n", "profile", "fds words", "jnl words", "ratio", "fds erase", "jnl erase", "ratio"
+        for (i = 0; i < n; i++) {
+            p = order[i]
+            # A journal that erased nothing has no ratio
+            printf "%-10s %9d %9d %6.1fx %9d %9d %7s\n", p,
+                   words[p], jwords[p], jwords[p] ? words[p] / jwords[p] : 0,
+                   erases[p], jerases[p],
+                   jerases[p] ? sprintf("%.1fx", erases[p] / jerases[p]) : "-"
+        }
+    }' "$WORK/fds.txt" "$WORK/journal.txt"
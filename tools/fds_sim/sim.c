@@ -0,0 +1,342 @@
+#include "sim.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "app_timer.h"
+#include "crc16.h"
+#include "event_loop.h"
+#include "cpu_usage.h"
+
+#define SIM_MAX_TIMERS 16
+#define SIM_NEVER UINT64_MAX
+#define SIM_IDLE_LIMIT_US (3600ULL * 1000000)
+
+/* Counter frequency of the RTC behind app_timer */
+#define SIM_RTC_FREQ (APP_TIMER_CLOCK_FREQ / (APP_TIMER_CONFIG_RTC_FREQUENCY + 1))
+
+sim_flash_timing_t const sim_nrf52840_timing = {
+    .write_word_us = 41,
+    .erase_page_us = 85000,
+    .op_overhead_us = 1000,
+};
+
+sim_stats_t sim_stats;
+
+static uint64_t m_now_us;
+static bool m_log_enabled;
+
+static app_timer_t *m_timers[SIM_MAX_TIMERS];
+static int m_timer_count;
+static uint32_t m_timer_start_failures;
+
+static sim_flash_client_t const *m_flash_client;
+static sim_flash_timing_t m_flash_timing;
+
+void sim_log_enable(bool enable)
+{
+    m_log_enabled = enable;
+}
+
+void sim_log(char const *level, char const *fmt, ...)
+{
+    va_list args;
+
+    if (!m_log_enabled)
+    {
+        return;
+    }
+
+    printf("%10.3f <%s> ", m_now_us / 1000.0, level);
+
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+
+    printf("\n");
+}
+
+uint16_t crc16_compute(uint8_t const * p_data, uint32_t size, uint16_t const * p_crc)
+{
+    uint16_t crc = (p_crc == NULL) ? 0xFFFF : *p_crc;
+    uint32_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        crc  = (uint8_t)(crc >> 8) | (crc << 8);
+        crc ^= p_data[i];
+        crc ^= (uint8_t)(crc & 0xFF) >> 4;
+        crc ^= (crc << 8) << 4;
+        crc ^= ((crc & 0xFF) << 4) << 1;
+    }
+
+    return crc;
+}
+
+uint64_t sim_now_us(void)
+{
+    return m_now_us;
+}
+
+static uint64_t ticks_to_us(uint32_t ticks)
+{
+    return (uint64_t) ticks * 1000000 / SIM_RTC_FREQ;
+}
+
+ret_code_t app_timer_init(void)
+{
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_create(app_timer_id_t const * p_timer_id,
+                            app_timer_mode_t mode,
+                            app_timer_timeout_handler_t timeout_handler)
+{
+    app_timer_t *timer = *p_timer_id;
+    int i;
+
+    timer->handler = timeout_handler;
+    timer->mode = mode;
+    timer->active = false;
+
+    for (i = 0; i < m_timer_count; i++)
+    {
+        if (m_timers[i] == timer)
+        {
+            return NRF_SUCCESS;
+        }
+    }
+
+    if (m_timer_count == SIM_MAX_TIMERS)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    m_timers[m_timer_count++] = timer;
+
+    return NRF_SUCCESS;
+}
+
+void sim_timer_start_fail(uint32_t count)
+{
+    m_timer_start_failures = count;
+}
+
+ret_code_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void * p_context)
+{
+    if (m_timer_start_failures > 0)
+    {
+        m_timer_start_failures--;
+        return NRF_ERROR_NO_MEM;
+    }
+
+    if (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS || timeout_ticks > APP_TIMER_MAX_CNT_VAL)
+    {
+        /* The real app_timer refuses these, the timer never fires */
+        sim_stats.timer_errors++;
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    timer_id->period_ticks = timeout_ticks;
+    timer_id->expiry_us = m_now_us + ticks_to_us(timeout_ticks);
+    timer_id->p_context = p_context;
+    timer_id->active = true;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t app_timer_stop(app_timer_id_t timer_id)
+{
+    timer_id->active = false;
+
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(void)
+{
+    return (uint32_t) (m_now_us * SIM_RTC_FREQ / 1000000) & APP_TIMER_MAX_CNT_VAL;
+}
+
+uint32_t app_timer_cnt_diff_compute(uint32_t ticks_to, uint32_t ticks_from)
+{
+    return (ticks_to - ticks_from) & APP_TIMER_MAX_CNT_VAL;
+}
+
+uint64_t sim_timer_next_us(void)
+{
+    uint64_t next = SIM_NEVER;
+    int i;
+
+    for (i = 0; i < m_timer_count; i++)
+    {
+        if (m_timers[i]->active && m_timers[i]->expiry_us < next)
+        {
+            next = m_timers[i]->expiry_us;
+        }
+    }
+
+    return next;
+}
+
+void sim_timer_fire(uint64_t now_us)
+{
+    int i;
+
+    for (i = 0; i < m_timer_count; i++)
+    {
+        app_timer_t *timer = m_timers[i];
+
+        if (!timer->active || timer->expiry_us > now_us)
+        {
+            continue;
+        }
+
+        if (timer->mode == APP_TIMER_MODE_REPEATED)
+        {
+            timer->expiry_us += ticks_to_us(timer->period_ticks);
+        }
+        else
+        {
+            timer->active = false;
+        }
+
+        timer->handler(timer->p_context);
+        return;
+    }
+}
+
+/* The timers fire from the simulated main loop, there is nothing to defer */
+void event_loop_defer(event_loop_work_t *work)
+{
+    work->handler(NULL, 0);
+}
+
+#if CPU_USAGE_ENABLED
+/* No time is simulated for the code itself */
+cpu_usage_subsystem_t cpu_usage_enter(cpu_usage_subsystem_t subsystem)
+{
+    return CPU_USAGE_OTHER;
+}
+
+void cpu_usage_exit(cpu_usage_subsystem_t previous)
+{
+}
+#endif
+
+void sim_timer_reset(void)
+{
+    int i;
+
+    for (i = 0; i < m_timer_count; i++)
+    {
+        m_timers[i]->active = false;
+    }
+}
+
+void sim_flash_client_set(sim_flash_client_t const *client)
+{
+    m_flash_client = client;
+}
+
+sim_flash_timing_t const * sim_flash_timing(void)
+{
+    return &m_flash_timing;
+}
+
+static uint64_t flash_client_next_us(void)
+{
+    return (m_flash_client != NULL) ? m_flash_client->next_us() : SIM_NEVER;
+}
+
+uint64_t sim_flash_stall_end_us(uint64_t time_us)
+{
+    uint64_t end = sim_fds_stall_end_us(time_us);
+
+    if (m_flash_client != NULL)
+    {
+        end = MAX(end, m_flash_client->stall_end_us(time_us));
+    }
+
+    return end;
+}
+
+void sim_run_until(uint64_t time_us)
+{
+    for (;;)
+    {
+        uint64_t next_fds = sim_fds_next_us();
+        uint64_t next_client = flash_client_next_us();
+        uint64_t next_timer = sim_timer_next_us();
+        uint64_t next = MIN(MIN(next_fds, next_client), next_timer);
+
+        if (next > time_us)
+        {
+            break;
+        }
+
+        m_now_us = MAX(m_now_us, next);
+
+        /* Flash first, like an event that is already pending */
+        if (next_fds == next)
+        {
+            sim_fds_complete(m_now_us);
+        }
+        else if (next_client == next)
+        {
+            m_flash_client->complete(m_now_us);
+        }
+        else
+        {
+            sim_timer_fire(m_now_us);
+        }
+    }
+
+    m_now_us = MAX(m_now_us, time_us);
+}
+
+void sim_run_idle(void)
+{
+    uint64_t limit = m_now_us + SIM_IDLE_LIMIT_US;
+    uint64_t next;
+
+    /* A timer that keeps re-arming itself would never let this return */
+    while ((next = MIN(MIN(sim_fds_next_us(), flash_client_next_us()),
+                       sim_timer_next_us())) <= limit)
+    {
+        sim_run_until(next);
+    }
+}
+
+void sim_reset(sim_flash_timing_t const *timing)
+{
+    m_now_us = 0;
+    m_timer_start_failures = 0;
+    memset(&sim_stats, 0, sizeof(sim_stats));
+
+    m_flash_timing = *timing;
+
+    sim_timer_reset();
+    sim_fds_reset(timing, true);
+
+    if (m_flash_client != NULL)
+    {
+        m_flash_client->reset(true);
+    }
+}
+
+void sim_reboot(void)
+{
+    sim_timer_reset();
+    sim_fds_reset(NULL, false);
+
+    if (m_flash_client != NULL)
+    {
+        m_flash_client->reset(false);
+    }
+}
+
+void sim_stats_get(sim_stats_t *stats)
+{
+    *stats = sim_stats;
+}
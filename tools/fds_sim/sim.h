@@ -0,0 +1,109 @@
+/* RAM-backed model of the flash, FDS and app_timer, driven by a virtual clock.
+ * Nothing runs on its own: time only moves forward inside sim_run_until(),
+ * which fires the timers and completes the flash operations that are due,
+ * in order, from the same context like the single IRQ priority on target. */
+#ifndef SIM_H__
+#define SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "fds_internal_defs.h"
+
+/* Raw pages for fstorage below the FDS pages, the LED journal */
+#define SIM_RAW_PAGES 2
+
+typedef struct {
+    uint32_t write_word_us;  /* nRF52840 t_WRITE, 41 us max */
+    uint32_t erase_page_us;  /* nRF52840 t_ERASEPAGE, 85 ms max */
+    uint32_t op_overhead_us; /* waiting for a flash timeslot next to the SoftDevice */
+} sim_flash_timing_t;
+
+typedef struct {
+    uint32_t words_written;
+    uint32_t page_erases[FDS_PHY_PAGES];
+    uint32_t raw_page_erases[SIM_RAW_PAGES]; /* erased through fstorage, outside FDS */
+    uint32_t gc_runs;
+    uint32_t bit_set_violations; /* writes that try to turn a 0 bit back into 1 */
+    uint32_t buffer_changes;     /* record data modified while its write was queued */
+    uint32_t queue_full;         /* requests rejected with FDS_ERR_NO_SPACE_IN_QUEUES */
+    uint32_t no_space;           /* requests rejected with FDS_ERR_NO_SPACE_IN_FLASH */
+    uint32_t timer_errors;       /* app_timer_start calls the real app_timer rejects */
+} sim_stats_t;
+
+typedef enum {
+    sim_op_write,  /* fds_record_write and fds_record_update */
+    sim_op_delete, /* fds_record_delete and fds_file_delete */
+    sim_op_gc,
+    sim_op_count
+} sim_op_kind_t;
+
+/* Time from queueing an FDS operation to its event */
+typedef struct {
+    uint32_t count;
+    uint32_t avg_us;
+    uint32_t p99_us;
+    uint32_t max_us;
+} sim_latency_t;
+
+extern sim_flash_timing_t const sim_nrf52840_timing;
+
+/* Erase the flash, stop all timers and rewind the clock */
+void sim_reset(sim_flash_timing_t const *timing);
+
+/* Forget the FDS RAM state as a reset would, the flash content stays */
+void sim_reboot(void);
+
+uint64_t sim_now_us(void);
+
+void sim_run_until(uint64_t time_us);
+
+/* Run until no timer is armed and no flash operation is queued */
+void sim_run_idle(void);
+
+void sim_stats_get(sim_stats_t *stats);
+
+void sim_latency_get(sim_op_kind_t kind, sim_latency_t *latency);
+
+/* Called with the words of every fstorage write once they are in flash */
+typedef void (*sim_raw_write_observer_t)(uint32_t const *p_words, uint32_t count);
+
+void sim_raw_write_observer_set(sim_raw_write_observer_t observer);
+
+/* When the CPU runs again if it has work at time_us: the nRF52 halts it
+ * while the flash is written or erased. time_us if nothing stalls it */
+uint64_t sim_flash_stall_end_us(uint64_t time_us);
+
+/* Queue time of the operation whose event is being dispatched */
+uint64_t sim_fds_event_queued_us(void);
+
+void sim_log_enable(bool enable);
+
+/* The next count app_timer_start() calls fail with NRF_ERROR_NO_MEM,
+ * as they do on target when the app_timer operation queue is full */
+void sim_timer_start_fail(uint32_t count);
+
+/* A flash user next to FDS, driven by the same clock: sim_fstorage.c
+ * registers itself when nrf_fstorage_init() is called */
+typedef struct {
+    uint64_t (*next_us)(void);
+    void (*complete)(uint64_t now_us);
+    uint64_t (*stall_end_us)(uint64_t time_us);
+    void (*reset)(bool erase);
+} sim_flash_client_t;
+
+void sim_flash_client_set(sim_flash_client_t const *client);
+
+/* Between sim.c, sim_fds.c and sim_fstorage.c */
+extern sim_stats_t sim_stats;
+uint64_t sim_timer_next_us(void);
+void sim_timer_fire(uint64_t now_us);
+void sim_timer_reset(void);
+uint64_t sim_fds_next_us(void);
+void sim_fds_complete(uint64_t now_us);
+void sim_fds_reset(sim_flash_timing_t const *timing, bool erase);
+uint64_t sim_fds_stall_end_us(uint64_t time_us);
+void sim_latency_add(sim_op_kind_t kind, uint64_t latency_us);
+sim_flash_timing_t const * sim_flash_timing(void);
+
+#endif /* SIM_H__ */
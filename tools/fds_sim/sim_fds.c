@@ -0,0 +1,1041 @@
+#include "sim.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "app_util.h"
+#include "crc16.h"
+
+/*
+ * Flash layout follows FDS: every page starts with a two-word tag, records
+ * are appended behind it with a three-word header:
+ *   word 0: record key | length in words << 16 (key 0x0000 marks it dirty)
+ *   word 1: file id | CRC << 16
+ *   word 2: record id
+ * One page is kept erased as the swap page for garbage collection.
+ *
+ * Operations run one at a time in queue order. The flash is changed and the
+ * event is sent when an operation completes, so the record data is read from
+ * the caller's buffer at that moment, as on target.
+ */
+
+#define SIM_PAGE_WORDS FDS_PHY_PAGE_SIZE
+#define SIM_PAGE_BYTES (SIM_PAGE_WORDS * sizeof(uint32_t))
+
+#define SIM_TAG_MAGIC 0xDEADC0DE
+#define SIM_TAG_DATA  0xF11E01FE
+#define SIM_TAG_SWAP  0xF11E01FF
+
+#define SIM_RECORD_KEY_DIRTY 0x0000
+#define SIM_ERASED_WORD 0xFFFFFFFF
+
+#define SIM_NEVER UINT64_MAX
+#define SIM_LATENCY_SAMPLES 65536
+
+typedef enum {
+    page_blank,
+    page_data,
+    page_swap
+} sim_page_type_t;
+
+typedef enum {
+    op_init,
+    op_write,
+    op_update,
+    op_delete,
+    op_del_file,
+    op_gc
+} sim_op_type_t;
+
+typedef struct {
+    sim_op_type_t type;
+    uint64_t queued_us;
+    uint64_t done_us;          /* SIM_NEVER until the operation is started */
+    uint64_t flash_us;         /* from done_us back, the CPU is halted on flash */
+    uint32_t record_id;        /* the new record, or the one to delete */
+    uint32_t old_record_id;    /* the record replaced by an update */
+    uint16_t file_id;
+    uint16_t record_key;
+    void const *p_data;
+    uint16_t length_words;
+    uint16_t data_crc;         /* catches a buffer reused before the write */
+    uint8_t page;              /* page the space was reserved in */
+} sim_op_t;
+
+typedef struct {
+    uint32_t samples[SIM_LATENCY_SAMPLES];
+    uint32_t count;
+    uint64_t total_us;
+    uint32_t max_us;
+} sim_latency_log_t;
+
+/* Aligned to the page size, like the real flash the page index is derived from */
+static uint32_t m_flash[FDS_PHY_PAGES][SIM_PAGE_WORDS] __attribute__((aligned(SIM_PAGE_BYTES)));
+
+static sim_page_type_t m_page_type[FDS_PHY_PAGES];
+static uint16_t m_write_offset[FDS_PHY_PAGES];
+static uint16_t m_words_reserved[FDS_PHY_PAGES];
+
+static sim_op_t m_queue[FDS_OP_QUEUE_SIZE];
+static uint8_t m_queue_head;
+static uint8_t m_queue_count;
+
+static fds_cb_t m_users[FDS_MAX_USERS];
+static uint8_t m_user_count;
+
+static bool m_initialized;
+static uint32_t m_last_record_id;
+static uint16_t m_gc_run_count;
+static uint16_t m_open_records;
+static uint64_t m_event_queued_us;
+
+static sim_flash_timing_t m_timing;
+static sim_latency_log_t m_latency[sim_op_count];
+
+static void flash_write(uint32_t *dst, uint32_t const *src, uint16_t words)
+{
+    uint16_t i;
+
+    for (i = 0; i < words; i++)
+    {
+        if ((dst[i] & src[i]) != src[i])
+        {
+            sim_stats.bit_set_violations++;
+        }
+
+        /* Programming can only clear bits */
+        dst[i] &= src[i];
+        sim_stats.words_written++;
+    }
+}
+
+static void flash_write_word(uint32_t *dst, uint32_t value)
+{
+    flash_write(dst, &value, 1);
+}
+
+static void flash_erase(uint8_t page)
+{
+    memset(m_flash[page], 0xFF, SIM_PAGE_BYTES);
+    sim_stats.page_erases[page]++;
+}
+
+static fds_header_t const * header_at(uint32_t const *p_record)
+{
+    return (fds_header_t const *) p_record;
+}
+
+static uint16_t record_words(uint32_t const *p_record)
+{
+    return FDS_HEADER_SIZE + header_at(p_record)->length_words;
+}
+
+static bool record_is_valid(uint32_t const *p_record)
+{
+    return header_at(p_record)->record_key != SIM_RECORD_KEY_DIRTY;
+}
+
+/* Next record of a data page at or after p_from, NULL past the last one */
+static uint32_t const * page_record_next(uint8_t page, uint32_t const *p_from)
+{
+    uint32_t const *p_end = &m_flash[page][m_write_offset[page]];
+
+    if (p_from == NULL)
+    {
+        p_from = &m_flash[page][FDS_PAGE_TAG_SIZE];
+    }
+
+    return (p_from < p_end) ? p_from : NULL;
+}
+
+static uint32_t const * record_by_id(uint32_t record_id)
+{
+    uint8_t page;
+    uint32_t const *p_record;
+
+    for (page = 0; page < FDS_PHY_PAGES; page++)
+    {
+        if (m_page_type[page] != page_data)
+        {
+            continue;
+        }
+
+        for (p_record = page_record_next(page, NULL);
+             p_record != NULL;
+             p_record = page_record_next(page, p_record + record_words(p_record)))
+        {
+            if (record_is_valid(p_record) && header_at(p_record)->record_id == record_id)
+            {
+                return p_record;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void pages_scan(void)
+{
+    uint8_t page;
+
+    m_last_record_id = 0;
+
+    for (page = 0; page < FDS_PHY_PAGES; page++)
+    {
+        uint32_t const *p_page = m_flash[page];
+        uint16_t offset = FDS_PAGE_TAG_SIZE;
+
+        m_words_reserved[page] = 0;
+
+        if (p_page[0] != SIM_TAG_MAGIC)
+        {
+            m_page_type[page] = page_blank;
+            m_write_offset[page] = FDS_PAGE_TAG_SIZE;
+            continue;
+        }
+
+        m_page_type[page] = (p_page[1] == SIM_TAG_DATA) ? page_data : page_swap;
+
+        while (offset + FDS_HEADER_SIZE <= SIM_PAGE_WORDS && p_page[offset] != SIM_ERASED_WORD)
+        {
+            fds_header_t const *header = header_at(&p_page[offset]);
+
+            m_last_record_id = MAX(m_last_record_id, header->record_id);
+            offset += FDS_HEADER_SIZE + header->length_words;
+        }
+
+        m_write_offset[page] = MIN(offset, SIM_PAGE_WORDS);
+    }
+}
+
+static uint16_t pages_format(bool dry_run)
+{
+    uint8_t page;
+    bool has_swap = false;
+    uint16_t words = 0;
+
+    for (page = 0; page < FDS_PHY_PAGES; page++)
+    {
+        has_swap |= (m_page_type[page] == page_swap);
+    }
+
+    for (page = 0; page < FDS_PHY_PAGES; page++)
+    {
+        if (m_page_type[page] != page_blank)
+        {
+            continue;
+        }
+
+        words += FDS_PAGE_TAG_SIZE;
+
+        if (dry_run)
+        {
+            continue;
+        }
+
+        flash_write_word(&m_flash[page][0], SIM_TAG_MAGIC);
+
+        if (!has_swap)
+        {
+            flash_write_word(&m_flash[page][1], SIM_TAG_SWAP);
+            m_page_type[page] = page_swap;
+            has_swap = true;
+        }
+        else
+        {
+            flash_write_word(&m_flash[page][1], SIM_TAG_DATA);
+            m_page_type[page] = page_data;
+        }
+    }
+
+    return words;
+}
+
+static bool space_reserve(uint16_t words, uint8_t *p_page)
+{
+    uint8_t page;
+
+    for (page = 0; page < FDS_PHY_PAGES; page++)
+    {
+        if (m_page_type[page] == page_data &&
+            m_write_offset[page] + m_words_reserved[page] + words <= SIM_PAGE_WORDS)
+        {
+            m_words_reserved[page] += words;
+            *p_page = page;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static sim_op_t * op_alloc(sim_op_type_t type)
+{
+    sim_op_t *op;
+
+    if (m_queue_count == FDS_OP_QUEUE_SIZE)
+    {
+        sim_stats.queue_full++;
+        return NULL;
+    }
+
+    op = &m_queue[(m_queue_head + m_queue_count) % FDS_OP_QUEUE_SIZE];
+    m_queue_count++;
+
+    memset(op, 0, sizeof(*op));
+    op->type = type;
+    op->queued_us = sim_now_us();
+    op->done_us = SIM_NEVER;
+
+    return op;
+}
+
+static uint16_t gc_words_to_copy(uint8_t page, bool *has_dirty)
+{
+    uint32_t const *p_record;
+    uint16_t words = 0;
+
+    *has_dirty = false;
+
+    for (p_record = page_record_next(page, NULL);
+         p_record != NULL;
+         p_record = page_record_next(page, p_record + record_words(p_record)))
+    {
+        if (record_is_valid(p_record))
+        {
+            words += record_words(p_record);
+        }
+        else
+        {
+            *has_dirty = true;
+        }
+    }
+
+    return words;
+}
+
+static uint64_t op_duration_us(sim_op_t const *op)
+{
+    uint32_t words = 0;
+    uint32_t erases = 0;
+    uint8_t page;
+
+    switch (op->type)
+    {
+        case op_init:
+            words = pages_format(true);
+            break;
+
+        case op_write:
+            words = FDS_HEADER_SIZE + op->length_words;
+            break;
+
+        case op_update:
+            words = FDS_HEADER_SIZE + op->length_words + 1;
+            break;
+
+        case op_delete:
+            words = 1;
+            break;
+
+        case op_del_file:
+            for (page = 0; page < FDS_PHY_PAGES; page++)
+            {
+                uint32_t const *p_record;
+
+                if (m_page_type[page] != page_data)
+                {
+                    continue;
+                }
+
+                for (p_record = page_record_next(page, NULL);
+                     p_record != NULL;
+                     p_record = page_record_next(page, p_record + record_words(p_record)))
+                {
+                    words += (record_is_valid(p_record) &&
+                              header_at(p_record)->file_id == op->file_id);
+                }
+            }
+            break;
+
+        case op_gc:
+            for (page = 0; page < FDS_PHY_PAGES; page++)
+            {
+                bool has_dirty;
+                uint16_t copy;
+
+                if (m_page_type[page] != page_data)
+                {
+                    continue;
+                }
+
+                copy = gc_words_to_copy(page, &has_dirty);
+
+                if (has_dirty)
+                {
+                    words += copy + 2 * FDS_PAGE_TAG_SIZE;
+                    erases++;
+                }
+            }
+            break;
+    }
+
+    return m_timing.op_overhead_us +
+           (uint64_t) words * m_timing.write_word_us +
+           (uint64_t) erases * m_timing.erase_page_us;
+}
+
+static void op_start_head(void)
+{
+    sim_op_t *op;
+
+    if (m_queue_count == 0)
+    {
+        return;
+    }
+
+    op = &m_queue[m_queue_head];
+
+    if (op->done_us == SIM_NEVER)
+    {
+        uint64_t duration = op_duration_us(op);
+
+        op->done_us = sim_now_us() + duration;
+        op->flash_us = duration - MIN(duration, m_timing.op_overhead_us);
+    }
+}
+
+static uint16_t data_crc(void const *p_data, uint16_t length_words)
+{
+    return crc16_compute(p_data, length_words * sizeof(uint32_t), NULL);
+}
+
+static bool record_put(sim_op_t *op)
+{
+    uint8_t page = op->page;
+    uint16_t words = FDS_HEADER_SIZE + op->length_words;
+    uint32_t *p_record;
+
+    m_words_reserved[page] -= words;
+
+    if (m_write_offset[page] + words > SIM_PAGE_WORDS)
+    {
+        return false;
+    }
+
+    if (data_crc(op->p_data, op->length_words) != op->data_crc)
+    {
+        sim_stats.buffer_changes++;
+    }
+
+    p_record = &m_flash[page][m_write_offset[page]];
+
+    /* Length first, the record id last: an interrupted write is never valid */
+    flash_write_word(&p_record[0], op->record_key | ((uint32_t) op->length_words << 16));
+    flash_write(&p_record[FDS_HEADER_SIZE], op->p_data, op->length_words);
+    flash_write_word(&p_record[1], op->file_id | 0xFFFF0000);
+    flash_write_word(&p_record[2], op->record_id);
+
+    m_write_offset[page] += words;
+
+    return true;
+}
+
+static void record_invalidate(uint32_t const *p_record)
+{
+    flash_write_word((uint32_t *) p_record, *p_record & 0xFFFF0000);
+}
+
+static void gc_run(void)
+{
+    uint8_t page;
+    uint8_t swap;
+    int i;
+
+    for (page = 0; page < FDS_PHY_PAGES; page++)
+    {
+        uint32_t const *p_record;
+        uint16_t offset = FDS_PAGE_TAG_SIZE;
+        bool has_dirty;
+
+        if (m_page_type[page] != page_data)
+        {
+            continue;
+        }
+
+        gc_words_to_copy(page, &has_dirty);
+
+        if (!has_dirty)
+        {
+            continue;
+        }
+
+        for (swap = 0; swap < FDS_PHY_PAGES && m_page_type[swap] != page_swap; swap++)
+        {
+        }
+
+        if (swap == FDS_PHY_PAGES)
+        {
+            return;
+        }
+
+        for (p_record = page_record_next(page, NULL);
+             p_record != NULL;
+             p_record = page_record_next(page, p_record + record_words(p_record)))
+        {
+            if (record_is_valid(p_record))
+            {
+                flash_write(&m_flash[swap][offset], p_record, record_words(p_record));
+                offset += record_words(p_record);
+            }
+        }
+
+        flash_erase(page);
+        flash_write_word(&m_flash[page][0], SIM_TAG_MAGIC);
+        flash_write_word(&m_flash[page][1], SIM_TAG_SWAP);
+
+        /* Promote the swap page, SWAP -> DATA only clears a bit */
+        flash_write_word(&m_flash[swap][1], SIM_TAG_DATA);
+
+        m_page_type[swap] = page_data;
+        m_write_offset[swap] = offset;
+        m_words_reserved[swap] = m_words_reserved[page];
+
+        m_page_type[page] = page_swap;
+        m_write_offset[page] = FDS_PAGE_TAG_SIZE;
+        m_words_reserved[page] = 0;
+
+        /* Space reserved by queued writes moves along with the page */
+        for (i = 0; i < m_queue_count; i++)
+        {
+            sim_op_t *op = &m_queue[(m_queue_head + i) % FDS_OP_QUEUE_SIZE];
+
+            if ((op->type == op_write || op->type == op_update) && op->page == page)
+            {
+                op->page = swap;
+            }
+        }
+    }
+
+    m_gc_run_count++;
+    sim_stats.gc_runs++;
+}
+
+static void del_file_run(uint16_t file_id)
+{
+    uint8_t page;
+    uint32_t const *p_record;
+
+    for (page = 0; page < FDS_PHY_PAGES; page++)
+    {
+        if (m_page_type[page] != page_data)
+        {
+            continue;
+        }
+
+        for (p_record = page_record_next(page, NULL);
+             p_record != NULL;
+             p_record = page_record_next(page, p_record + record_words(p_record)))
+        {
+            if (record_is_valid(p_record) && header_at(p_record)->file_id == file_id)
+            {
+                record_invalidate(p_record);
+            }
+        }
+    }
+}
+
+void sim_latency_add(sim_op_kind_t kind, uint64_t latency_us)
+{
+    sim_latency_log_t *log = &m_latency[kind];
+
+    if (log->count < SIM_LATENCY_SAMPLES)
+    {
+        log->samples[log->count] = latency_us;
+    }
+
+    log->count++;
+    log->total_us += latency_us;
+    log->max_us = MAX(log->max_us, latency_us);
+}
+
+static void event_send(fds_evt_t const *evt)
+{
+    uint8_t i;
+
+    for (i = 0; i < m_user_count; i++)
+    {
+        m_users[i](evt);
+    }
+}
+
+uint64_t sim_fds_next_us(void)
+{
+    if (m_queue_count == 0)
+    {
+        return SIM_NEVER;
+    }
+
+    op_start_head();
+
+    return m_queue[m_queue_head].done_us;
+}
+
+uint64_t sim_fds_stall_end_us(uint64_t time_us)
+{
+    sim_op_t const *op;
+
+    if (m_queue_count == 0)
+    {
+        return time_us;
+    }
+
+    op_start_head();
+    op = &m_queue[m_queue_head];
+
+    /* The timeslot wait before it does not stall anything */
+    if (time_us >= op->done_us - op->flash_us && time_us < op->done_us)
+    {
+        return op->done_us;
+    }
+
+    return time_us;
+}
+
+void sim_fds_complete(uint64_t now_us)
+{
+    sim_op_t op;
+    fds_evt_t evt;
+    uint32_t const *p_record;
+
+    if (m_queue_count == 0 || m_queue[m_queue_head].done_us > now_us)
+    {
+        return;
+    }
+
+    op = m_queue[m_queue_head];
+
+    memset(&evt, 0, sizeof(evt));
+    evt.result = NRF_SUCCESS;
+
+    switch (op.type)
+    {
+        case op_init:
+            pages_format(false);
+            m_initialized = true;
+            evt.id = FDS_EVT_INIT;
+            break;
+
+        case op_write:
+        case op_update:
+            if (!record_put(&m_queue[m_queue_head]))
+            {
+                evt.result = FDS_ERR_NO_SPACE_IN_FLASH;
+            }
+            else if (op.type == op_update && (p_record = record_by_id(op.old_record_id)) != NULL)
+            {
+                record_invalidate(p_record);
+            }
+
+            evt.id = (op.type == op_write) ? FDS_EVT_WRITE : FDS_EVT_UPDATE;
+            evt.write.record_id = op.record_id;
+            evt.write.file_id = op.file_id;
+            evt.write.record_key = op.record_key;
+            evt.write.is_record_updated = (op.type == op_update);
+
+            sim_latency_add(sim_op_write, now_us - op.queued_us);
+            break;
+
+        case op_delete:
+            p_record = record_by_id(op.record_id);
+
+            if (p_record != NULL)
+            {
+                evt.del.file_id = header_at(p_record)->file_id;
+                evt.del.record_key = header_at(p_record)->record_key;
+                record_invalidate(p_record);
+            }
+            else
+            {
+                evt.result = FDS_ERR_NOT_FOUND;
+            }
+
+            evt.id = FDS_EVT_DEL_RECORD;
+            evt.del.record_id = op.record_id;
+
+            sim_latency_add(sim_op_delete, now_us - op.queued_us);
+            break;
+
+        case op_del_file:
+            del_file_run(op.file_id);
+
+            evt.id = FDS_EVT_DEL_FILE;
+            evt.del.file_id = op.file_id;
+
+            sim_latency_add(sim_op_delete, now_us - op.queued_us);
+            break;
+
+        case op_gc:
+            gc_run();
+
+            evt.id = FDS_EVT_GC;
+
+            sim_latency_add(sim_op_gc, now_us - op.queued_us);
+            break;
+    }
+
+    /* Dequeue before the event, handlers may queue the next operation */
+    m_queue_head = (m_queue_head + 1) % FDS_OP_QUEUE_SIZE;
+    m_queue_count--;
+    m_event_queued_us = op.queued_us;
+
+    event_send(&evt);
+}
+
+uint64_t sim_fds_event_queued_us(void)
+{
+    return m_event_queued_us;
+}
+
+void sim_fds_reset(sim_flash_timing_t const *timing, bool erase)
+{
+    uint8_t page;
+
+    if (timing != NULL)
+    {
+        m_timing = *timing;
+    }
+
+    if (erase)
+    {
+        for (page = 0; page < FDS_PHY_PAGES; page++)
+        {
+            memset(m_flash[page], 0xFF, SIM_PAGE_BYTES);
+        }
+
+        memset(m_latency, 0, sizeof(m_latency));
+    }
+
+    m_queue_head = 0;
+    m_queue_count = 0;
+    m_user_count = 0;
+    m_initialized = false;
+    m_gc_run_count = 0;
+    m_open_records = 0;
+}
+
+static int latency_cmp(void const *a, void const *b)
+{
+    uint32_t x = *(uint32_t const *) a;
+    uint32_t y = *(uint32_t const *) b;
+
+    return (x > y) - (x < y);
+}
+
+void sim_latency_get(sim_op_kind_t kind, sim_latency_t *latency)
+{
+    sim_latency_log_t *log = &m_latency[kind];
+    uint32_t samples = MIN(log->count, SIM_LATENCY_SAMPLES);
+
+    memset(latency, 0, sizeof(*latency));
+
+    if (log->count == 0)
+    {
+        return;
+    }
+
+    qsort(log->samples, samples, sizeof(uint32_t), latency_cmp);
+
+    latency->count = log->count;
+    latency->avg_us = log->total_us / log->count;
+    latency->p99_us = log->samples[(samples - 1) * 99 / 100];
+    latency->max_us = log->max_us;
+}
+
+ret_code_t fds_register(fds_cb_t cb)
+{
+    if (m_user_count == FDS_MAX_USERS)
+    {
+        return FDS_ERR_USER_LIMIT_REACHED;
+    }
+
+    m_users[m_user_count++] = cb;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_init(void)
+{
+    if (op_alloc(op_init) == NULL)
+    {
+        return FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+
+    /* Pages are checked right away, formatting them is queued */
+    pages_scan();
+
+    return NRF_SUCCESS;
+}
+
+static ret_code_t write_enqueue(sim_op_type_t type,
+                                fds_record_desc_t * p_desc,
+                                fds_record_t const * p_record)
+{
+    uint16_t words = FDS_HEADER_SIZE + p_record->data.length_words;
+    sim_op_t *op;
+    uint8_t page;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+
+    if (words > SIM_PAGE_WORDS - FDS_PAGE_TAG_SIZE)
+    {
+        return FDS_ERR_RECORD_TOO_LARGE;
+    }
+
+    if (m_queue_count == FDS_OP_QUEUE_SIZE)
+    {
+        sim_stats.queue_full++;
+        return FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+
+    if (!space_reserve(words, &page))
+    {
+        sim_stats.no_space++;
+        return FDS_ERR_NO_SPACE_IN_FLASH;
+    }
+
+    op = op_alloc(type);
+    op->record_id = ++m_last_record_id;
+    op->old_record_id = (type == op_update) ? p_desc->record_id : 0;
+    op->file_id = p_record->file_id;
+    op->record_key = p_record->key;
+    op->p_data = p_record->data.p_data;
+    op->length_words = p_record->data.length_words;
+    op->data_crc = data_crc(op->p_data, op->length_words);
+    op->page = page;
+
+    p_desc->record_id = op->record_id;
+    p_desc->p_record = NULL;
+    p_desc->gc_run_count = m_gc_run_count;
+    p_desc->record_is_open = false;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_record_write(fds_record_desc_t * p_desc, fds_record_t const * p_record)
+{
+    fds_record_desc_t desc;
+
+    return write_enqueue(op_write, (p_desc != NULL) ? p_desc : &desc, p_record);
+}
+
+ret_code_t fds_record_update(fds_record_desc_t * p_desc, fds_record_t const * p_record)
+{
+    return write_enqueue(op_update, p_desc, p_record);
+}
+
+ret_code_t fds_record_delete(fds_record_desc_t * p_desc)
+{
+    sim_op_t *op;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+
+    op = op_alloc(op_delete);
+
+    if (op == NULL)
+    {
+        return FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+
+    op->record_id = p_desc->record_id;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_file_delete(uint16_t file_id)
+{
+    sim_op_t *op;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+
+    op = op_alloc(op_del_file);
+
+    if (op == NULL)
+    {
+        return FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+
+    op->file_id = file_id;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_gc(void)
+{
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+
+    return (op_alloc(op_gc) != NULL) ? NRF_SUCCESS : FDS_ERR_NO_SPACE_IN_QUEUES;
+}
+
+static ret_code_t record_find(bool match_key,
+                              uint16_t file_id,
+                              uint16_t record_key,
+                              fds_record_desc_t * p_desc,
+                              fds_find_token_t * p_token)
+{
+    uint8_t page = p_token->page;
+    uint32_t const *p_record;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+
+    for (; page < FDS_PHY_PAGES; page++)
+    {
+        if (m_page_type[page] != page_data)
+        {
+            continue;
+        }
+
+        /* Resume behind the record the token points at */
+        p_record = (p_token->p_addr != NULL && p_token->page == page)
+                 ? page_record_next(page, p_token->p_addr + record_words(p_token->p_addr))
+                 : page_record_next(page, NULL);
+
+        for (; p_record != NULL;
+             p_record = page_record_next(page, p_record + record_words(p_record)))
+        {
+            fds_header_t const *header = header_at(p_record);
+
+            if (!record_is_valid(p_record) ||
+                header->file_id != file_id ||
+                (match_key && header->record_key != record_key))
+            {
+                continue;
+            }
+
+            p_token->page = page;
+            p_token->p_addr = p_record;
+
+            p_desc->record_id = header->record_id;
+            p_desc->p_record = p_record;
+            p_desc->gc_run_count = m_gc_run_count;
+            p_desc->record_is_open = false;
+
+            return NRF_SUCCESS;
+        }
+    }
+
+    return FDS_ERR_NOT_FOUND;
+}
+
+ret_code_t fds_record_find(uint16_t file_id,
+                           uint16_t record_key,
+                           fds_record_desc_t * p_desc,
+                           fds_find_token_t * p_token)
+{
+    return record_find(true, file_id, record_key, p_desc, p_token);
+}
+
+ret_code_t fds_record_find_in_file(uint16_t file_id,
+                                   fds_record_desc_t * p_desc,
+                                   fds_find_token_t * p_token)
+{
+    return record_find(false, file_id, 0, p_desc, p_token);
+}
+
+ret_code_t fds_record_open(fds_record_desc_t * p_desc, fds_flash_record_t * p_flash_record)
+{
+    uint32_t const *p_record = record_by_id(p_desc->record_id);
+
+    if (p_record == NULL)
+    {
+        return FDS_ERR_NOT_FOUND;
+    }
+
+    p_desc->p_record = p_record;
+    p_desc->record_is_open = true;
+    m_open_records++;
+
+    p_flash_record->p_header = header_at(p_record);
+    p_flash_record->p_data = p_record + FDS_HEADER_SIZE;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_record_close(fds_record_desc_t * p_desc)
+{
+    if (p_desc->record_is_open)
+    {
+        p_desc->record_is_open = false;
+        m_open_records--;
+    }
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_descriptor_from_rec_id(fds_record_desc_t * p_desc, uint32_t record_id)
+{
+    memset(p_desc, 0, sizeof(*p_desc));
+    p_desc->record_id = record_id;
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t fds_stat(fds_stat_t * p_stat)
+{
+    uint8_t page;
+    uint32_t const *p_record;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+
+    memset(p_stat, 0, sizeof(*p_stat));
+    p_stat->open_records = m_open_records;
+
+    for (page = 0; page < FDS_PHY_PAGES; page++)
+    {
+        if (m_page_type[page] != page_data)
+        {
+            continue;
+        }
+
+        p_stat->pages_available++;
+        p_stat->words_used += m_write_offset[page];
+        p_stat->words_reserved += m_words_reserved[page];
+        p_stat->largest_contig = MAX(p_stat->largest_contig,
+                                     SIM_PAGE_WORDS - m_write_offset[page] - m_words_reserved[page]);
+
+        for (p_record = page_record_next(page, NULL);
+             p_record != NULL;
+             p_record = page_record_next(page, p_record + record_words(p_record)))
+        {
+            if (record_is_valid(p_record))
+            {
+                p_stat->valid_records++;
+            }
+            else
+            {
+                p_stat->dirty_records++;
+                p_stat->freeable_words += record_words(p_record);
+            }
+        }
+    }
+
+    return NRF_SUCCESS;
+}
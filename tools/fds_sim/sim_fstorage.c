@@ -0,0 +1,345 @@
+#include "sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "app_util.h"
+#include "crc16.h"
+#include "nrf.h"
+#include "nrf_fstorage.h"
+#include "nrf_fstorage_sd.h"
+
+/*
+ * The raw flash pages of the LED journal (lib/led_journal.c), written through
+ * nrf_fstorage right below the FDS pages.
+ *
+ * led_journal.c places the pages from UICR and FICR like fds.c does and
+ * reads them through a pointer, so they are mapped at their address on
+ * target: the LED_JOURNAL region of gcc_nrf52.ld, below the PCA10059
+ * bootloader at 0xE0000. The build defines the linker symbol of that region
+ * the same way:
+ *   -Wl,--defsym,__led_journal_start=0xdb000
+ *
+ * Operations run one at a time in queue order, a write copies the source
+ * buffer when it completes. The queue has NRF_FSTORAGE_SD_QUEUE_SIZE entries,
+ * FDS has a queue of its own here, while on target both share this one.
+ */
+
+#define SIM_FSTORAGE_START 0xDB000
+#define SIM_FSTORAGE_PAGE_BYTES 4096
+#define SIM_FSTORAGE_END   (SIM_FSTORAGE_START + SIM_RAW_PAGES * SIM_FSTORAGE_PAGE_BYTES)
+
+#define SIM_NEVER UINT64_MAX
+
+typedef struct {
+    nrf_fstorage_t const *p_fs;
+    nrf_fstorage_evt_id_t id;
+    uint32_t addr;
+    void const *p_src;
+    uint32_t len;
+    void *p_param;
+    uint16_t data_crc;
+    uint64_t queued_us;
+    uint64_t done_us;  /* SIM_NEVER until the operation is started */
+    uint64_t flash_us; /* from done_us back, the CPU is halted on flash */
+} sim_fstorage_op_t;
+
+NRF_UICR_Type sim_uicr = { .NRFFW = { [0] = 0xE0000, [1 ... 14] = 0xFFFFFFFF } };
+NRF_FICR_Type sim_ficr = { .CODEPAGESIZE = 4096, .CODESIZE = 256 };
+
+nrf_fstorage_api_t nrf_fstorage_sd = { .name = "sim" };
+
+static uint8_t *m_flash;
+
+static sim_raw_write_observer_t m_observer;
+
+static sim_fstorage_op_t m_queue[NRF_FSTORAGE_SD_QUEUE_SIZE];
+static uint8_t m_queue_head;
+static uint8_t m_queue_count;
+
+static void flash_map(void)
+{
+    void *p_flash;
+
+    if (m_flash != NULL)
+    {
+        return;
+    }
+
+    p_flash = mmap((void *) SIM_FSTORAGE_START,
+                   SIM_FSTORAGE_END - SIM_FSTORAGE_START,
+                   PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                   -1,
+                   0);
+
+    if (p_flash != (void *) SIM_FSTORAGE_START)
+    {
+        fprintf(stderr, "Unable to map the journal pages at 0x%X\n", SIM_FSTORAGE_START);
+        exit(EXIT_FAILURE);
+    }
+
+    m_flash = p_flash;
+    memset(m_flash, 0xFF, SIM_FSTORAGE_END - SIM_FSTORAGE_START);
+}
+
+static bool range_is_valid(nrf_fstorage_t const *p_fs, uint32_t addr, uint32_t len)
+{
+    return addr >= p_fs->start_addr && addr + len <= p_fs->end_addr &&
+           addr >= SIM_FSTORAGE_START && addr + len <= SIM_FSTORAGE_END;
+}
+
+static uint64_t op_duration_us(sim_fstorage_op_t const *op)
+{
+    sim_flash_timing_t const *timing = sim_flash_timing();
+
+    if (op->id == NRF_FSTORAGE_EVT_ERASE_RESULT)
+    {
+        return timing->op_overhead_us + (uint64_t) op->len * timing->erase_page_us;
+    }
+
+    return timing->op_overhead_us + (uint64_t) op->len / sizeof(uint32_t) * timing->write_word_us;
+}
+
+static void op_start_head(void)
+{
+    sim_fstorage_op_t *op;
+
+    if (m_queue_count == 0)
+    {
+        return;
+    }
+
+    op = &m_queue[m_queue_head];
+
+    if (op->done_us == SIM_NEVER)
+    {
+        uint64_t duration = op_duration_us(op);
+
+        op->done_us = sim_now_us() + duration;
+        op->flash_us = duration - MIN(duration, sim_flash_timing()->op_overhead_us);
+    }
+}
+
+static ret_code_t op_enqueue(sim_fstorage_op_t const *op)
+{
+    sim_fstorage_op_t *slot;
+
+    if (m_queue_count == NRF_FSTORAGE_SD_QUEUE_SIZE)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    slot = &m_queue[(m_queue_head + m_queue_count) % NRF_FSTORAGE_SD_QUEUE_SIZE];
+    m_queue_count++;
+
+    *slot = *op;
+    slot->queued_us = sim_now_us();
+    slot->done_us = SIM_NEVER;
+
+    return NRF_SUCCESS;
+}
+
+static void flash_write(uint32_t addr, void const *p_src, uint32_t len)
+{
+    uint32_t *dst = (uint32_t *) (uintptr_t) addr;
+    uint32_t const *src = p_src;
+    uint32_t i;
+
+    for (i = 0; i < len / sizeof(uint32_t); i++)
+    {
+        if ((dst[i] & src[i]) != src[i])
+        {
+            sim_stats.bit_set_violations++;
+        }
+
+        /* Programming can only clear bits */
+        dst[i] &= src[i];
+        sim_stats.words_written++;
+    }
+}
+
+static uint64_t fstorage_next_us(void)
+{
+    if (m_queue_count == 0)
+    {
+        return SIM_NEVER;
+    }
+
+    op_start_head();
+
+    return m_queue[m_queue_head].done_us;
+}
+
+static void fstorage_complete(uint64_t now_us)
+{
+    sim_fstorage_op_t op;
+    nrf_fstorage_evt_t evt;
+
+    if (m_queue_count == 0 || m_queue[m_queue_head].done_us > now_us)
+    {
+        return;
+    }
+
+    op = m_queue[m_queue_head];
+
+    m_queue_head = (m_queue_head + 1) % NRF_FSTORAGE_SD_QUEUE_SIZE;
+    m_queue_count--;
+
+    if (op.id == NRF_FSTORAGE_EVT_ERASE_RESULT)
+    {
+        uint32_t page = (op.addr - SIM_FSTORAGE_START) / SIM_FSTORAGE_PAGE_BYTES;
+        uint32_t i;
+
+        memset((void *) (uintptr_t) op.addr, 0xFF, op.len * SIM_FSTORAGE_PAGE_BYTES);
+
+        for (i = 0; i < op.len; i++)
+        {
+            sim_stats.raw_page_erases[page + i]++;
+        }
+
+        /* A compaction erase takes the place of garbage collection */
+        sim_latency_add(sim_op_gc, now_us - op.queued_us);
+    }
+    else
+    {
+        if (op.data_crc != crc16_compute(op.p_src, op.len, NULL))
+        {
+            sim_stats.buffer_changes++;
+        }
+
+        flash_write(op.addr, op.p_src, op.len);
+        sim_latency_add(sim_op_write, now_us - op.queued_us);
+
+        if (m_observer != NULL)
+        {
+            m_observer((uint32_t const *) (uintptr_t) op.addr, op.len / sizeof(uint32_t));
+        }
+    }
+
+    memset(&evt, 0, sizeof(evt));
+
+    evt.id = op.id;
+    evt.result = NRF_SUCCESS;
+    evt.addr = op.addr;
+    evt.p_src = op.p_src;
+    evt.len = op.len;
+    evt.p_param = op.p_param;
+
+    if (op.p_fs->evt_handler != NULL)
+    {
+        op.p_fs->evt_handler(&evt);
+    }
+}
+
+static uint64_t fstorage_stall_end_us(uint64_t time_us)
+{
+    sim_fstorage_op_t const *op;
+
+    if (m_queue_count == 0)
+    {
+        return time_us;
+    }
+
+    op_start_head();
+    op = &m_queue[m_queue_head];
+
+    if (time_us >= op->done_us - op->flash_us && time_us < op->done_us)
+    {
+        return op->done_us;
+    }
+
+    return time_us;
+}
+
+static void fstorage_reset(bool erase)
+{
+    if (erase)
+    {
+        memset(m_flash, 0xFF, SIM_FSTORAGE_END - SIM_FSTORAGE_START);
+    }
+
+    m_queue_head = 0;
+    m_queue_count = 0;
+}
+
+static sim_flash_client_t const m_client = {
+    .next_us = fstorage_next_us,
+    .complete = fstorage_complete,
+    .stall_end_us = fstorage_stall_end_us,
+    .reset = fstorage_reset,
+};
+
+void sim_raw_write_observer_set(sim_raw_write_observer_t observer)
+{
+    m_observer = observer;
+}
+
+ret_code_t nrf_fstorage_init(nrf_fstorage_t * p_fs, nrf_fstorage_api_t * p_api, void * p_param)
+{
+    if (p_fs->start_addr < SIM_FSTORAGE_START || p_fs->end_addr > SIM_FSTORAGE_END)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    p_fs->p_api = p_api;
+
+    flash_map();
+    sim_flash_client_set(&m_client);
+
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_fstorage_write(nrf_fstorage_t const * p_fs,
+                              uint32_t dest,
+                              void const * p_src,
+                              uint32_t len,
+                              void * p_param)
+{
+    sim_fstorage_op_t op = {
+        .p_fs = p_fs,
+        .id = NRF_FSTORAGE_EVT_WRITE_RESULT,
+        .addr = dest,
+        .p_src = p_src,
+        .len = len,
+        .p_param = p_param,
+    };
+
+    if (len == 0 || len % sizeof(uint32_t) != 0 || dest % sizeof(uint32_t) != 0)
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    if (!range_is_valid(p_fs, dest, len))
+    {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+
+    op.data_crc = crc16_compute(p_src, len, NULL);
+
+    return op_enqueue(&op);
+}
+
+ret_code_t nrf_fstorage_erase(nrf_fstorage_t const * p_fs,
+                              uint32_t page_addr,
+                              uint32_t len,
+                              void * p_param)
+{
+    sim_fstorage_op_t op = {
+        .p_fs = p_fs,
+        .id = NRF_FSTORAGE_EVT_ERASE_RESULT,
+        .addr = page_addr,
+        .len = len,
+        .p_param = p_param,
+    };
+
+    if (page_addr % SIM_FSTORAGE_PAGE_BYTES != 0 ||
+        !range_is_valid(p_fs, page_addr, len * SIM_FSTORAGE_PAGE_BYTES))
+    {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+
+    return op_enqueue(&op);
+}